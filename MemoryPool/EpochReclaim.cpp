@@ -0,0 +1,186 @@
+#include "EpochReclaim.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+    constexpr size_t LOCAL_BATCH = 64;     // 本线程缓冲这么多退休对象后交给全局
+
+    // deleter 为空时 context 是 LockFreeMultiSizePool，按 size 归还
+    struct Retired {
+        void* ptr;
+        epoch::Deleter deleter;
+        void* context;
+        size_t size;
+    };
+
+    // 交给全局时的 epoch 不小于其中任何对象退休时的 epoch，按它判断到期是保守的
+    struct Batch {
+        uint64_t epoch;
+        std::vector<Retired> items;
+    };
+
+    struct alignas(CACHE_LINE_SIZE) Participant {
+        std::atomic<uint64_t> state{0};    // 在临界区内时为 (epoch << 1) | 1，否则为 0
+        std::atomic<bool> in_use{false};
+        Participant* next = nullptr;
+    };
+
+    std::atomic<uint64_t> global_epoch{1};
+    // 记录只增不减，线程退出后由之后的线程复用
+    std::atomic<Participant*> participants{nullptr};
+
+    std::mutex limbo_mtx;
+    std::deque<Batch> limbo;               // 按 epoch 递增
+    std::atomic<size_t> pending_count{0};
+
+    Participant* acquire_participant() {
+        for (Participant* p = participants.load(std::memory_order_acquire); p; p = p->next) {
+            bool expected = false;
+            if (!p->in_use.load(std::memory_order_relaxed)
+                && p->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                return p;
+            }
+        }
+        auto* p = new Participant();
+        p->in_use.store(true, std::memory_order_relaxed);
+        Participant* old_head = participants.load(std::memory_order_relaxed);
+        do {
+            p->next = old_head;
+        } while (!participants.compare_exchange_weak(old_head, p, std::memory_order_release, std::memory_order_relaxed));
+        return p;
+    }
+
+    void hand_off(std::vector<Retired>& items) {
+        if (items.empty()) return;
+        uint64_t stamp = global_epoch.load(std::memory_order_seq_cst);
+        std::lock_guard<std::mutex> lock(limbo_mtx);
+        limbo.push_back(Batch{stamp, std::move(items)});
+        items.clear();
+    }
+
+    struct LocalState {
+        Participant* participant = nullptr;
+        uint32_t nesting = 0;
+        std::vector<Retired> buffer;
+
+        // 线程退出时缓冲的对象交给全局，由其他线程回收
+        ~LocalState() {
+            hand_off(buffer);
+            if (participant) {
+                participant->state.store(0, std::memory_order_release);
+                participant->in_use.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    thread_local LocalState local;
+
+    // 所有在临界区内的读者都已看到当前 epoch 时前进一步
+    bool try_advance() {
+        uint64_t current = global_epoch.load(std::memory_order_seq_cst);
+        for (Participant* p = participants.load(std::memory_order_acquire); p; p = p->next) {
+            uint64_t state = p->state.load(std::memory_order_seq_cst);
+            if ((state & 1) && (state >> 1) != current) return false;
+        }
+        global_epoch.compare_exchange_strong(current, current + 1, std::memory_order_seq_cst);
+        return true;
+    }
+
+    void free_items(std::vector<Retired>& items) {
+        // 归还内存池的对象按 (内存池, 大小) 排序后成段调用 deallocate_bulk
+        auto pooled = std::partition(items.begin(), items.end(), [](const Retired& item) { return item.deleter != nullptr; });
+        for (auto it = items.begin(); it != pooled; ++it) it->deleter(it->ptr, it->context);
+        std::sort(pooled, items.end(), [](const Retired& a, const Retired& b) {
+            return a.context != b.context ? a.context < b.context : a.size < b.size;
+        });
+        std::vector<void*> ptrs;
+        for (auto it = pooled; it != items.end();) {
+            auto run_end = std::find_if(it, items.end(), [&](const Retired& item) {
+                return item.context != it->context || item.size != it->size;
+            });
+            ptrs.clear();
+            for (auto r = it; r != run_end; ++r) ptrs.push_back(r->ptr);
+            static_cast<LockFreeMultiSizePool*>(it->context)->deallocate_bulk(ptrs.data(), ptrs.size(), it->size);
+            it = run_end;
+        }
+    }
+
+    // 回收所有到期的批次，回调在锁外执行
+    size_t reclaim() {
+        std::vector<Retired> expired;
+        {
+            std::lock_guard<std::mutex> lock(limbo_mtx);
+            uint64_t current = global_epoch.load(std::memory_order_seq_cst);
+            while (!limbo.empty() && limbo.front().epoch + 2 <= current) {
+                auto& items = limbo.front().items;
+                expired.insert(expired.end(), items.begin(), items.end());
+                limbo.pop_front();
+            }
+        }
+        free_items(expired);
+        pending_count.fetch_sub(expired.size(), std::memory_order_relaxed);
+        return expired.size();
+    }
+
+    void push_local(const Retired& item) {
+        local.buffer.push_back(item);
+        pending_count.fetch_add(1, std::memory_order_relaxed);
+        if (local.buffer.size() >= LOCAL_BATCH) epoch::flush();
+    }
+}
+
+void epoch::enter() {
+    LocalState& state = local;
+    if (state.nesting++ > 0) return;
+    if (!state.participant) state.participant = acquire_participant();
+    state.participant->state.store(global_epoch.load(std::memory_order_relaxed) << 1 | 1, std::memory_order_relaxed);
+    // 公布 epoch 必须先于临界区内的读取对其他线程可见
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void epoch::exit() {
+    LocalState& state = local;
+    if (--state.nesting == 0) {
+        state.participant->state.store(0, std::memory_order_release);
+    }
+}
+
+void epoch::retire(void* ptr, Deleter deleter, void* context) {
+    push_local(Retired{ptr, deleter, context, 0});
+}
+
+void epoch::retire(LockFreeMultiSizePool& pool, void* ptr, size_t size) {
+    push_local(Retired{ptr, nullptr, &pool, size});
+}
+
+size_t epoch::flush() {
+    hand_off(local.buffer);
+    try_advance();
+    return reclaim();
+}
+
+void epoch::synchronize() {
+    if (local.nesting > 0) {
+        LOG_WARNING("epoch::synchronize called inside a critical section");
+        return;
+    }
+    hand_off(local.buffer);
+    // 交给全局的批次 epoch 都不超过 target - 2，前进到 target 后全部到期
+    uint64_t target = global_epoch.load(std::memory_order_seq_cst) + 2;
+    while (global_epoch.load(std::memory_order_seq_cst) < target) {
+        if (!try_advance()) std::this_thread::yield();
+    }
+    reclaim();
+}
+
+uint64_t epoch::current() {
+    return global_epoch.load(std::memory_order_relaxed);
+}
+
+size_t epoch::pending() {
+    return pending_count.load(std::memory_order_relaxed);
+}
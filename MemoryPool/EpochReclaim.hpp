@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "MemoryPool.hpp"
+
+// 基于 epoch 的延迟回收（EBR）
+// 读者在临界区内访问共享节点：进入时记下全局 epoch，退出时清除
+// 写者把节点从共享结构中摘下后 retire；所有在临界区内的读者都已看到当前 epoch 时，全局 epoch 前进一步
+// 全局 epoch 比退休时大 2 之后，任何读者都不可能再持有该节点，按批回收
+// 与 hazard pointer 相比读者只写本线程的一个字，开销更低；代价是停在临界区中的读者会阻止所有回收
+namespace epoch {
+    using Deleter = void (*)(void* ptr, void* context);
+
+    // 进入 / 退出临界区，可以嵌套
+    void enter();
+    void exit();
+
+    class Guard {
+    public:
+        Guard() { enter(); }
+        ~Guard() { exit(); }
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    };
+
+    // ptr 已从共享结构中摘下，宽限期过后调用 deleter(ptr, context)
+    void retire(void* ptr, Deleter deleter, void* context = nullptr);
+
+    template<typename T>
+    void retire(T* ptr) {
+        retire(ptr, [](void* p, void*) { delete static_cast<T*>(p); });
+    }
+
+    // 宽限期过后归还 pool，同一内存池、同一大小的块合并为一次 deallocate_bulk
+    void retire(LockFreeMultiSizePool& pool, void* ptr, size_t size);
+
+    // 把本线程缓冲的退休对象交给全局并尝试推进 epoch、回收到期的批次，返回回收的对象数
+    size_t flush();
+
+    // 等待完整的宽限期并回收所有已交给全局的对象（包括本线程缓冲的），不能在临界区内调用
+    // 销毁 retire 时传入的内存池之前，需要在所有退休过对象的线程退出或调用 flush 之后调用
+    void synchronize();
+
+    // 当前全局 epoch
+    uint64_t current();
+
+    // 已退休、尚未回收的对象数
+    size_t pending();
+}
@@ -0,0 +1,257 @@
+// 全局分配器替换模式
+// 链接 memoryPoolNew 后进程内的 operator new/delete 由内存池提供；
+// 以 MEMORYPOOL_REPLACE_MALLOC 编译的 libmemoryPoolMalloc.so 还会接管 malloc 系列函数，可通过 LD_PRELOAD 使用：
+//     LD_PRELOAD=lib/libmemoryPoolMalloc.so bin/memoryPoolTest
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <unistd.h>
+#ifdef MEMORYPOOL_REPLACE_MALLOC
+#include <dlfcn.h>
+#endif
+
+#include "MemoryPool.hpp"
+
+#ifdef MEMORYPOOL_REPLACE_MALLOC
+extern "C" {
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* ptr, size_t size);
+    void* __libc_memalign(size_t alignment, size_t size);
+    void __libc_free(void* ptr);
+}
+#endif
+
+namespace {
+    // 与 LockFreeMultiSizePool 使用相同的大小类，但类型不同，线程缓存不会与用户创建的内存池混用
+    struct GlobalSizeClasses : DefaultSizeClasses {};
+    using GlobalPool = BasicMultiSizePool<GlobalSizeClasses>;
+
+    // 每次分配前都写在用户指针之前，free/operator delete 不带大小时据此归还
+    // magic 位于用户指针前 4 字节，glibc chunk 头在该位置是 size 字段的高 32 位（恒为 0），据此区分指针来源
+    struct alignas(std::max_align_t) AllocHeader {
+        size_t size;        // 向内存池申请的总字节数
+        uint32_t offset;    // 用户指针距原始指针的偏移
+        uint32_t magic;
+    };
+    static_assert(sizeof(AllocHeader) == 16);
+
+    constexpr uint32_t HEADER_MAGIC = 0x4d504f4c;
+    constexpr size_t MIN_ALIGNMENT = alignof(std::max_align_t);
+
+    // 内存池内部（registry、日志、TLS 析构注册等）的分配会重入，重入期间交给 libc
+    thread_local bool in_pool __attribute__((tls_model("initial-exec"))) = false;
+
+    struct ReentryGuard {
+        ReentryGuard() { in_pool = true; }
+        ~ReentryGuard() { in_pool = false; }
+    };
+
+    void* fallback_alloc(size_t size, size_t alignment) {
+#ifdef MEMORYPOOL_REPLACE_MALLOC
+        return alignment <= MIN_ALIGNMENT ? __libc_malloc(size) : __libc_memalign(alignment, size);
+#else
+        return alignment <= MIN_ALIGNMENT ? std::malloc(size) : std::aligned_alloc(alignment, align_of(size, alignment));
+#endif
+    }
+
+    void fallback_free(void* ptr) {
+#ifdef MEMORYPOOL_REPLACE_MALLOC
+        __libc_free(ptr);
+#else
+        std::free(ptr);
+#endif
+    }
+
+    // 内存池放在静态存储中且从不析构，保证静态对象析构阶段和其他线程退出时仍可释放
+    // 与其他内存池一样登记在 pool_lifetime 中，fork 前后的加锁由它的 pthread_atfork 处理函数完成
+    GlobalPool& global_pool() {
+        alignas(GlobalPool) static std::byte storage[sizeof(GlobalPool)];
+        static GlobalPool* pool = new (storage) GlobalPool();
+        return *pool;
+    }
+
+    AllocHeader* header_of(void* ptr) {
+        return reinterpret_cast<AllocHeader*>(ptr) - 1;
+    }
+
+    // 只适用于 glibc：libc 分配的指针前 4 字节读到的是 chunk 头 size 字段的高位
+    // 其他 libc（musl 等）的 chunk 头布局不同，fallback 分配可能被误判为内存池分配
+    bool owned(void* ptr) {
+        return header_of(ptr)->magic == HEADER_MAGIC;
+    }
+
+    void* pool_alloc(size_t size, size_t alignment = MIN_ALIGNMENT) {
+        if (in_pool) return fallback_alloc(size, alignment);
+
+        // 超过默认对齐时多申请 alignment 字节，对齐后的地址前仍有空间存放头部
+        size_t padding = alignment > MIN_ALIGNMENT ? alignment : 0;
+        if (size > SIZE_MAX - sizeof(AllocHeader) - padding) return nullptr;
+        size_t total = size + sizeof(AllocHeader) + padding;
+
+        std::byte* raw;
+        {
+            ReentryGuard guard;
+            raw = static_cast<std::byte*>(global_pool().allocate(total));
+        }
+        if (!raw) return nullptr;
+
+        auto* user = reinterpret_cast<std::byte*>(align_of(reinterpret_cast<uintptr_t>(raw + sizeof(AllocHeader)), alignment));
+        *header_of(user) = AllocHeader{total, static_cast<uint32_t>(user - raw), HEADER_MAGIC};
+        return user;
+    }
+
+    void pool_free(void* ptr) {
+        if (!ptr) return;
+        if (!owned(ptr)) {
+            fallback_free(ptr);
+            return;
+        }
+        AllocHeader* header = header_of(ptr);
+        auto* raw = reinterpret_cast<std::byte*>(ptr) - header->offset;
+        size_t total = header->size;
+        header->magic = 0;
+
+        bool nested = in_pool;
+        in_pool = true;
+        global_pool().deallocate(raw, total);
+        in_pool = nested;
+    }
+
+#ifdef MEMORYPOOL_REPLACE_MALLOC
+    // 用户可用的字节数
+    size_t usable_size(void* ptr) {
+        AllocHeader* header = header_of(ptr);
+        return header->size - header->offset;
+    }
+#endif
+
+    void* new_impl(size_t size, size_t alignment) {
+        for (;;) {
+            if (void* ptr = pool_alloc(size > 0 ? size : 1, alignment)) return ptr;
+            std::new_handler handler = std::get_new_handler();
+            if (!handler) throw std::bad_alloc();
+            handler();
+        }
+    }
+
+    void* new_nothrow(size_t size, size_t alignment) noexcept {
+        try {
+            return new_impl(size, alignment);
+        } catch (...) {
+            return nullptr;
+        }
+    }
+}
+
+void* operator new(size_t size) { return new_impl(size, MIN_ALIGNMENT); }
+void* operator new[](size_t size) { return new_impl(size, MIN_ALIGNMENT); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return new_nothrow(size, MIN_ALIGNMENT); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return new_nothrow(size, MIN_ALIGNMENT); }
+void* operator new(size_t size, std::align_val_t align) { return new_impl(size, static_cast<size_t>(align)); }
+void* operator new[](size_t size, std::align_val_t align) { return new_impl(size, static_cast<size_t>(align)); }
+void* operator new(size_t size, std::align_val_t align, const std::nothrow_t&) noexcept { return new_nothrow(size, static_cast<size_t>(align)); }
+void* operator new[](size_t size, std::align_val_t align, const std::nothrow_t&) noexcept { return new_nothrow(size, static_cast<size_t>(align)); }
+
+// 头部记录了实际大小，sized/aligned 版本无需额外信息
+void operator delete(void* ptr) noexcept { pool_free(ptr); }
+void operator delete[](void* ptr) noexcept { pool_free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { pool_free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { pool_free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { pool_free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { pool_free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { pool_free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { pool_free(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { pool_free(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { pool_free(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { pool_free(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { pool_free(ptr); }
+
+#ifdef MEMORYPOOL_REPLACE_MALLOC
+extern "C" {
+
+void* malloc(size_t size) {
+    void* ptr = pool_alloc(size > 0 ? size : 1);
+    if (!ptr) errno = ENOMEM;
+    return ptr;
+}
+
+void free(void* ptr) {
+    pool_free(ptr);
+}
+
+void* calloc(size_t count, size_t size) {
+    if (in_pool) return __libc_calloc(count, size);
+    if (size != 0 && count > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    // 池中的块会被复用，必须清零
+    void* ptr = malloc(count * size);
+    if (ptr) std::memset(ptr, 0, count * size);
+    return ptr;
+}
+
+void* realloc(void* ptr, size_t size) {
+    if (!ptr) return malloc(size);
+    if (size == 0) {
+        free(ptr);
+        return nullptr;
+    }
+    if (!owned(ptr)) {
+        return __libc_realloc(ptr, size);
+    }
+
+    // 容量足够且不会浪费一半以上时原地返回
+    size_t capacity = usable_size(ptr);
+    if (size <= capacity && size >= capacity / 2) return ptr;
+
+    void* moved = malloc(size);
+    if (!moved) return nullptr;
+    std::memcpy(moved, ptr, std::min(size, capacity));
+    free(ptr);
+    return moved;
+}
+
+int posix_memalign(void** out, size_t alignment, size_t size) {
+    if (alignment < sizeof(void*) || !std::has_single_bit(alignment)) return EINVAL;
+    void* ptr = pool_alloc(size > 0 ? size : 1, std::max(alignment, MIN_ALIGNMENT));
+    if (!ptr) return ENOMEM;
+    *out = ptr;
+    return 0;
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    if (!std::has_single_bit(alignment)) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    void* ptr = pool_alloc(size > 0 ? size : 1, std::max(alignment, MIN_ALIGNMENT));
+    if (!ptr) errno = ENOMEM;
+    return ptr;
+}
+
+void* memalign(size_t alignment, size_t size) {
+    return aligned_alloc(alignment, size);
+}
+
+void* valloc(size_t size) {
+    return aligned_alloc(static_cast<size_t>(sysconf(_SC_PAGESIZE)), size);
+}
+
+void* pvalloc(size_t size) {
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return aligned_alloc(page, align_of(size > 0 ? size : 1, page));
+}
+
+// fallback 分配来自 libc，交给 libc 的 malloc_usable_size
+size_t malloc_usable_size(void* ptr) {
+    if (!ptr) return 0;
+    if (owned(ptr)) return usable_size(ptr);
+    using UsableSize = size_t (*)(void*);
+    static UsableSize libc_usable_size = reinterpret_cast<UsableSize>(dlsym(RTLD_NEXT, "malloc_usable_size"));
+    return libc_usable_size ? libc_usable_size(ptr) : 0;
+}
+
+}
+#endif
@@ -0,0 +1,121 @@
+#include "HazardPointer.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+
+namespace {
+    // 记录只增不减，链表头之后的节点不再修改 next，遍历不需要加锁
+    std::atomic<hazard::Record*> records{nullptr};
+    std::atomic<size_t> record_count{0};
+
+    hazard::Record* acquire_record() {
+        for (hazard::Record* record = records.load(std::memory_order_acquire); record; record = record->next) {
+            bool expected = false;
+            if (!record->active.load(std::memory_order_relaxed)
+                && record->active.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                return record;
+            }
+        }
+        auto* record = new hazard::Record();
+        record->active.store(true, std::memory_order_relaxed);
+        hazard::Record* old_head = records.load(std::memory_order_relaxed);
+        do {
+            record->next = old_head;
+        } while (!records.compare_exchange_weak(old_head, record, std::memory_order_release, std::memory_order_relaxed));
+        record_count.fetch_add(1, std::memory_order_relaxed);
+        return record;
+    }
+
+    // 线程退出时清空槽并交还记录
+    struct RecordOwner {
+        hazard::Record* record = nullptr;
+
+        ~RecordOwner() {
+            if (!record) return;
+            for (auto& slot : record->slots) slot.store(nullptr, std::memory_order_relaxed);
+            record->used_mask = 0;
+            record->active.store(false, std::memory_order_release);
+        }
+    };
+
+    thread_local RecordOwner record_owner;
+}
+
+hazard::Record& hazard::local_record() {
+    if (!record_owner.record) record_owner.record = acquire_record();
+    return *record_owner.record;
+}
+
+size_t hazard::slot_count() {
+    return record_count.load(std::memory_order_relaxed) * SLOTS_PER_THREAD;
+}
+
+void hazard::collect(std::vector<const void*>& out) {
+    out.clear();
+    for (Record* record = records.load(std::memory_order_acquire); record; record = record->next) {
+        for (auto& slot : record->slots) {
+            if (const void* ptr = slot.load(std::memory_order_acquire)) out.push_back(ptr);
+        }
+    }
+    std::sort(out.begin(), out.end());
+}
+
+HazardPointer::HazardPointer() {
+    hazard::Record& record = hazard::local_record();
+    uint32_t free_mask = ~record.used_mask & ((1u << hazard::SLOTS_PER_THREAD) - 1);
+    if (free_mask == 0) throw std::logic_error("too many hazard pointers held by one thread");
+    index = static_cast<uint32_t>(std::countr_zero(free_mask));
+    record.used_mask |= 1u << index;
+    slot = &record.slots[index];
+}
+
+HazardPointer::~HazardPointer() {
+    slot->store(nullptr, std::memory_order_release);
+    hazard::local_record().used_mask &= ~(1u << index);
+}
+
+HazardCohort::~HazardCohort() {
+    HazardRetirable* node = retired.exchange(nullptr, std::memory_order_acquire);
+    while (node) {
+        HazardRetirable* next = node->retired_next;
+        reclaim_fn(node, context);
+        node = next;
+    }
+}
+
+size_t HazardCohort::reclaim() {
+    // 一次取下全部退休节点，并发的扫描者看到空链表直接返回
+    HazardRetirable* node = retired.exchange(nullptr, std::memory_order_acquire);
+    if (!node) return 0;
+
+    // 节点在退休前已经摘下；fence 之后读到的槽要么登记了它，要么对应的读者重读时会发现它已不在结构中
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    thread_local std::vector<const void*> protected_ptrs;
+    hazard::collect(protected_ptrs);
+
+    size_t reclaimed = 0;
+    HazardRetirable* keep_head = nullptr;
+    HazardRetirable* keep_tail = nullptr;
+    while (node) {
+        HazardRetirable* next = node->retired_next;
+        if (std::binary_search(protected_ptrs.begin(), protected_ptrs.end(), node->hazard_address)) {
+            node->retired_next = keep_head;
+            keep_head = node;
+            if (!keep_tail) keep_tail = node;
+        } else {
+            reclaim_fn(node, context);
+            ++reclaimed;
+        }
+        node = next;
+    }
+    retired_count.fetch_sub(reclaimed, std::memory_order_relaxed);
+
+    if (keep_head) {
+        HazardRetirable* old_head = retired.load(std::memory_order_relaxed);
+        do {
+            keep_tail->retired_next = old_head;
+        } while (!retired.compare_exchange_weak(old_head, keep_head, std::memory_order_release, std::memory_order_relaxed));
+    }
+    return reclaimed;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "MemoryPool.hpp"
+
+// hazard pointer：读取共享节点前先把地址登记到本线程的槽中，回收方扫描所有槽，被登记的节点推迟回收
+// 每个线程一条记录，线程退出后记录保留，由之后的线程复用
+namespace hazard {
+    static constexpr size_t SLOTS_PER_THREAD = 4;
+
+    struct alignas(CACHE_LINE_SIZE) Record {
+        std::atomic<const void*> slots[SLOTS_PER_THREAD] = {};
+        std::atomic<bool> active{false};
+        uint32_t used_mask = 0;     // 已分配出去的槽，只有所属线程访问
+        Record* next = nullptr;
+    };
+
+    // 当前线程的记录，第一次调用时获取
+    Record& local_record();
+
+    // 当前所有记录的槽位数，回收阈值据此确定
+    size_t slot_count();
+
+    // 收集所有槽中登记的指针并排序
+    void collect(std::vector<const void*>& out);
+}
+
+// 占用本线程的一个 hazard 槽，析构时释放；同一线程最多同时持有 SLOTS_PER_THREAD 个
+class HazardPointer {
+public:
+    HazardPointer();
+    ~HazardPointer();
+
+    HazardPointer(const HazardPointer&) = delete;
+    HazardPointer& operator=(const HazardPointer&) = delete;
+
+    // 读取 source 并登记，登记后再次确认 source 未变，返回的节点在 reset 之前不会被回收
+    template<typename T>
+    T* protect(const std::atomic<T*>& source) {
+        T* ptr = source.load(std::memory_order_relaxed);
+        for (;;) {
+            // 登记与重读之间需要 store-load 顺序，与回收方扫描前的 fence 配对
+            slot->store(ptr, std::memory_order_seq_cst);
+            T* current = source.load(std::memory_order_seq_cst);
+            if (current == ptr) return ptr;
+            ptr = current;
+        }
+    }
+
+    void reset() { slot->store(nullptr, std::memory_order_release); }
+
+private:
+    std::atomic<const void*>* slot;
+    uint32_t index;
+};
+
+// 可以退休的节点；退休链接单独存放，退休后仍持有 hazard 的线程可能继续读取节点自身的字段
+// 读者登记的是派生类型的节点地址，基类子对象不一定位于偏移 0，退休时记下该地址供扫描比较
+struct HazardRetirable {
+    HazardRetirable* retired_next = nullptr;
+    const void* hazard_address = nullptr;
+};
+
+// 退休节点的归属方，通常每个容器一个
+// retire 无锁压栈，累积到阈值时由退休的线程扫描 hazard 槽，回收未被登记的节点，其余放回
+// 析构时回收剩余的全部节点，调用方保证此时已经没有线程访问对应的容器
+class HazardCohort {
+public:
+    using Reclaim = void (*)(HazardRetirable* node, void* context);
+
+    HazardCohort(Reclaim reclaim, void* context) : reclaim_fn(reclaim), context(context) {}
+    ~HazardCohort();
+
+    HazardCohort(const HazardCohort&) = delete;
+    HazardCohort& operator=(const HazardCohort&) = delete;
+
+    // 节点已从共享结构中摘下，不再能被新的读者看到
+    // Node 与读者 protect() 时的指针类型相同，扫描时按这个地址匹配 hazard 槽
+    template<typename Node>
+        requires std::derived_from<Node, HazardRetirable>
+    void retire(Node* node) {
+        node->hazard_address = static_cast<const void*>(node);
+        push_retired(node);
+    }
+
+    // 立即扫描一次，返回回收的节点数
+    size_t reclaim();
+
+    // 尚未回收的节点数
+    size_t pending() const { return retired_count.load(std::memory_order_relaxed); }
+
+private:
+    void push_retired(HazardRetirable* node) {
+        HazardRetirable* old_head = retired.load(std::memory_order_relaxed);
+        do {
+            node->retired_next = old_head;
+        } while (!retired.compare_exchange_weak(old_head, node, std::memory_order_release, std::memory_order_relaxed));
+        size_t count = retired_count.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (count >= threshold()) reclaim();
+    }
+
+    // 阈值与槽位总数成正比，一次扫描至少回收一半，均摊到每次退休是常数开销
+    static size_t threshold() { return std::max<size_t>(64, 2 * hazard::slot_count()); }
+
+    Reclaim reclaim_fn;
+    void* context;
+    std::atomic<HazardRetirable*> retired{nullptr};
+    std::atomic<size_t> retired_count{0};
+};
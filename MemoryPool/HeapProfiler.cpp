@@ -0,0 +1,102 @@
+#include "HeapProfiler.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <execinfo.h>
+#include <limits>
+
+#include "logger.hpp"
+
+HeapProfiler& HeapProfiler::instance() {
+    static HeapProfiler* profiler = [] {
+        // glibc 的 backtrace 第一次调用时会 dlopen libgcc_s 并分配内存，这里先调用一次，之后的采样不再分配
+        // 初始化期间本线程的分配不采样，避免重入 instance()
+        bytes_until_sample = std::numeric_limits<int64_t>::max();
+        void* frame;
+        backtrace(&frame, 1);
+        bytes_until_sample = DEFAULT_SAMPLE_INTERVAL;
+        return new HeapProfiler();
+    }();
+    return *profiler;
+}
+
+void HeapProfiler::sample(size_t size) {
+    size_t current_interval = interval.load(std::memory_order_relaxed);
+    if (current_interval == 0) {
+        // 停止期间仍按默认间隔回来检查，重新设置间隔后各线程最多再分配这么多字节就恢复采样
+        bytes_until_sample = DEFAULT_SAMPLE_INTERVAL;
+        return;
+    }
+    bytes_until_sample = static_cast<int64_t>(current_interval);
+
+    void* frames[MAX_FRAMES + 2];
+    int depth = backtrace(frames, MAX_FRAMES + 2);
+    // 跳过 sample 与 on_allocate 自身
+    int skip = std::min(depth, 2);
+    depth -= skip;
+
+    uint64_t hash = 1469598103934665603ull;
+    for (int i = 0; i < depth; ++i) {
+        hash = (hash ^ reinterpret_cast<uintptr_t>(frames[skip + i])) * 1099511628211ull;
+    }
+    if (hash == 0) hash = 1;
+
+    // 小于采样间隔的分配代表整个间隔内的分配量
+    uint64_t weight = std::max<uint64_t>(size, current_interval);
+
+    std::lock_guard<std::mutex> lock(mtx);
+    for (size_t probe = 0; probe < MAX_SITES; ++probe) {
+        size_t slot = (hash + probe) % MAX_SITES;
+        if (hashes[slot] == hash) {
+            ++sites[slot].samples;
+            sites[slot].bytes += weight;
+            return;
+        }
+        if (hashes[slot] == 0) {
+            hashes[slot] = hash;
+            Site& site = sites[slot];
+            std::memcpy(site.frames, frames + skip, depth * sizeof(void*));
+            site.depth = depth;
+            site.samples = 1;
+            site.bytes = weight;
+            ++site_count;
+            return;
+        }
+    }
+    dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::vector<HeapProfiler::Site> HeapProfiler::snapshot() const {
+    std::vector<Site> result;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        result.reserve(site_count);
+        for (size_t slot = 0; slot < MAX_SITES; ++slot) {
+            if (hashes[slot] != 0) result.push_back(sites[slot]);
+        }
+    }
+    std::sort(result.begin(), result.end(), [](const Site& a, const Site& b) { return a.bytes > b.bytes; });
+    return result;
+}
+
+void HeapProfiler::reset() {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::fill(std::begin(hashes), std::end(hashes), 0);
+    site_count = 0;
+    dropped.store(0, std::memory_order_relaxed);
+}
+
+void HeapProfiler::dump(size_t top) const {
+    auto sites = snapshot();
+    LOG_INFO("=== Heap Profile (interval: {} bytes, sites: {}, dropped: {}) ===", sample_interval(), sites.size(), dropped_samples());
+    for (size_t i = 0; i < std::min(top, sites.size()); ++i) {
+        const Site& site = sites[i];
+        LOG_INFO("#{} ~{} bytes in {} samples", i, site.bytes, site.samples);
+        char** symbols = backtrace_symbols(site.frames, site.depth);
+        for (int frame = 0; symbols && frame < site.depth; ++frame) {
+            LOG_INFO("    {}", symbols[frame]);
+        }
+        std::free(symbols);
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// 按字节采样的分配点剖析器（MEMORYPOOL_PROFILING 打开时才会被内存池调用）
+// 每个线程每分配约 sample_interval 字节记录一次调用栈，同一调用栈的样本合并计数
+// 记录路径不分配内存，可以在全局分配器替换模式下使用
+class HeapProfiler {
+public:
+    static constexpr size_t MAX_FRAMES = 16;
+    static constexpr size_t MAX_SITES = 1024;
+    static constexpr size_t DEFAULT_SAMPLE_INTERVAL = 512 * 1024;
+
+    struct Site {
+        void* frames[MAX_FRAMES];
+        int depth;
+        uint64_t samples;
+        uint64_t bytes;     // 按采样间隔加权后估算的分配字节数
+    };
+
+    static HeapProfiler& instance();
+
+    // 分配热路径：只做一次线程局部的减法
+    static void on_allocate(size_t size) {
+        bytes_until_sample -= static_cast<int64_t>(size);
+        if (bytes_until_sample < 0) {
+            instance().sample(size);
+        }
+    }
+
+    // 0 表示停止采样；各线程在下一次采样（停止期间每 DEFAULT_SAMPLE_INTERVAL 字节检查一次）后使用新的间隔
+    void set_sample_interval(size_t bytes) { interval.store(bytes, std::memory_order_relaxed); }
+    size_t sample_interval() const { return interval.load(std::memory_order_relaxed); }
+
+    // 按估算字节数降序返回所有分配点
+    std::vector<Site> snapshot() const;
+
+    // 表满后丢弃的样本数
+    uint64_t dropped_samples() const { return dropped.load(std::memory_order_relaxed); }
+
+    void reset();
+
+    // 输出估算字节数最多的 top 个分配点
+    void dump(size_t top = 10) const;
+
+private:
+    HeapProfiler() = default;
+
+    void sample(size_t size);
+
+    static inline thread_local int64_t bytes_until_sample = DEFAULT_SAMPLE_INTERVAL;
+
+    std::atomic<size_t> interval{DEFAULT_SAMPLE_INTERVAL};
+    std::atomic<uint64_t> dropped{0};
+    mutable std::mutex mtx;
+    uint64_t hashes[MAX_SITES] = {};    // 0 表示空槽
+    Site sites[MAX_SITES] = {};
+    size_t site_count = 0;
+};
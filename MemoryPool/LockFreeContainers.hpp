@@ -0,0 +1,272 @@
+#pragma once
+
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <new>
+#include <optional>
+#include <utility>
+
+#include "HazardPointer.hpp"
+#include "MemoryPool.hpp"
+
+// 基于 LockFreeFixedSizePool 节点的无锁容器
+// 节点出队后先退休到容器自己的 HazardCohort，确认没有线程通过 hazard pointer 持有它之后才归还内存池
+// 容器析构时调用方保证已经没有其他线程访问它
+
+// Treiber 栈
+template<typename T, size_t N = 4096>
+class TreiberStack {
+private:
+    struct Node : HazardRetirable {
+        T value;
+        Node* next = nullptr;   // 入栈前写好，之后不再修改
+
+        template<typename... Args>
+        explicit Node(std::in_place_t, Args&&... args) : value(std::forward<Args>(args)...) {}
+    };
+
+    static void reclaim_node(HazardRetirable* node, void* context) {
+        static_cast<TreiberStack*>(context)->pool.deallocate(static_cast<Node*>(node));
+    }
+
+    // cohort 析构时把剩余节点还给 pool，必须声明在 pool 之后
+    LockFreeFixedSizePool<Node, N> pool;
+    HazardCohort cohort{&TreiberStack::reclaim_node, this};
+    alignas(CACHE_LINE_SIZE) std::atomic<Node*> head{nullptr};
+
+public:
+    TreiberStack() = default;
+
+    ~TreiberStack() {
+        Node* node = head.load(std::memory_order_acquire);
+        while (node) {
+            Node* next = node->next;
+            pool.deallocate(node);
+            node = next;
+        }
+    }
+
+    TreiberStack(const TreiberStack&) = delete;
+    TreiberStack& operator=(const TreiberStack&) = delete;
+
+    // 内存池无法分配节点时返回 false
+    template<typename... Args>
+    bool emplace(Args&&... args) {
+        Node* node = pool.allocate(std::in_place, std::forward<Args>(args)...);
+        if (!node) return false;
+        node->next = head.load(std::memory_order_relaxed);
+        while (!head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)) {}
+        return true;
+    }
+
+    bool push(T item) { return emplace(std::move(item)); }
+
+    std::optional<T> pop() {
+        HazardPointer hp;
+        for (;;) {
+            Node* node = hp.protect(head);
+            if (!node) return std::nullopt;
+            // node 受保护，不会被回收，读取 next 是安全的；节点不会在退休前复用，CAS 没有 ABA 问题
+            if (head.compare_exchange_weak(node, node->next, std::memory_order_acquire, std::memory_order_relaxed)) {
+                hp.reset();
+                std::optional<T> value(std::move(node->value));
+                cohort.retire(node);
+                return value;
+            }
+        }
+    }
+
+    bool pop(T& result) {
+        std::optional<T> value = pop();
+        if (!value) return false;
+        result = std::move(*value);
+        return true;
+    }
+
+    bool empty() const { return head.load(std::memory_order_relaxed) == nullptr; }
+
+    // 已出栈、等待回收的节点数
+    size_t pending_reclaim() const { return cohort.pending(); }
+};
+
+// 原来的 LockFreeStack 每个节点 new/delete，且 pop 可能读取已释放的节点，现在就是 TreiberStack
+template<typename T>
+using LockFreeStack = TreiberStack<T>;
+
+// Michael-Scott 队列，多生产者多消费者
+template<typename T, size_t N = 4096>
+class MSQueue {
+private:
+    // 头部始终是一个哑节点，值存放在它之后的节点中，由出队成功的线程取走
+    struct Node : HazardRetirable {
+        std::atomic<Node*> next{nullptr};
+        alignas(T) std::byte storage[sizeof(T)];
+
+        T* value() { return std::launder(reinterpret_cast<T*>(storage)); }
+    };
+
+    static void reclaim_node(HazardRetirable* node, void* context) {
+        static_cast<MSQueue*>(context)->pool.deallocate(static_cast<Node*>(node));
+    }
+
+    LockFreeFixedSizePool<Node, N> pool;
+    HazardCohort cohort{&MSQueue::reclaim_node, this};
+    alignas(CACHE_LINE_SIZE) std::atomic<Node*> head;
+    alignas(CACHE_LINE_SIZE) std::atomic<Node*> tail;
+
+public:
+    MSQueue() {
+        Node* dummy = pool.allocate();
+        if (!dummy) throw std::bad_alloc();
+        head.store(dummy, std::memory_order_relaxed);
+        tail.store(dummy, std::memory_order_relaxed);
+    }
+
+    ~MSQueue() {
+        Node* node = head.load(std::memory_order_acquire);
+        for (Node* next = node->next.load(std::memory_order_acquire); next; next = node->next.load(std::memory_order_acquire)) {
+            next->value()->~T();
+            pool.deallocate(node);
+            node = next;
+        }
+        pool.deallocate(node);
+    }
+
+    MSQueue(const MSQueue&) = delete;
+    MSQueue& operator=(const MSQueue&) = delete;
+
+    // 内存池无法分配节点时返回 false
+    template<typename... Args>
+    bool emplace(Args&&... args) {
+        Node* node = pool.allocate();
+        if (!node) return false;
+        try {
+            new (node->storage) T(std::forward<Args>(args)...);
+        } catch (...) {
+            pool.deallocate(node);
+            throw;
+        }
+
+        HazardPointer hp;
+        for (;;) {
+            Node* last = hp.protect(tail);
+            Node* next = last->next.load(std::memory_order_acquire);
+            if (last != tail.load(std::memory_order_acquire)) continue;
+            if (next) {
+                // tail 落后，帮忙推进
+                tail.compare_exchange_weak(last, next, std::memory_order_release, std::memory_order_relaxed);
+                continue;
+            }
+            Node* expected = nullptr;
+            if (last->next.compare_exchange_weak(expected, node, std::memory_order_release, std::memory_order_relaxed)) {
+                tail.compare_exchange_strong(last, node, std::memory_order_release, std::memory_order_relaxed);
+                return true;
+            }
+        }
+    }
+
+    bool push(T item) { return emplace(std::move(item)); }
+
+    std::optional<T> pop() {
+        HazardPointer hp_first;
+        HazardPointer hp_next;
+        for (;;) {
+            Node* first = hp_first.protect(head);
+            Node* last = tail.load(std::memory_order_acquire);
+            Node* next = hp_next.protect(first->next);
+            // first 仍是头部说明 next 还没有出队，登记之后不会被回收
+            if (first != head.load(std::memory_order_acquire)) continue;
+            if (!next) return std::nullopt;
+            if (first == last) {
+                tail.compare_exchange_weak(last, next, std::memory_order_release, std::memory_order_relaxed);
+                continue;
+            }
+            if (head.compare_exchange_weak(first, next, std::memory_order_acquire, std::memory_order_relaxed)) {
+                // next 成为新的哑节点，只有出队成功的线程会访问它的值
+                std::optional<T> value(std::move(*next->value()));
+                next->value()->~T();
+                hp_first.reset();
+                cohort.retire(first);
+                return value;
+            }
+        }
+    }
+
+    bool pop(T& result) {
+        std::optional<T> value = pop();
+        if (!value) return false;
+        result = std::move(*value);
+        return true;
+    }
+
+    bool empty() const {
+        HazardPointer hp;
+        return hp.protect(head)->next.load(std::memory_order_acquire) == nullptr;
+    }
+
+    size_t pending_reclaim() const { return cohort.pending(); }
+};
+
+// 侵入式 MPSC 队列的链接字段，元素类型需要继承它
+struct MpscQueueHook {
+    std::atomic<MpscQueueHook*> mpsc_next{nullptr};
+};
+
+// 侵入式多生产者单消费者队列（Vyukov）
+// 入队是一次 exchange，没有 CAS 循环；不分配内存，元素的存储由调用方管理，例如从 LockFreeFixedSizePool 分配
+// 出队的元素只属于唯一的消费者，不需要延迟回收
+template<typename T>
+    requires std::derived_from<T, MpscQueueHook>
+class MpscQueue {
+private:
+    MpscQueueHook stub;
+    alignas(CACHE_LINE_SIZE) std::atomic<MpscQueueHook*> head;    // 生产者
+    alignas(CACHE_LINE_SIZE) MpscQueueHook* tail;                   // 消费者
+
+    void push_hook(MpscQueueHook* hook) {
+        hook->mpsc_next.store(nullptr, std::memory_order_relaxed);
+        MpscQueueHook* prev = head.exchange(hook, std::memory_order_acq_rel);
+        // exchange 与这一步之间链表暂时断开，消费者此时会看到队列为空
+        prev->mpsc_next.store(hook, std::memory_order_release);
+    }
+
+public:
+    MpscQueue() : head(&stub), tail(&stub) {}
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    // 任意线程调用
+    void push(T* item) { push_hook(item); }
+
+    // 只能由一个消费者线程调用；生产者正在挂接时可能暂时返回 nullptr
+    T* pop() {
+        MpscQueueHook* first = tail;
+        MpscQueueHook* next = first->mpsc_next.load(std::memory_order_acquire);
+        if (first == &stub) {
+            if (!next) return nullptr;
+            tail = next;
+            first = next;
+            next = next->mpsc_next.load(std::memory_order_acquire);
+        }
+        if (next) {
+            tail = next;
+            return static_cast<T*>(first);
+        }
+        if (first != head.load(std::memory_order_acquire)) return nullptr;
+        // 只剩最后一个元素：重新挂上 stub，使它有后继后再取出
+        push_hook(&stub);
+        next = first->mpsc_next.load(std::memory_order_acquire);
+        if (next) {
+            tail = next;
+            return static_cast<T*>(first);
+        }
+        return nullptr;
+    }
+
+    // 只能由消费者调用
+    bool empty() const {
+        return tail == &stub && stub.mpsc_next.load(std::memory_order_acquire) == nullptr;
+    }
+};
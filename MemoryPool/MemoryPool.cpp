@@ -2,229 +2,714 @@
 #include "MemoryPool.hpp"
 #include "logger.hpp"
 
-LockFreeMultiSizePool::LockFreeMultiSizePool() {
-    for (size_t i = 0; i < SIZE_CALSSES.size(); ++i) {
-        new (&chunk_classes[i]) ChunkClass(SIZE_CALSSES[i]);
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fstream>
+
+size_t os_memory::page_size() {
+    static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return size;
+}
+
+void* os_memory::map(size_t bytes) {
+    void* ptr = mmap(nullptr, align_of(bytes, page_size()), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        LOG_ERROR("mmap failed, size:{}", bytes);
+        return nullptr;
     }
-    thread_cache.pool_ptr = this;
+    return ptr;
 }
 
-bool LockFreeMultiSizePool::fill_class_cache(size_t index) {
-    if (index >= SIZE_CALSSES.size()) return false;
+void* os_memory::map_aligned(size_t bytes, size_t alignment) {
+    bytes = align_of(bytes, page_size());
+    if (alignment <= page_size()) return map(bytes);
+
+    // 多申请一个对齐单位，再裁掉首尾多余的部分
+    auto* raw = static_cast<std::byte*>(map(bytes + alignment));
+    if (!raw) return nullptr;
+    auto addr = reinterpret_cast<uintptr_t>(raw);
+    auto* aligned = reinterpret_cast<std::byte*>(align_of(addr, alignment));
+    size_t head = static_cast<size_t>(aligned - raw);
+    size_t tail = alignment - head;
+    if (head > 0) munmap(raw, head);
+    if (tail > 0) munmap(aligned + bytes, tail);
+    return aligned;
+}
 
-    ChunkClass& chunk_class = chunk_classes[index];
-    auto& class_cache = thread_cache.caches[index];
+void* os_memory::map_huge_tlb(size_t bytes) {
+#ifdef MAP_HUGETLB
+    void* ptr = mmap(nullptr, align_of(bytes, HUGE_PAGE_SIZE), PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    return ptr == MAP_FAILED ? nullptr : ptr;
+#else
+    (void)bytes;
+    return nullptr;
+#endif
+}
 
-    // 已经有缓存，不需要填充
-    if (class_cache.count > 0) return true;
+void os_memory::unmap(void* ptr, size_t bytes) {
+    if (ptr) munmap(ptr, align_of(bytes, page_size()));
+}
+
+void os_memory::advise_huge_pages(void* ptr, size_t bytes) {
+#ifdef MADV_HUGEPAGE
+    if (madvise(ptr, bytes, MADV_HUGEPAGE) != 0) {
+        LOG_WARNING("madvise(MADV_HUGEPAGE) failed, size:{}", bytes);
+    }
+#else
+    (void)ptr;
+    (void)bytes;
+#endif
+}
 
-    int BATCH_SIZE = std::size(class_cache.blocks) / 2;
+void os_memory::decommit(void* ptr, size_t bytes, DecommitMode mode) {
+    int advice = MADV_DONTNEED;
+#ifdef MADV_FREE
+    if (mode == DecommitMode::Free) advice = MADV_FREE;
+#endif
+    // MADV_FREE 在旧内核上不可用，退回 MADV_DONTNEED
+    if (madvise(ptr, align_of(bytes, page_size()), advice) != 0 && advice != MADV_DONTNEED) {
+        madvise(ptr, align_of(bytes, page_size()), MADV_DONTNEED);
+    }
+}
 
-    // 尝试从全局链表获取多个块
-    FreeBlock* old_head = chunk_class.free_list.load(std::memory_order_acquire);
-    if (!old_head) {
-        allocate_chunk_for_size_class(index);
-        old_head = chunk_class.free_list.load(std::memory_order_acquire);
-        if (!old_head) return false;
+void os_memory::prefault(void* ptr, size_t bytes) {
+    bytes = align_of(bytes, page_size());
+#ifdef MADV_POPULATE_WRITE
+    // Linux 5.14+ 由内核一次填充页表，不需要逐页触发缺页
+    if (madvise(ptr, bytes, MADV_POPULATE_WRITE) == 0) return;
+#endif
+    // 每页写一次原值，调用方保证此时没有其他线程访问这段内存
+    MEMORYPOOL_ASAN_UNPOISON(ptr, bytes);
+    auto* page = static_cast<volatile std::byte*>(ptr);
+    for (size_t offset = 0; offset < bytes; offset += page_size()) {
+        page[offset] = page[offset];
     }
+}
 
-    //获取一串块
-    FreeBlock* current = old_head;
-    FreeBlock* new_head = nullptr;
+bool os_memory::lock(void* ptr, size_t bytes) {
+    return mlock(ptr, align_of(bytes, page_size())) == 0;
+}
 
-    int count = 0;
+size_t os_memory::resident_bytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t total_pages = 0;
+    size_t resident_pages = 0;
+    if (!(statm >> total_pages >> resident_pages)) return 0;
+    return resident_pages * page_size();
+}
 
-    for (int i = 0; i < BATCH_SIZE - 1 && current->next.load(std::memory_order_relaxed); ++i) {
-        current = current->next.load(std::memory_order_relaxed);
-        ++count;
-    }
+bool percpu::available() {
+#if MEMORYPOOL_HAS_RSEQ
+    // GLIBC_TUNABLES=glibc.pthread.rseq=0 或内核不支持时 __rseq_size 为 0
+    return __rseq_size > 0;
+#else
+    return false;
+#endif
+}
 
-    new_head = current->next.load(std::memory_order_relaxed);
+size_t percpu::cpu_count() {
+    // 包括离线的 CPU，cpu_id 不会超出该范围
+    long count = sysconf(_SC_NPROCESSORS_CONF);
+    return count > 0 ? static_cast<size_t>(count) : 1;
+}
 
-    // 更新链表头
-    if(!chunk_class.free_list.compare_exchange_strong(old_head, new_head, std::memory_order_release, std::memory_order_relaxed)) {
-        return false;
-    }
+HugePageArena::HugePageArena(PageBacking backing, size_t region_size)
+    : region_size(align_of(region_size, os_memory::HUGE_PAGE_SIZE)), try_huge_tlb(backing == PageBacking::HugeTLB) {}
 
-    //将获取的块放入本地缓存
-    current = old_head;
-    while (current != new_head) {
-        class_cache.blocks[class_cache.count++] = current;
-        current = current->next.load(std::memory_order_relaxed);
+HugePageArena::~HugePageArena() {
+    for (auto& region : regions) {
+        munmap(region.base, region.bytes);
     }
+}
 
+bool HugePageArena::reserve_region(size_t min_bytes) {
+    size_t bytes = std::max(region_size, align_of(min_bytes, os_memory::HUGE_PAGE_SIZE));
+    void* base = nullptr;
+    if (try_huge_tlb) {
+        base = os_memory::map_huge_tlb(bytes);
+        if (base) {
+            huge_tlb.store(true, std::memory_order_release);
+        } else {
+            LOG_WARNING("MAP_HUGETLB unavailable, falling back to transparent huge pages");
+            try_huge_tlb = false;
+        }
+    }
+    if (!base) {
+        base = os_memory::map_aligned(bytes, os_memory::HUGE_PAGE_SIZE);
+        if (!base) return false;
+        os_memory::advise_huge_pages(base, bytes);
+    }
+    regions.push_back(Region{static_cast<std::byte*>(base), bytes, 0});
     return true;
 }
 
-void* LockFreeMultiSizePool::allocate(size_t size) {
-    if (size == 0) return nullptr;
-
-    thread_cache.pool_ptr = this; // 设置当前线程的内存池实例
-    size_t aligned_size = align_of(size, ALIGNMENT);
-    size_t index = get_size_class_index(aligned_size);
-    if (index >= SIZE_CALSSES.size()) {  // 分配大对象
-        void* ptr = std::aligned_alloc(ALIGNMENT, aligned_size);
-        return ptr;
+void* HugePageArena::allocate(size_t bytes, size_t alignment) {
+    bytes = align_of(bytes, os_memory::page_size());
+    alignment = std::max(alignment, os_memory::page_size());
+    std::lock_guard<std::mutex> lock(mtx);
+    // 区域起始地址按大页对齐，区域内的偏移对齐即可
+    auto fits = [&](const Region& region) { return align_of(region.used, alignment) + bytes <= region.bytes; };
+    if (regions.empty() || !fits(regions.back())) {
+        if (!reserve_region(bytes)) return nullptr;
     }
+    Region& region = regions.back();
+    region.used = align_of(region.used, alignment);
+    void* ptr = region.base + region.used;
+    region.used += bytes;
+    return ptr;
+}
 
-    ChunkClass& chunk_class = chunk_classes[index];
-    FreeBlock* old_block = chunk_class.free_list.load(std::memory_order_acquire);
-    FreeBlock* block = nullptr;
+size_t HugePageArena::reserved_bytes() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    size_t bytes = 0;
+    for (const auto& region : regions) {
+        bytes += region.bytes;
+    }
+    return bytes;
+}
 
-    // 尝试从本地缓存分配
-    auto& class_cache = thread_cache.caches[index];
-    if (class_cache.count > 0) {
-        FreeBlock* block = class_cache.blocks[--class_cache.count];
-        block->free_flag = false;
-        chunk_class.allocated_count.fetch_add(1, std::memory_order_relaxed);
-        return block->data(); // 返回数据指针
+ChunkRegistry::~ChunkRegistry() {
+    ChunkRecord* chunk = chunks;
+    while (chunk) {
+        ChunkRecord* next = chunk->next;
+        // 地址可能被重新映射给其他用途，先清除 ASan 标记
+        MEMORYPOOL_ASAN_UNPOISON(chunk->base, chunk->bytes);
+        if (!arena) os_memory::unmap(chunk->base, chunk->bytes);
+        delete chunk;
+        chunk = next;
     }
-    // 尝试批量获取块到本地缓存
-    if (fill_class_cache(index)) {
-        FreeBlock* block = class_cache.blocks[--class_cache.count];
-        block->free_flag = false;
-        chunk_class.allocated_count.fetch_add(1, std::memory_order_relaxed);
-        return block->data(); // 返回数据指针
+}
+
+ChunkRecord* ChunkRegistry::acquire(size_t bytes, size_t block_count, size_t alignment) {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    // 复用已 decommit 的 chunk，页面在首次访问时重新分配
+    ChunkRecord** link = &idle_chunks;
+    while (*link) {
+        ChunkRecord* chunk = *link;
+        if (chunk->bytes >= bytes) {
+            *link = chunk->next_idle;
+            chunk->next_idle = nullptr;
+            chunk->committed = true;
+            chunk->block_count = block_count;
+            chunk->carved.store(block_count, std::memory_order_relaxed);
+            committed += chunk->bytes;
+            return chunk;
+        }
+        link = &chunk->next_idle;
     }
 
-    // 尝试从空闲列表获取
-    while(old_block) {
-        if(chunk_class.free_list.compare_exchange_weak(old_block, old_block->next.load(std::memory_order_relaxed))) {
-            block = old_block;
+    void* memory = arena ? arena->allocate(bytes, alignment) : os_memory::map_aligned(bytes, alignment);
+    if (!memory) return nullptr;
+
+    auto* chunk = new ChunkRecord();
+    chunk->base = static_cast<std::byte*>(memory);
+    chunk->bytes = bytes;
+    chunk->block_count = block_count;
+    chunk->carved.store(block_count, std::memory_order_relaxed);
+    chunk->next = chunks;
+    chunks = chunk;
+    ++total_chunks;
+    committed += bytes;
+    return chunk;
+}
+
+ChunkRecord* ChunkRegistry::carve(size_t n, size_t& first, size_t& count) {
+    ChunkRecord* chunk = carving.load(std::memory_order_acquire);
+    if (!chunk) return nullptr;
+    // 旧的切分对象已经切完，fetch_add 只会得到超出范围的序号
+    size_t start = chunk->carved.fetch_add(n, std::memory_order_acq_rel);
+    if (start >= chunk->block_count) return nullptr;
+    first = start;
+    count = std::min(n, chunk->block_count - start);
+    return chunk;
+}
+
+ChunkRecord* ChunkRegistry::start_carving(ChunkRecord* chunk, size_t& first, size_t& count) {
+    std::lock_guard<std::mutex> lock(mtx);
+    chunk->carved.store(0, std::memory_order_release);
+    ChunkRecord* previous = carving.exchange(chunk, std::memory_order_acq_rel);
+    if (!previous) return nullptr;
+    size_t start = previous->carved.exchange(previous->block_count, std::memory_order_acq_rel);
+    if (start >= previous->block_count) return nullptr;
+    first = start;
+    count = previous->block_count - start;
+    return previous;
+}
+
+size_t ChunkRegistry::pin_committed() {
+    std::lock_guard<std::mutex> lock(mtx);
+    size_t pinned = 0;
+    for (ChunkRecord* chunk = chunks; chunk; chunk = chunk->next) {
+        if (!chunk->committed || chunk->pinned) continue;
+        if (!os_memory::lock(chunk->base, chunk->bytes)) {
+            LOG_WARNING("mlock failed after pinning {} bytes, check RLIMIT_MEMLOCK", pinned);
             break;
         }
+        chunk->pinned = true;
+        pinned += chunk->bytes;
     }
-    if (!block) {
-        allocate_chunk_for_size_class(index);
+    return pinned;
+}
 
-        old_block = chunk_class.free_list.load(std::memory_order_acquire);
-        // 再次尝试从空闲列表获取
-        while(old_block) {
-            if(chunk_class.free_list.compare_exchange_weak(old_block, old_block->next.load(std::memory_order_relaxed))) {
-                block = old_block;
-                break;
-            }
+size_t ChunkRegistry::release(ChunkRecord* chunk, DecommitMode mode) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!chunk->committed) return 0;
+    // 不能 decommit 的 arena（MAP_HUGETLB）只放回空闲列表
+    if (!arena || arena->supports_decommit()) os_memory::decommit(chunk->base, chunk->bytes, mode);
+    chunk->committed = false;
+    chunk->next_idle = idle_chunks;
+    idle_chunks = chunk;
+    committed -= chunk->bytes;
+    return chunk->bytes;
+}
+
+size_t ChunkRegistry::chunk_count() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return total_chunks;
+}
+
+size_t ChunkRegistry::committed_bytes() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return committed;
+}
+
+// 每页一个描述项，只有 span 首页的 pages/free 有效，尾页的 head 指向首页
+struct PageHeap::Span {
+    Span* prev;
+    Span* next;
+    Span* head;
+    uint32_t pages;
+    bool free;
+};
+
+// segment 起始处存放页描述表，后面的页用于切分 span
+struct PageHeap::Segment {
+    Segment* next;
+    Span spans[PAGES_PER_SEGMENT];
+};
+
+const size_t PageHeap::HEADER_PAGES = (sizeof(PageHeap::Segment) + PageHeap::PAGE_BYTES - 1) / PageHeap::PAGE_BYTES;
+const size_t PageHeap::USABLE_PAGES = PageHeap::PAGES_PER_SEGMENT - PageHeap::HEADER_PAGES;
+
+namespace {
+    constexpr size_t LONG_SPAN_BUCKET = PageHeap::MAX_SPAN_PAGES + 1;
+    constexpr size_t MAX_CACHED_PER_CLASS = 16;
+
+    size_t bucket_of(size_t pages) {
+        return pages <= PageHeap::MAX_SPAN_PAGES ? pages : LONG_SPAN_BUCKET;
+    }
+
+    // 线程缓存：按页数分桶，空闲 span 的首 8 字节存放链表指针
+    struct SpanCache {
+        void* lists[PageHeap::MAX_CACHED_PAGES + 1] = {};
+        size_t counts[PageHeap::MAX_CACHED_PAGES + 1] = {};
+        size_t bytes = 0;
+        bool exited = false;   // 线程退出后不再缓存
+
+        ~SpanCache() {
+            if (bytes > 0) PageHeap::instance().flush_thread_cache();
+            exited = true;
         }
+    };
+
+    thread_local SpanCache span_cache;
+}
+
+PageHeap& PageHeap::instance() {
+    static PageHeap* heap = new PageHeap();
+    return *heap;
+}
+
+void* PageHeap::allocate(size_t size) {
+    size_t pages = pages_for(size);
+    if (pages > MAX_SPAN_PAGES) {
+        return allocate_huge(align_of(size, HUGE_GRANULE));
     }
 
-    if(block) {
-        chunk_class.allocated_count.fetch_add(1, std::memory_order_relaxed);
-        block->free_flag = false;
-        return block->data(); // 返回数据指针
+    // 线程缓存命中时不需要加锁
+    if (pages <= MAX_CACHED_PAGES && span_cache.lists[pages]) {
+        void* ptr = span_cache.lists[pages];
+        span_cache.lists[pages] = *static_cast<void**>(ptr);
+        --span_cache.counts[pages];
+        span_cache.bytes -= pages * PAGE_BYTES;
+        return ptr;
     }
-    return nullptr;
+    return allocate_span(pages);
 }
 
-void LockFreeMultiSizePool::deallocate(void* ptr, size_t size) {
-    if (ptr == nullptr) return;
-
-    thread_cache.pool_ptr = this; // 设置当前线程的内存池实例
-    size_t align_size = align_of(size, ALIGNMENT);
-    size_t index = get_size_class_index(align_size);
-    if (index >= SIZE_CALSSES.size()) {
-        std::free(ptr);  // 大对象直接释放
+void PageHeap::deallocate(void* ptr, size_t size) {
+    if (!ptr) return;
+    size_t pages = pages_for(size);
+    if (pages > MAX_SPAN_PAGES) {
+        deallocate_huge(ptr, align_of(size, HUGE_GRANULE));
         return;
     }
 
-    ChunkClass& chunk_class = chunk_classes[index];
-    FreeBlock* block_ptr = FreeBlock::from_data(ptr);  // 获取block
-    
-    //LOG_INFO("free detected, ptr:{}, size:{}", ptr, size);
-    if (block_ptr->free_flag) {
-        LOG_ERROR("Double free detected, ptr:{}, size:{}", ptr, size);
+    size_t bytes = pages * PAGE_BYTES;
+    if (pages <= MAX_CACHED_PAGES && !span_cache.exited && span_cache.counts[pages] < MAX_CACHED_PER_CLASS
+        && span_cache.bytes + bytes <= THREAD_CACHE_BYTES) {
+        *static_cast<void**>(ptr) = span_cache.lists[pages];
+        span_cache.lists[pages] = ptr;
+        ++span_cache.counts[pages];
+        span_cache.bytes += bytes;
         return;
     }
-    block_ptr->free_flag = true;
-    // 尝试先放入本地缓存
-    auto& class_cache = thread_cache.caches[index];
-    if (class_cache.count < static_cast<int>(sizeof(class_cache.blocks) / sizeof(class_cache.blocks[0]))) {
-        class_cache.blocks[class_cache.count++] = block_ptr;
+    deallocate_span(ptr, pages);
+}
+
+void PageHeap::flush_thread_cache() {
+    for (size_t pages = 1; pages <= MAX_CACHED_PAGES; ++pages) {
+        void* ptr = span_cache.lists[pages];
+        while (ptr) {
+            void* next = *static_cast<void**>(ptr);
+            deallocate_span(ptr, pages);
+            ptr = next;
+        }
+        span_cache.lists[pages] = nullptr;
+        span_cache.counts[pages] = 0;
+    }
+    span_cache.bytes = 0;
+}
+
+void PageHeap::insert_free(Span* span) {
+    size_t bucket = bucket_of(span->pages);
+    span->free = true;
+    span->prev = nullptr;
+    span->next = free_lists[bucket];
+    if (span->next) span->next->prev = span;
+    free_lists[bucket] = span;
+    nonempty[bucket / 64] |= uint64_t(1) << (bucket % 64);
+    free_pages += span->pages;
+}
+
+void PageHeap::remove_free(Span* span) {
+    size_t bucket = bucket_of(span->pages);
+    if (span->prev) {
+        span->prev->next = span->next;
     } else {
-        // 本地缓存已满，将一半缓存归还全局链表
-        int half_count = class_cache.count / 2;
+        free_lists[bucket] = span->next;
+    }
+    if (span->next) span->next->prev = span->prev;
+    if (!free_lists[bucket]) {
+        nonempty[bucket / 64] &= ~(uint64_t(1) << (bucket % 64));
+    }
+    span->free = false;
+    span->prev = span->next = nullptr;
+    free_pages -= span->pages;
+}
+
+PageHeap::Span* PageHeap::find_free_span(size_t pages) {
+    // 在位图中查找第一个不小于 pages 的非空桶
+    size_t bucket = bucket_of(pages);
+    for (size_t word = bucket / 64; word < std::size(nonempty); ++word) {
+        uint64_t bits = nonempty[word];
+        if (word == bucket / 64) bits &= ~uint64_t(0) << (bucket % 64);
+        if (bits) return free_lists[word * 64 + std::countr_zero(bits)];
+    }
+    return nullptr;
+}
 
-        // 构建链表
-        for (int i = 0; i < half_count - 1; ++i) {
-            class_cache.blocks[i]->next.store(class_cache.blocks[i + 1], std::memory_order_relaxed);
+PageHeap::Span* PageHeap::split(Span* span, size_t pages) {
+    Segment* segment = segment_of(span);
+    size_t index = static_cast<size_t>(span - segment->spans);
+    if (span->pages > pages) {
+        Span* rest = &segment->spans[index + pages];
+        rest->pages = static_cast<uint32_t>(span->pages - pages);
+        rest->head = rest;
+        segment->spans[index + span->pages - 1].head = rest;
+        insert_free(rest);
+        span->pages = static_cast<uint32_t>(pages);
+    }
+    segment->spans[index + pages - 1].head = span;
+    return span;
+}
+
+bool PageHeap::add_segment() {
+    void* memory = os_memory::map_aligned(SEGMENT_SIZE, SEGMENT_SIZE);
+    if (!memory) return false;
+
+    auto* segment = static_cast<Segment*>(memory);
+    segment->next = segments;
+    segments = segment;
+    ++segment_count;
+
+    Span* span = &segment->spans[HEADER_PAGES];
+    span->pages = static_cast<uint32_t>(USABLE_PAGES);
+    span->head = span;
+    segment->spans[PAGES_PER_SEGMENT - 1].head = span;
+    insert_free(span);
+    return true;
+}
+
+void* PageHeap::allocate_span(size_t pages) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Span* span = find_free_span(pages);
+    if (!span) {
+        if (!add_segment()) return nullptr;
+        span = find_free_span(pages);
+    }
+    remove_free(span);
+    split(span, pages);
+
+    Segment* segment = segment_of(span);
+    size_t index = static_cast<size_t>(span - segment->spans);
+    return reinterpret_cast<std::byte*>(segment) + (index << PAGE_SHIFT);
+}
+
+void PageHeap::deallocate_span(void* ptr, size_t pages) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Segment* segment = segment_of(ptr);
+    size_t index = static_cast<size_t>(static_cast<std::byte*>(ptr) - reinterpret_cast<std::byte*>(segment)) >> PAGE_SHIFT;
+    Span* span = &segment->spans[index];
+    if (span->free || span->pages != pages) {
+        LOG_ERROR("Invalid span free detected, ptr:{}, pages:{}", ptr, pages);
+        return;
+    }
+
+    // 与后一个空闲 span 合并
+    size_t next_index = index + span->pages;
+    if (next_index < PAGES_PER_SEGMENT && segment->spans[next_index].free) {
+        Span* next = &segment->spans[next_index];
+        remove_free(next);
+        span->pages += next->pages;
+    }
+    // 与前一个空闲 span 合并
+    if (index > HEADER_PAGES) {
+        Span* prev = segment->spans[index - 1].head;
+        if (prev->free) {
+            remove_free(prev);
+            prev->pages += span->pages;
+            span = prev;
+            index = static_cast<size_t>(span - segment->spans);
         }
+    }
+    span->head = span;
+    segment->spans[index + span->pages - 1].head = span;
+    insert_free(span);
+}
 
-        // 将新块添加到链表尾部
-        class_cache.blocks[half_count - 1]->next.store(block_ptr, std::memory_order_relaxed);
+void* PageHeap::allocate_huge(size_t bytes) {
+    {
+        // 优先复用大小相同的缓存映射
+        std::lock_guard<std::mutex> lock(huge_mtx);
+        for (size_t i = 0; i < huge_cache_count; ++i) {
+            if (huge_cache[i].bytes == bytes) {
+                void* ptr = huge_cache[i].ptr;
+                huge_cache[i] = huge_cache[--huge_cache_count];
+                huge_cached -= bytes;
+                huge_mapped.fetch_add(bytes, std::memory_order_relaxed);
+                return ptr;
+            }
+        }
+    }
+    void* ptr = os_memory::map(bytes);
+    if (ptr) huge_mapped.fetch_add(bytes, std::memory_order_relaxed);
+    return ptr;
+}
 
-        // 归还给全局链表
-        FreeBlock* old_block = chunk_class.free_list.load(std::memory_order_relaxed);
-        do {
-            block_ptr->next.store(old_block, std::memory_order_relaxed);
-        } while(!chunk_class.free_list.compare_exchange_weak(old_block, class_cache.blocks[0], std::memory_order_release, std::memory_order_relaxed));
+void PageHeap::deallocate_huge(void* ptr, size_t bytes) {
+    huge_mapped.fetch_sub(bytes, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(huge_mtx);
+        if (huge_cache_count < HUGE_CACHE_ENTRIES && huge_cached + bytes <= HUGE_CACHE_BYTES) {
+            huge_cache[huge_cache_count++] = HugeMapping{ptr, bytes};
+            huge_cached += bytes;
+            return;
+        }
+    }
+    os_memory::unmap(ptr, bytes);
+}
 
-        // 压缩剩余缓存 更新class_cache
-        for (int i = 0; i < class_cache.count - half_count; ++i) {
-            class_cache.blocks[i] = class_cache.blocks[i + half_count];
+size_t PageHeap::trim() {
+    flush_thread_cache();
+    size_t released = 0;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        Segment** link = &segments;
+        while (*link) {
+            Segment* segment = *link;
+            Span* span = &segment->spans[HEADER_PAGES];
+            if (span->free && span->pages == USABLE_PAGES) {
+                remove_free(span);
+                *link = segment->next;
+                --segment_count;
+                os_memory::unmap(segment, SEGMENT_SIZE);
+                released += SEGMENT_SIZE;
+            } else {
+                link = &segment->next;
+            }
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(huge_mtx);
+        for (size_t i = 0; i < huge_cache_count; ++i) {
+            os_memory::unmap(huge_cache[i].ptr, huge_cache[i].bytes);
+            released += huge_cache[i].bytes;
         }
-        class_cache.count -= half_count;
+        huge_cache_count = 0;
+        huge_cached = 0;
     }
-    chunk_class.deallocated_count.fetch_add(1, std::memory_order_relaxed);
+    return released;
 }
 
-void LockFreeMultiSizePool::print_stats() const {
-    LOG_INFO("=== Memory Pool Statistics ===");
-    for (size_t i = 0; i < SIZE_CALSSES.size(); ++i) {
-        const ChunkClass& chunk_class = chunk_classes[i];
-        LOG_INFO("Size class {}: allocated: {}, deallocated: {}", 
-            SIZE_CALSSES[i], chunk_class.allocated_count.load(std::memory_order_relaxed), chunk_class.deallocated_count.load(std::memory_order_relaxed));
+PageHeap::Stats PageHeap::stats() const {
+    Stats result{};
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        result.segments = segment_count;
+        result.free_pages = free_pages;
+        for (size_t bucket = LONG_SPAN_BUCKET; bucket > 0 && result.largest_free_run == 0; --bucket) {
+            for (Span* span = free_lists[bucket]; span; span = span->next) {
+                result.largest_free_run = std::max<size_t>(result.largest_free_run, span->pages);
+            }
+        }
     }
+    {
+        std::lock_guard<std::mutex> lock(huge_mtx);
+        result.huge_cached_bytes = huge_cached;
+    }
+    result.huge_mapped_bytes = huge_mapped.load(std::memory_order_relaxed);
+    return result;
+}
+
+void PageHeap::prepare_fork() {
+    mtx.lock();
+    huge_mtx.lock();
+}
+
+void PageHeap::after_fork() {
+    huge_mtx.unlock();
+    mtx.unlock();
+}
+
+BackgroundTrimmer::BackgroundTrimmer(std::chrono::milliseconds interval, std::function<void()> task) {
+    worker = std::thread([this, interval, task = std::move(task)] {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (!cv.wait_for(lock, interval, [this] { return stop; })) {
+            lock.unlock();
+            task();
+            lock.lock();
+        }
+    });
 }
 
-size_t LockFreeMultiSizePool::get_size_class_index(size_t size) {
-    // 替换线性搜索为二分查找
-    size_t left = 0;
-    size_t right = SIZE_CALSSES.size() - 1;
-    
-    while (left <= right) {
-        size_t mid = left + (right - left) / 2;
-        if (SIZE_CALSSES[mid] < size)
-            left = mid + 1;
-        else if (SIZE_CALSSES[mid] > size && mid > 0)
-            right = mid - 1;
-        else
-            return mid;
+BackgroundTrimmer::~BackgroundTrimmer() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stop = true;
     }
-    
-    return (left < SIZE_CALSSES.size()) ? left : SIZE_CALSSES.size();
+    cv.notify_all();
+    if (worker.joinable()) worker.join();
 }
 
-void LockFreeMultiSizePool::allocate_chunk_for_size_class(size_t index) {
-    if (index >= SIZE_CALSSES.size()) return; // 分配大对象
-    ChunkClass& chunk_class = chunk_classes[index];
-    size_t block_count = chunk_class.block_count;
+namespace {
+    // 登记表是侵入式链表，登记和查询都不申请内存，替换 malloc 时也可以使用
+    std::mutex lifetime_mtx;
+    pool_lifetime::Registration* live_pools = nullptr;
+    uint64_t next_generation = 1;
 
-    if (block_count == 0) block_count = 1;
+    thread_local pool_lifetime::ThreadCacheHook* thread_hooks = nullptr;
 
-    size_t actual_chunk_size = chunk_class.total_block_size * block_count;
-    auto chunk = std::make_unique<std::byte[]>(actual_chunk_size); // 分配一个chunk
-    std::byte* ptr = chunk.get();
+    // fork 时其他线程可能正持有内存池或页堆的锁，在父进程中把它们全部锁住后再 fork，子进程中的锁处于一致的未锁定状态
+    // 加锁顺序：登记锁 -> 各内存池（CPU 槽、registry、arena）-> 页堆，与分配路径中的嵌套顺序一致
+    void lifetime_prepare_fork() {
+        lifetime_mtx.lock();
+        for (pool_lifetime::Registration* pool = live_pools; pool; pool = pool->next) {
+            if (pool->prepare_fork) pool->prepare_fork(pool->owner);
+        }
+        PageHeap::instance().prepare_fork();
+    }
 
-    FreeBlock* first_block = nullptr;
-    FreeBlock* prev_block = nullptr;
-    FreeBlock* block  = nullptr;
-    // 将chunk 添加到对应大小的free_list 里面
-    for (size_t i = 0; i < block_count; ++i) {
-        // 获取每个block
-        block = new(ptr) FreeBlock(chunk_class.block_size);
-        ptr += chunk_class.total_block_size;
-        if (i == 0) {
-            first_block = block;
+    void lifetime_after_fork() {
+        PageHeap::instance().after_fork();
+        for (pool_lifetime::Registration* pool = live_pools; pool; pool = pool->next) {
+            if (pool->after_fork) pool->after_fork(pool->owner);
         }
+        lifetime_mtx.unlock();
+    }
+}
+
+uint64_t pool_lifetime::register_pool(Registration& registration) {
+    static std::once_flag atfork_once;
+    std::call_once(atfork_once, [] {
+        pthread_atfork(lifetime_prepare_fork, lifetime_after_fork, lifetime_after_fork);
+    });
+    std::lock_guard<std::mutex> lock(lifetime_mtx);
+    registration.generation = next_generation++;
+    registration.next = live_pools;
+    live_pools = &registration;
+    return registration.generation;
+}
 
-        if (prev_block) {
-            prev_block->next.store(block, std::memory_order_relaxed);
+void pool_lifetime::unregister_pool(Registration& registration) {
+    std::lock_guard<std::mutex> lock(lifetime_mtx);
+    for (Registration** link = &live_pools; *link; link = &(*link)->next) {
+        if (*link == &registration) {
+            *link = registration.next;
+            break;
         }
-        prev_block = block;
     }
-    // 将block 添加到free_list
-    FreeBlock* old_block = chunk_class.free_list.load(std::memory_order_relaxed);
-    do {
-        block->next.store(old_block, std::memory_order_relaxed);
-    } while(!chunk_class.free_list.compare_exchange_weak(old_block, first_block,  std::memory_order_release, std::memory_order_relaxed));
-    allocated_chunks.push(std::move(chunk)); // 将chunk 添加到allocated_chunks 管理
-}
\ No newline at end of file
+}
+
+std::unique_lock<std::mutex> pool_lifetime::lock_if_alive(uint64_t generation) {
+    std::unique_lock<std::mutex> lock(lifetime_mtx);
+    for (Registration* registration = live_pools; registration; registration = registration->next) {
+        if (registration->generation == generation) return lock;
+    }
+    return {};
+}
+
+void pool_lifetime::link(ThreadCacheHook& hook) {
+    if (hook.linked) return;
+    hook.next = thread_hooks;
+    thread_hooks = &hook;
+    hook.linked = true;
+}
+
+void pool_lifetime::unlink(ThreadCacheHook& hook) {
+    if (!hook.linked) return;
+    for (ThreadCacheHook** link = &thread_hooks; *link; link = &(*link)->next) {
+        if (*link == &hook) {
+            *link = hook.next;
+            break;
+        }
+    }
+    hook.linked = false;
+}
+
+void pool_lifetime::thread_detach() {
+    for (ThreadCacheHook* hook = thread_hooks; hook; hook = hook->next) {
+        hook->detach(hook);
+    }
+    PageHeap::instance().flush_thread_cache();
+}
+
+namespace {
+    std::atomic<PoolErrorHandler> pool_error_handler{nullptr};
+}
+
+const char* pool_error_name(PoolError error) {
+    switch (error) {
+        case PoolError::DoubleFree: return "Double free";
+        case PoolError::BufferOverflow: return "Buffer overflow";
+        case PoolError::UseAfterFree: return "Use after free";
+    }
+    return "Unknown error";
+}
+
+PoolErrorHandler set_pool_error_handler(PoolErrorHandler handler) {
+    return pool_error_handler.exchange(handler);
+}
+
+void report_pool_error(PoolError error, const void* ptr, size_t size) {
+    if (PoolErrorHandler handler = pool_error_handler.load()) {
+        handler(error, ptr, size);
+        return;
+    }
+    LOG_ERROR("{} detected, ptr:{}, size:{}", pool_error_name(error), ptr, size);
+}
+
+template class BasicMultiSizePool<DefaultSizeClasses>;
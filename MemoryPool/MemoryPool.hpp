@@ -4,83 +4,739 @@
 #include <atomic>
 #include <vector>
 #include <memory>
-#include <cstddef> 
+#include <cstddef>
+#include <cstdint>
 #include <array>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <bit>
+#include <concepts>
+#include <cstring>
+
+#include "logger.hpp"
+
+// 统计与剖析开关，对应 CMake 选项 MEMORYPOOL_STATS / MEMORYPOOL_PROFILING
+#ifndef MEMORYPOOL_STATS
+#define MEMORYPOOL_STATS 1
+#endif
+#ifndef MEMORYPOOL_PROFILING
+#define MEMORYPOOL_PROFILING 0
+#endif
+// 加固模式：越界检测、释放后投毒、隔离区与可靠的重复释放检测，对应 CMake 选项 MEMORYPOOL_HARDENED
+#ifndef MEMORYPOOL_HARDENED
+#define MEMORYPOOL_HARDENED 0
+#endif
+
+#if MEMORYPOOL_STATS
+#define MEMORYPOOL_STAT(expr) (expr)
+#else
+#define MEMORYPOOL_STAT(expr) ((void)0)
+#endif
+
+#if MEMORYPOOL_PROFILING
+#include "HeapProfiler.hpp"
+#endif
+
+// 在 AddressSanitizer 下标记空闲块和块尾的空隙，越界与释放后访问由 ASan 直接报告
+#if defined(__SANITIZE_ADDRESS__)
+#define MEMORYPOOL_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define MEMORYPOOL_ASAN 1
+#endif
+#endif
+
+// glibc 2.35 起为每个线程注册 rseq，并导出其在 TLS 中的偏移
+#if __has_include(<sys/rseq.h>)
+#include <sys/rseq.h>
+#define MEMORYPOOL_HAS_RSEQ 1
+#else
+#define MEMORYPOOL_HAS_RSEQ 0
+#endif
+
+#ifdef MEMORYPOOL_ASAN
+#include <sanitizer/asan_interface.h>
+#define MEMORYPOOL_ASAN_POISON(addr, size) ASAN_POISON_MEMORY_REGION(addr, size)
+#define MEMORYPOOL_ASAN_UNPOISON(addr, size) ASAN_UNPOISON_MEMORY_REGION(addr, size)
+#else
+#define MEMORYPOOL_ASAN_POISON(addr, size) ((void)(addr), (void)(size))
+#define MEMORYPOOL_ASAN_UNPOISON(addr, size) ((void)(addr), (void)(size))
+#endif
 
 constexpr size_t align_of(size_t size, size_t allignment) {
     return (size + allignment -1) & ~(allignment - 1);
 }
-// 无锁栈实现
-template <typename T>
-class LockFreeStack {
+
+// 不使用 std::hardware_destructive_interference_size：其值随编译选项变化，放在头文件中会导致 ABI 不一致
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+// 内存池检测到的错误
+enum class PoolError {
+    DoubleFree,
+    BufferOverflow,     // 块前后的金丝雀被改写
+    UseAfterFree,       // 空闲块的投毒内容在复用时被改写
+};
+
+const char* pool_error_name(PoolError error);
+
+// 设置错误处理函数并返回之前的处理函数，传入 nullptr 恢复默认行为（LOG_ERROR）
+using PoolErrorHandler = void (*)(PoolError error, const void* ptr, size_t size);
+PoolErrorHandler set_pool_error_handler(PoolErrorHandler handler);
+void report_pool_error(PoolError error, const void* ptr, size_t size);
+
+#if MEMORYPOOL_HARDENED
+namespace hardening {
+    constexpr unsigned char POISON_BYTE = 0xdd;     // 空闲块的数据区
+    constexpr unsigned char CANARY_BYTE = 0xfd;     // 用户数据之后的空隙与 redzone
+    constexpr uint64_t HEADER_CANARY = 0x5afec0de5afec0deull;
+    constexpr size_t REDZONE = 16;
+
+    inline bool check_fill(const void* ptr, size_t size, unsigned char value) {
+        auto* bytes = static_cast<const unsigned char*>(ptr);
+        for (size_t i = 0; i < size; ++i) {
+            if (bytes[i] != value) return false;
+        }
+        return true;
+    }
+
+    // 最近释放的块先进入隔离区，延迟复用，让释放后写入有机会在复用前被发现
+    template<typename Block, size_t Capacity = 256>
+    class Quarantine {
+    public:
+        // 放入一个块，隔离区已满时返回最早放入的块，否则返回 nullptr
+        Block* push(Block* block) {
+            std::lock_guard<std::mutex> lock(mtx);
+            Block* evicted = nullptr;
+            if (count == Capacity) {
+                evicted = ring[head];
+                head = (head + 1) % Capacity;
+                --count;
+            }
+            ring[(head + count) % Capacity] = block;
+            ++count;
+            return evicted;
+        }
+
+        // 取出全部块
+        template<typename Func>
+        void drain(Func&& func) {
+            std::lock_guard<std::mutex> lock(mtx);
+            for (; count > 0; --count) {
+                func(ring[head]);
+                head = (head + 1) % Capacity;
+            }
+        }
+
+        // fork 前持有锁，保证子进程中隔离区处于一致状态
+        void lock() { mtx.lock(); }
+        void unlock() { mtx.unlock(); }
+
+    private:
+        std::mutex mtx;
+        Block* ring[Capacity] = {};
+        size_t head = 0;
+        size_t count = 0;
+    };
+}
+#endif
+
+// chunk 归还给操作系统的方式
+enum class DecommitMode {
+    DontNeed,   // MADV_DONTNEED: 立即释放物理页
+    Free,       // MADV_FREE: 内存紧张时由内核回收，开销更小
+};
+
+// 空闲 chunk 的保留策略
+struct RetentionPolicy {
+    size_t retain_empty_chunks = 1;                 // 每个大小类保留的已提交空 chunk 数量
+    DecommitMode decommit_mode = DecommitMode::DontNeed;
+    std::chrono::milliseconds trim_interval{0};     // 后台 trim 周期，0 表示只在调用 trim() 时回收
+    size_t thread_cache_budget = 8 * 1024 * 1024;   // 所有线程缓存合计的字节预算，按线程数平分
+    bool pack_by_occupancy = true;                  // trim 时按 chunk 占用率重排空闲链表，之后优先从最满的 chunk 分配
+};
+
+// reserve() 预留 chunk 时的预热方式
+struct ReserveOptions {
+    bool prefault = true;       // 预先触发缺页，首次访问时不再有 page fault
+    bool lock_memory = false;   // mlock 已提交的 chunk，锁定的 chunk 不会被 trim 回收
+};
+
+// chunk 的页面来源
+enum class PageBacking {
+    Standard,               // 每个 chunk 单独 mmap，使用 4K 页
+    TransparentHugePages,   // 从 2MiB 对齐的大区域切分 chunk，并 madvise(MADV_HUGEPAGE)
+    HugeTLB,                // MAP_HUGETLB 显式大页，系统未预留大页时退回透明大页
+};
+
+// 直接向操作系统申请/归还页
+namespace os_memory {
+    constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    size_t page_size();
+    void* map(size_t bytes);
+    void* map_aligned(size_t bytes, size_t alignment);
+    void* map_huge_tlb(size_t bytes);   // 失败返回 nullptr
+    void unmap(void* ptr, size_t bytes);
+    void advise_huge_pages(void* ptr, size_t bytes);
+    void decommit(void* ptr, size_t bytes, DecommitMode mode);
+    void prefault(void* ptr, size_t bytes);     // 只能在页面内容尚未使用时调用
+    bool lock(void* ptr, size_t bytes);         // mlock，超出 RLIMIT_MEMLOCK 等情况返回 false
+    size_t resident_bytes();    // 当前进程 RSS
+}
+
+// 大页区域：一次预留大块虚拟地址，按顺序切分给各个 chunk
+// 区域只在 arena 销毁时整体 munmap
+class HugePageArena {
+public:
+    static constexpr size_t DEFAULT_REGION_SIZE = 64 * 1024 * 1024;
+
+    explicit HugePageArena(PageBacking backing, size_t region_size = DEFAULT_REGION_SIZE);
+    ~HugePageArena();
+
+    HugePageArena(const HugePageArena&) = delete;
+    HugePageArena& operator=(const HugePageArena&) = delete;
+
+    // alignment 不超过大页大小，0 表示按页对齐
+    void* allocate(size_t bytes, size_t alignment = 0);
+
+    // MAP_HUGETLB 的页不能按 4K 粒度 decommit
+    bool supports_decommit() const { return !huge_tlb.load(std::memory_order_acquire); }
+    bool uses_huge_tlb() const { return huge_tlb.load(std::memory_order_acquire); }
+    size_t reserved_bytes() const;
+
+    // fork 前持有锁，保证子进程中 arena 处于一致状态
+    void lock() { mtx.lock(); }
+    void unlock() { mtx.unlock(); }
+
+private:
+    struct Region {
+        std::byte* base;
+        size_t bytes;
+        size_t used;
+    };
+
+    bool reserve_region(size_t min_bytes);
+
+    mutable std::mutex mtx;
+    std::vector<Region> regions;
+    size_t region_size;
+    bool try_huge_tlb;
+    std::atomic<bool> huge_tlb{false};  // 是否已有区域使用 MAP_HUGETLB
+};
+
+// chunk 记录，与 chunk 内存分开存放，decommit 之后依然有效
+struct ChunkRecord {
+    std::byte* base = nullptr;
+    size_t bytes = 0;
+    size_t block_count = 0;     // chunk 中的 block 数量
+    size_t free_seen = 0;       // trim 扫描时统计到的空闲 block 数量
+    std::atomic<size_t> carved{0};      // 已切出的 block 数量，不小于 block_count 表示已切完
+    bool committed = true;
+    bool releasing = false;
+    bool pinned = false;                // 已 mlock，trim 时保留
+    uint8_t occupancy_bin = 0;          // trim 扫描时的占用率分档，越大越满
+    ChunkRecord* next = nullptr;        // 全部 chunk 链表
+    ChunkRecord* next_idle = nullptr;   // 已 decommit、等待复用的 chunk 链表
+};
+
+// 管理同一大小类的所有 chunk：申请、复用和 trim
+// 只有 chunk 增长和 trim 时才加锁，分配/释放的热路径不受影响
+class ChunkRegistry {
 public:
-    LockFreeStack():head(nullptr) {}
-    ~LockFreeStack() {
-        T dummy;
-        while(pop(dummy)) {}
+    ChunkRegistry() = default;
+    ~ChunkRegistry();
+
+    ChunkRegistry(const ChunkRegistry&) = delete;
+    ChunkRegistry& operator=(const ChunkRegistry&) = delete;
+
+    // 设置后 chunk 从大页 arena 中切分，arena 的生命周期必须长于 registry
+    void set_arena(HugePageArena* huge_arena) { arena = huge_arena; }
+
+    // 获取一个 chunk，优先复用已 decommit 的虚拟地址，否则 mmap 新的
+    // alignment 非 0 时 chunk 起始地址按其对齐（同一 registry 的所有 chunk 须使用相同的对齐）
+    // 返回的 chunk 视为已经全部切出，由调用方初始化全部 block，或交给 start_carving 惰性切分
+    ChunkRecord* acquire(size_t bytes, size_t block_count, size_t alignment = 0);
+
+    // 惰性切分：按需增长的 chunk 不预先串成空闲链表，由游标顺序切出从未使用过的 block
+    // block 只有在被释放之后才进入空闲链表，增长时不会触碰整个 chunk
+    // 从切分中的 chunk 无锁地取最多 n 个相邻 block，first/count 为 block 序号范围；chunk 用尽时返回 nullptr
+    ChunkRecord* carve(size_t n, size_t& first, size_t& count);
+
+    // 把 chunk 设为切分对象，调用方须先写好 chunk 中 block 之外的数据（如 chunk 头部）
+    // 原切分对象若还有未切出的 block（并发增长时可能发生），取走并返回，first/count 为序号范围，由调用方挂回空闲链表
+    ChunkRecord* start_carving(ChunkRecord* chunk, size_t& first, size_t& count);
+
+    // 扫描全局空闲链表，把完全空闲的 chunk 按策略 decommit，返回释放的字节数
+    // 尚未切出的 block 视为空闲；切分中的 chunk 只有在回收期间没有被继续切分时才会释放
+    // policy.pack_by_occupancy 时剩余的 block 按所属 chunk 的占用率分档挂回：最满的 chunk 在链表头，
+    // 之后的分配先填满它们，占用率低的 chunk 只出不进，逐渐变空并在下一次 trim 时回收
+    // 已 decommit 的 chunk 不会 munmap：其他线程可能仍持有旧的链表指针，读到的只是零页
+    // pop_lock 是空闲链表的取块锁，只在摘下整条链表时持有；挂回是普通的压栈，这些 block 已不在链表中，没有 ABA 问题
+    template<typename Block, typename PopLock>
+    size_t trim(std::atomic<Block*>& free_list, PopLock& pop_lock, const RetentionPolicy& policy);
+
+    // mlock 所有已提交且尚未锁定的 chunk，返回新锁定的字节数；失败时记录警告并停止
+    size_t pin_committed();
+
+    // 调用方确认 chunk 不再使用：decommit 后放入空闲列表等待复用，返回释放的字节数
+    size_t release(ChunkRecord* chunk, DecommitMode mode);
+
+    size_t chunk_count() const;
+    size_t committed_bytes() const;
+
+    // fork 前持有锁，保证子进程中 registry 处于一致状态
+    void lock() { mtx.lock(); }
+    void unlock() { mtx.unlock(); }
+
+private:
+    mutable std::mutex mtx;
+    HugePageArena* arena = nullptr;
+    std::atomic<ChunkRecord*> carving{nullptr};     // 当前惰性切分的 chunk
+    ChunkRecord* chunks = nullptr;
+    ChunkRecord* idle_chunks = nullptr;
+    size_t total_chunks = 0;
+    static constexpr size_t OCCUPANCY_BINS = 8;
+    size_t committed = 0;
+};
+
+template<typename Block, typename PopLock>
+size_t ChunkRegistry::trim(std::atomic<Block*>& free_list, PopLock& pop_lock, const RetentionPolicy& policy) {
+    // 一次性摘下整条空闲链表，扫描完成后再挂回去
+    // 取块时可能持有 pop_lock 申请新 chunk（需要 mtx），所以先摘链表、放开 pop_lock 之后再加 mtx
+    // 此后取块的线程看到空链表会切分或申请新 chunk，这些 block 不在摘下的链表中，按已使用计算
+    Block* head = nullptr;
+    {
+        std::lock_guard<PopLock> guard(pop_lock);
+        head = free_list.exchange(nullptr, std::memory_order_acquire);
+    }
+    if (!head) return 0;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    // MAP_HUGETLB 的 arena 不能 decommit，只重排空闲链表
+    bool can_release = !arena || arena->supports_decommit();
+
+    // 按地址排序，用于从 block 反查所属 chunk
+    std::vector<ChunkRecord*> sorted;
+    // 切分中的 chunk 记下此刻已切出的数量，其余 chunk 都已切完
+    ChunkRecord* carving_chunk = carving.load(std::memory_order_acquire);
+    size_t carved_snapshot = carving_chunk ? carving_chunk->carved.load(std::memory_order_acquire) : 0;
+    auto carved_blocks = [&](ChunkRecord* chunk) {
+        return chunk == carving_chunk ? std::min(carved_snapshot, chunk->block_count) : chunk->block_count;
+    };
+
+    for (ChunkRecord* chunk = chunks; chunk; chunk = chunk->next) {
+        if (!chunk->committed) continue;
+        chunk->free_seen = 0;
+        chunk->releasing = false;
+        sorted.push_back(chunk);
     }
+    std::sort(sorted.begin(), sorted.end(), [](ChunkRecord* a, ChunkRecord* b) { return a->base < b->base; });
 
-    void push(T item) {
-        auto* newNode = new Node(std::move(item));
-        Node* oldNode = head.load(std::memory_order_relaxed);
-        do{
-            newNode->next.store(oldNode, std::memory_order_relaxed);
-        } while(!head.compare_exchange_weak(oldNode, newNode, std::memory_order_release, std::memory_order_relaxed));
+    auto owner = [&](Block* block) -> ChunkRecord* {
+        auto* addr = reinterpret_cast<std::byte*>(block);
+        auto it = std::upper_bound(sorted.begin(), sorted.end(), addr,
+            [](std::byte* p, ChunkRecord* chunk) { return p < chunk->base; });
+        if (it == sorted.begin()) return nullptr;
+        ChunkRecord* chunk = *(it - 1);
+        return addr < chunk->base + chunk->bytes ? chunk : nullptr;
+    };
+
+    for (Block* block = head; block; block = block->next.load(std::memory_order_relaxed)) {
+        if (ChunkRecord* chunk = owner(block)) ++chunk->free_seen;
+    }
+
+    // 所有 block 都在空闲链表中的 chunk 才能回收，超出保留数量的部分标记释放
+    size_t retained = 0;
+    size_t releasing = 0;
+    for (ChunkRecord* chunk : sorted) {
+        size_t used = carved_blocks(chunk) - std::min(chunk->free_seen, carved_blocks(chunk));
+        chunk->occupancy_bin = static_cast<uint8_t>(used * (OCCUPANCY_BINS - 1) / chunk->block_count);
+        if (used != 0 || chunk->pinned || !can_release) continue;
+        if (retained < policy.retain_empty_chunks) {
+            ++retained;
+            continue;
+        }
+        if (chunk == carving_chunk) {
+            // 取消切分：游标在快照之后没有移动才能回收，否则新切出的 block 正在被使用
+            // 持有 mtx 期间没有人能设置新的切分对象，失败时原样恢复
+            carving.store(nullptr, std::memory_order_release);
+            size_t expected = carved_snapshot;
+            if (!chunk->carved.compare_exchange_strong(expected, chunk->block_count, std::memory_order_acq_rel)) {
+                carving.store(chunk, std::memory_order_release);
+                continue;
+            }
+        }
+        chunk->releasing = true;
+        ++releasing;
     }
-    bool pop(T& result) {
-        Node* oldNode = head.load(std::memory_order_relaxed);
-        if (oldNode) {
-            if (head.compare_exchange_weak(oldNode, oldNode->next.load(std::memory_order_relaxed), std::memory_order_release, std::memory_order_relaxed)) {
-                result = std::move(oldNode->data);
-                delete oldNode;
-                return true;
+
+    // 剔除待释放 chunk 中的 block，剩余的按占用率分档（不重排时全部放在同一档，保持原顺序）
+    Block* bin_head[OCCUPANCY_BINS] = {};
+    Block* bin_tail[OCCUPANCY_BINS] = {};
+    for (Block* block = head; block;) {
+        Block* next = block->next.load(std::memory_order_relaxed);
+        ChunkRecord* chunk = owner(block);
+        if (!releasing || !chunk || !chunk->releasing) {
+            size_t bin = policy.pack_by_occupancy && chunk ? chunk->occupancy_bin : OCCUPANCY_BINS - 1;
+            if (bin_tail[bin]) {
+                bin_tail[bin]->next.store(block, std::memory_order_relaxed);
+            } else {
+                bin_head[bin] = block;
             }
+            bin_tail[bin] = block;
         }
-        return false;
+        block = next;
+    }
+
+    // 从最满的一档开始串联
+    Block* keep_head = nullptr;
+    Block* keep_tail = nullptr;
+    for (size_t bin = OCCUPANCY_BINS; bin-- > 0;) {
+        if (!bin_head[bin]) continue;
+        if (keep_tail) {
+            keep_tail->next.store(bin_head[bin], std::memory_order_relaxed);
+        } else {
+            keep_head = bin_head[bin];
+        }
+        keep_tail = bin_tail[bin];
+    }
+
+    if (keep_head) {
+        Block* old_head = free_list.load(std::memory_order_relaxed);
+        do {
+            keep_tail->next.store(old_head, std::memory_order_relaxed);
+        } while (!free_list.compare_exchange_weak(old_head, keep_head, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    size_t released = 0;
+    for (ChunkRecord* chunk : sorted) {
+        if (!chunk->releasing) continue;
+        os_memory::decommit(chunk->base, chunk->bytes, policy.decommit_mode);
+        chunk->releasing = false;
+        chunk->committed = false;
+        chunk->next_idle = idle_chunks;
+        idle_chunks = chunk;
+        committed -= chunk->bytes;
+        released += chunk->bytes;
+    }
+    return released;
+}
+
+// 大对象页堆，进程内所有内存池共享
+// 不超过 1M 的请求按页数（8k 为一页）从 4M 对齐的 segment 中切分 span，释放时与相邻空闲 span 合并
+// 256k 以内的 span 先进入无锁的线程缓存；更大的请求直接 mmap，释放后缓存少量映射以便复用
+class PageHeap {
+public:
+    static constexpr size_t PAGE_SHIFT = 13;
+    static constexpr size_t PAGE_BYTES = size_t(1) << PAGE_SHIFT;
+    static constexpr size_t SEGMENT_SIZE = 4 * 1024 * 1024;
+    static constexpr size_t PAGES_PER_SEGMENT = SEGMENT_SIZE / PAGE_BYTES;
+    static constexpr size_t MAX_SPAN_PAGES = 128;           // 1M 以内走 span
+    static constexpr size_t MAX_CACHED_PAGES = 32;          // 256k 以内进入线程缓存
+    static constexpr size_t THREAD_CACHE_BYTES = 2 * 1024 * 1024;
+    static constexpr size_t HUGE_GRANULE = 64 * 1024;       // 直接 mmap 的请求按 64k 取整
+    static constexpr size_t HUGE_CACHE_BYTES = 64 * 1024 * 1024;
+    static constexpr size_t HUGE_CACHE_ENTRIES = 16;
+
+    struct Stats {
+        size_t segments;            // 已映射的 segment 数量
+        size_t free_pages;          // 页堆中空闲的页数
+        size_t largest_free_run;    // 最长的连续空闲页数
+        size_t huge_mapped_bytes;   // 直接 mmap 且正在使用的字节数
+        size_t huge_cached_bytes;   // 缓存等待复用的 mmap 字节数
+    };
+
+    // 进程生命周期内不析构，线程退出时仍可以归还线程缓存
+    static PageHeap& instance();
+
+    void* allocate(size_t size);
+    void deallocate(void* ptr, size_t size);
+
+    // 归还当前线程缓存，释放完全空闲的 segment 和缓存的 mmap，返回释放的字节数
+    size_t trim();
+
+    // 将当前线程缓存的 span 归还页堆
+    void flush_thread_cache();
+
+    Stats stats() const;
+
+    // 供 pthread_atfork 使用：fork 前持有全部锁，fork 后在父子进程中释放
+    void prepare_fork();
+    void after_fork();
+
+    static size_t pages_for(size_t size) { return (size + PAGE_BYTES - 1) >> PAGE_SHIFT; }
+
+private:
+    struct Span;
+    struct Segment;
+    struct HugeMapping {
+        void* ptr;
+        size_t bytes;
+    };
+
+    PageHeap() = default;
+
+    static Segment* segment_of(const void* ptr) {
+        return reinterpret_cast<Segment*>(reinterpret_cast<uintptr_t>(ptr) & ~(SEGMENT_SIZE - 1));
+    }
+
+    // segment 头部占用的页数和可用于 span 的页数，定义在 Segment 完整之后
+    static const size_t HEADER_PAGES;
+    static const size_t USABLE_PAGES;
+
+    void* allocate_span(size_t pages);
+    void deallocate_span(void* ptr, size_t pages);
+    void* allocate_huge(size_t bytes);
+    void deallocate_huge(void* ptr, size_t bytes);
+
+    Span* find_free_span(size_t pages);
+    Span* split(Span* span, size_t pages);
+    void insert_free(Span* span);
+    void remove_free(Span* span);
+    bool add_segment();
+
+    mutable std::mutex mtx;
+    Segment* segments = nullptr;
+    Span* free_lists[MAX_SPAN_PAGES + 2] = {};     // 按页数分桶，最后一个桶存放更长的 span
+    uint64_t nonempty[(MAX_SPAN_PAGES + 2 + 63) / 64] = {};
+    size_t segment_count = 0;
+    size_t free_pages = 0;
+
+    mutable std::mutex huge_mtx;
+    HugeMapping huge_cache[HUGE_CACHE_ENTRIES] = {};
+    size_t huge_cache_count = 0;
+    size_t huge_cached = 0;
+    std::atomic<size_t> huge_mapped{0};
+};
+
+// 周期性调用 trim 的后台线程
+class BackgroundTrimmer {
+public:
+    BackgroundTrimmer(std::chrono::milliseconds interval, std::function<void()> task);
+    ~BackgroundTrimmer();
+
+    BackgroundTrimmer(const BackgroundTrimmer&) = delete;
+    BackgroundTrimmer& operator=(const BackgroundTrimmer&) = delete;
+
+private:
+    std::thread worker;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stop = false;
+};
+
+// 内存池与线程缓存的生命周期
+// 线程缓存可能比内存池活得更久（池在别的线程析构、线程退出晚于池），也可能绑定到复用了旧地址的新池
+// 每个内存池构造时登记并取得唯一的代号，线程缓存同时记下指针和代号，归还前确认代号仍然登记
+namespace pool_lifetime {
+    using ForkHook = void (*)(void* owner);
+
+    struct Registration {
+        uint64_t generation = 0;
+        Registration* next = nullptr;
+        // 可选：fork 前持有内存池自己的全部锁，fork 后在父子进程中释放；页堆由 fork 处理函数统一加锁
+        void* owner = nullptr;
+        ForkHook prepare_fork = nullptr;
+        ForkHook after_fork = nullptr;
+    };
+
+    // 登记内存池，返回代号；第一次调用时注册 pthread_atfork
+    // fork 时持有登记锁，依次调用所有存活内存池的 prepare_fork，再锁住页堆；子进程中的内存池因此可以继续使用
+    uint64_t register_pool(Registration& registration);
+    void unregister_pool(Registration& registration);
+
+    // 代号仍然登记时返回持有登记锁的 lock，持锁期间对应的内存池不会析构完成；否则返回空 lock
+    std::unique_lock<std::mutex> lock_if_alive(uint64_t generation);
+
+    // 线程缓存第一次绑定内存池时挂入当前线程的链表，thread_detach() 依次调用 detach 归还
+    struct ThreadCacheHook {
+        void (*detach)(ThreadCacheHook*) = nullptr;
+        ThreadCacheHook* next = nullptr;
+        bool linked = false;
+    };
+    void link(ThreadCacheHook& hook);
+    void unlink(ThreadCacheHook& hook);
+
+    // 把当前线程在所有内存池（包括页堆）中的缓存归还全局，线程即将退出或长时间空闲前调用
+    // 之后线程仍可以继续分配，缓存会重新建立
+    void thread_detach();
+}
+
+// 空闲块缓存的组织方式
+enum class CacheMode {
+    Thread,     // 每个线程一份缓存，缓存占用随线程数增长
+    PerCpu,     // 每个 CPU 一份缓存，缓存占用只与核数有关；rseq 不可用时退回 Thread
+};
+
+// 当前 CPU 编号：直接读取 glibc 注册的 rseq 区域中由内核维护的 cpu_id，不需要系统调用
+namespace percpu {
+    bool available();       // 内核与 glibc 是否为线程注册了 rseq
+    size_t cpu_count();     // 可能出现的 CPU 编号上限
+
+    inline unsigned current_cpu() {
+#if MEMORYPOOL_HAS_RSEQ
+        auto* area = reinterpret_cast<const volatile struct rseq*>(static_cast<const char*>(__builtin_thread_pointer()) + __rseq_offset);
+        int32_t cpu = area->cpu_id;
+        return cpu >= 0 ? static_cast<unsigned>(cpu) : 0;
+#else
+        return 0;
+#endif
     }
-    bool empty() const {
-        return head.load(std::memory_order_relaxed) == nullptr;
+}
+
+// 每 CPU 缓存的锁：只有线程在持锁期间被抢占或迁移时才会发生竞争
+class SpinLock {
+public:
+    void lock() {
+        while (flag.test_and_set(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
     }
+    void unlock() { flag.clear(std::memory_order_release); }
+
 private:
-    struct Node {
-        T data;
-        std::atomic<Node*> next;
+    std::atomic_flag flag = ATOMIC_FLAG_INIT;
+};
+
+// 每个 CPU 一组按类别划分的空闲块链表，块通过自身的 next 指针串起来
+// 用户态无法保证持锁线程不被迁移，因此以自旋锁代替 rseq 临界区，锁几乎总是无竞争的
+template<typename Block, size_t Classes>
+class PerCpuCache {
+public:
+    struct List {
+        Block* head = nullptr;
+        uint32_t count = 0;
+
+        Block* pop() {
+            Block* block = head;
+            head = block->next.load(std::memory_order_relaxed);
+            --count;
+            return block;
+        }
+
+        void push(Block* block) {
+            block->next.store(head, std::memory_order_relaxed);
+            head = block;
+            ++count;
+        }
+
+        // 取下头部的 n 个块，返回 {first, last}，last->next 未修改
+        std::pair<Block*, Block*> take(uint32_t n) {
+            n = std::min(n, count);
+            if (n == 0) return {nullptr, nullptr};
+            Block* first = head;
+            Block* last = first;
+            for (uint32_t i = 1; i < n; ++i) {
+                last = last->next.load(std::memory_order_relaxed);
+            }
+            head = last->next.load(std::memory_order_relaxed);
+            count -= n;
+            return {first, last};
+        }
+    };
 
-        template<typename... Args>
-        Node(Args&&... args): data(std::forward<Args>(args)...), next(nullptr) {}
+    struct alignas(CACHE_LINE_SIZE) Slot {
+        SpinLock lock;
+        List lists[Classes];
     };
 
-    std::atomic<Node*> head;
+    PerCpuCache() : slot_count(percpu::cpu_count()), slots(std::make_unique<Slot[]>(slot_count)) {}
+
+    Slot& local() { return slots[percpu::current_cpu() % slot_count]; }
+    Slot& operator[](size_t cpu) { return slots[cpu]; }
+    size_t size() const { return slot_count; }
+
+    // fork 前持有所有槽的锁
+    void lock_all() {
+        for (size_t cpu = 0; cpu < slot_count; ++cpu) slots[cpu].lock.lock();
+    }
+    void unlock_all() {
+        for (size_t cpu = slot_count; cpu-- > 0;) slots[cpu].lock.unlock();
+    }
+
+private:
+    size_t slot_count;
+    std::unique_ptr<Slot[]> slots;
+};
+
+// 固定大小内存池中块的布局
+enum class BlockLayout {
+    Compact,        // 块按 T 对齐紧密排列，空闲链接位于对象之后
+    CacheAligned,   // 块按缓存行对齐并填充，空闲链接存放在对象体内；适合会被不同线程并发访问的对象
 };
 
+namespace fixed_pool_detail {
+    // 加固模式会填充对象体，ASan 会毒化对象体，这两种情况下链接仍放在对象之外
+#if MEMORYPOOL_HARDENED || defined(MEMORYPOOL_ASAN)
+    constexpr bool INLINE_LINK_SUPPORTED = false;
+#else
+    constexpr bool INLINE_LINK_SUPPORTED = true;
+#endif
+}
+
 // 无锁固定大小内存池
-template <typename T, size_t N = 4096>
+template <typename T, size_t N = 4096, BlockLayout Layout = BlockLayout::Compact>
 class LockFreeFixedSizePool {
 private:
-    struct alignas(T) Block {
+    static constexpr bool INLINE_LINK = Layout == BlockLayout::CacheAligned && fixed_pool_detail::INLINE_LINK_SUPPORTED;
+
+    template<size_t Align>
+    struct alignas(Align) LinkedBlock {
         std::byte data[sizeof(T)]; // 每个block的大小为T
-        std::atomic<Block*> next{nullptr};
+#if MEMORYPOOL_HARDENED
+        uint64_t canary = hardening::HEADER_CANARY;    // 紧跟 data，检测向后越界
+        std::atomic<bool> free_flag{true};
+#endif
+        std::atomic<LinkedBlock*> next{nullptr};
         T* as_object() { return reinterpret_cast<T*>(data);}
     };
 
-    struct Chunk { // 每个chunk包含N个block
-        std::unique_ptr<Block[]> blocks;
-        size_t count;
-        Chunk(size_t block_count)
-            :blocks(std::make_unique<Block[]>(block_count)), count(block_count) {}
+    // 空闲块的对象已经析构，链接复用对象体，块大小只按缓存行向上取整
+    struct alignas(std::max(alignof(T), CACHE_LINE_SIZE)) InlineBlock {
+        union {
+            std::byte data[sizeof(T)];
+            std::atomic<InlineBlock*> next;
+        };
+        InlineBlock() : next(nullptr) {}
+        T* as_object() { return reinterpret_cast<T*>(data);}
     };
 
-    struct ThreadCache {
+    using Block = std::conditional_t<INLINE_LINK, InlineBlock,
+                  LinkedBlock<Layout == BlockLayout::CacheAligned ? std::max(alignof(T), CACHE_LINE_SIZE) : alignof(T)>>;
+
+    struct ThreadCache : pool_lifetime::ThreadCacheHook {
         Block* blocks[32];
         int count = 0;
         static constexpr size_t BATCH_SIZE = 16; // 批量获取块的数量
 
-        LockFreeFixedSizePool<T, N>* pool_instance = nullptr;
+        LockFreeFixedSizePool* pool_instance = nullptr;
+        uint64_t generation = 0;    // 绑定时内存池的代号
+
+        constexpr ThreadCache() : pool_lifetime::ThreadCacheHook{&ThreadCache::detach_hook} {}
+
         ~ThreadCache() {
+            pool_lifetime::unlink(*this);
+            detach_pool();
+        }
+
+        static void detach_hook(pool_lifetime::ThreadCacheHook* hook) {
+            static_cast<ThreadCache*>(hook)->detach_pool();
+        }
+
+        // 解除绑定：内存池仍然存活时归还缓存，已经析构时缓存的块随它的 chunk 一起释放了，直接丢弃
+        void detach_pool() {
             if (count > 0 && pool_instance) {
-                return_thread_cache();
+                auto lock = pool_lifetime::lock_if_alive(generation);
+                if (lock.owns_lock()) return_thread_cache();
             }
+            count = 0;
+            pool_instance = nullptr;
         }
+
         // 将线程本地缓存归还全局链表
         void return_thread_cache() {
             if (count == 0 || !pool_instance) return;
@@ -102,29 +758,107 @@ private:
     };
     static inline thread_local ThreadCache local_cache;
 
-    static inline constexpr size_t BLOCK_PER_CHUNK = N / sizeof(Block);
+    // chunk 头部记录所属内存池；chunk 按 CHUNK_ALIGNMENT 对齐，由对象地址向下取整即可找到头部
+    struct ChunkHeader {
+        LockFreeFixedSizePool* pool;
+    };
+    static constexpr size_t CHUNK_HEADER = align_of(sizeof(ChunkHeader), alignof(Block));
+    static inline constexpr size_t BLOCK_PER_CHUNK = N > CHUNK_HEADER && (N - CHUNK_HEADER) / sizeof(Block) > 0 ? (N - CHUNK_HEADER) / sizeof(Block) : 1;
+    static constexpr size_t CHUNK_BYTES = CHUNK_HEADER + BLOCK_PER_CHUNK * sizeof(Block);
+    static constexpr size_t CHUNK_ALIGNMENT = std::bit_ceil(CHUNK_BYTES);
+
+    // 三个热点原子变量各占一个缓存行，互不干扰
+    alignas(CACHE_LINE_SIZE) std::atomic<Block*> free_list{nullptr};
+    // 从全局链表取块必须串行：遍历时读到的 next 可能已经过时（块被取走、归还后换了后继），CAS 仍会成功（ABA）
+    // 链接在对象体内时过时的 next 甚至是对象数据；归还仍是无锁的，trim 只在摘下整条链表时持有这把锁
+    SpinLock pop_lock;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> allocate_count{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> deallocated_count{0};
+    std::unique_ptr<HugePageArena> arena;
+    ChunkRegistry chunks;
+    RetentionPolicy retention;
+    std::unique_ptr<BackgroundTrimmer> trimmer;
+#if MEMORYPOOL_HARDENED
+    hardening::Quarantine<Block> quarantine;
+#endif
+    // CacheMode::PerCpu 时创建，每个 CPU 最多缓存 CPU_CACHE_CAPACITY 个块
+    static constexpr uint32_t CPU_CACHE_CAPACITY = 32;
+    std::unique_ptr<PerCpuCache<Block, 1>> cpu_cache;
+    pool_lifetime::Registration lifetime;
 
-    std::atomic<Block*> free_list{nullptr};
-    LockFreeStack<std::unique_ptr<Chunk>> chunks; 
-    std::atomic<size_t> allocate_count{0};
-    std::atomic<size_t> deallocated_count{0};
+    // 由 pool_lifetime 的 fork 处理函数调用：fork 前持有本池的全部锁，加锁顺序与分配路径一致
+    void prepare_fork() {
+        if (cpu_cache) cpu_cache->lock_all();
+        // 取块时持有 pop_lock 可能切分新 chunk，pop_lock 在 registry 之前
+        pop_lock.lock();
+        chunks.lock();
+        if (arena) arena->lock();
+#if MEMORYPOOL_HARDENED
+        quarantine.lock();
+#endif
+    }
 
-    void allocate_new_chunk() {
-        auto chunk = std::make_unique<Chunk>(BLOCK_PER_CHUNK);
-        Block* blocks = chunk->blocks.get();
+    void after_fork() {
+#if MEMORYPOOL_HARDENED
+        quarantine.unlock();
+#endif
+        if (arena) arena->unlock();
+        chunks.unlock();
+        pop_lock.unlock();
+        if (cpu_cache) cpu_cache->unlock_all();
+    }
 
-        // 准备链表，只在最后一步进行一次原子操作
-        auto* first_block = &blocks[0];
-        for (size_t i = 0; i < chunk->count - 1; ++i) {
-            blocks[i].next.store(&blocks[i+1], std::memory_order_relaxed);
+    // 初始化 chunk 中 [first, first + count) 号块，串成以 nullptr 结尾的链表
+    static Block* init_blocks(ChunkRecord* chunk, size_t first, size_t count) {
+        Block* blocks = reinterpret_cast<Block*>(chunk->base + CHUNK_HEADER);
+        for (size_t i = first; i < first + count; ++i) {
+            new (&blocks[i]) Block();
+#if MEMORYPOOL_HARDENED
+            std::memset(blocks[i].data, hardening::POISON_BYTE, sizeof(T));
+#endif
+            MEMORYPOOL_ASAN_POISON(blocks[i].data, sizeof(T));
+            blocks[i].next.store(i + 1 < first + count ? &blocks[i + 1] : nullptr, std::memory_order_relaxed);
         }
+        return &blocks[first];
+    }
 
-        Block* old_head = free_list.load(std::memory_order_relaxed);
+    // 初始化一段块并挂回全局链表
+    void publish_blocks(ChunkRecord* chunk, size_t first, size_t count) {
+        Block* head = init_blocks(chunk, first, count);
+        push_global(head, head + (count - 1));
+    }
+
+    // 按需增长时新 chunk 只设置切分游标，块在切出时才初始化
+    // warm 非空时由 reserve() 调用：预先触发缺页后整个 chunk 串入空闲链表，prewarm 可以直接取用
+    bool allocate_new_chunk(const ReserveOptions* warm = nullptr) {
+        ChunkRecord* chunk = chunks.acquire(CHUNK_BYTES, BLOCK_PER_CHUNK, CHUNK_ALIGNMENT);
+        if (!chunk) return false;
+        if (warm && warm->prefault) os_memory::prefault(chunk->base, chunk->bytes);
+        new (chunk->base) ChunkHeader{this};
+        if (warm) {
+            publish_blocks(chunk, 0, BLOCK_PER_CHUNK);
+            return true;
+        }
+        size_t first = 0;
+        size_t count = 0;
+        if (ChunkRecord* previous = chunks.start_carving(chunk, first, count)) {
+            publish_blocks(previous, first, count);
+        }
+        return true;
+    }
+
+    // 从切分中的 chunk 取最多 n 个从未使用过的块，用尽时申请新 chunk；返回以 nullptr 结尾的链表
+    Block* carve_blocks(size_t n, uint32_t& count) {
         do {
-            blocks[chunk->count-1].next.store(old_head, std::memory_order_relaxed);
-        } while(!free_list.compare_exchange_weak(old_head, first_block, std::memory_order_release, std::memory_order_relaxed));
-        //将所有块链接到空闲列表
-        chunks.push(std::move(chunk));
+            size_t first = 0;
+            size_t carved = 0;
+            if (ChunkRecord* chunk = chunks.carve(n, first, carved)) {
+                count = static_cast<uint32_t>(carved);
+                return init_blocks(chunk, first, carved);
+            }
+        } while (allocate_new_chunk());
+        count = 0;
+        return nullptr;
     }
 
     // 批量获取块到本地缓存
@@ -133,6 +867,7 @@ private:
         // 如果本地缓存还有剩余，则直接返回
         if (cache.count > 0) return;
 
+        std::lock_guard guard(pop_lock);
         // 从全局空闲列表中获取块
         int batch_size = ThreadCache::BATCH_SIZE;
         Block* head = nullptr;
@@ -141,11 +876,13 @@ private:
 
         Block* old_head = free_list.load(std::memory_order_acquire);
         do {
-            // 如果全局链表为空，分配新的块
+            // 如果全局链表为空，从 chunk 中切出新的块
             if (!old_head) {
-                allocate_new_chunk();
-                old_head = free_list.load(std::memory_order_acquire);
-                if (!old_head)  return;  // 如果还是仍然为空，返回
+                uint32_t count = 0;
+                for (Block* block = carve_blocks(batch_size, count); block; block = block->next.load(std::memory_order_relaxed)) {
+                    cache.blocks[cache.count++] = block;
+                }
+                return;
             }
 
             head = old_head;
@@ -168,20 +905,89 @@ private:
         }
         cache.count = i;
     }
-public:
-    LockFreeFixedSizePool() {
-        allocate_new_chunk();
+
+    // 一次 CAS 从全局链表取下最多 n 个块，返回以 nullptr 结尾的链表，count 为实际数量
+    Block* pop_global(size_t n, uint32_t& count) {
+        std::lock_guard guard(pop_lock);
+        Block* old_head = free_list.load(std::memory_order_acquire);
+        while (old_head) {
+            Block* last = old_head;
+            count = 1;
+            while (count < n && last->next.load(std::memory_order_relaxed)) {
+                last = last->next.load(std::memory_order_relaxed);
+                ++count;
+            }
+            if (free_list.compare_exchange_weak(old_head, last->next.load(std::memory_order_relaxed),
+                                                std::memory_order_acquire, std::memory_order_relaxed)) {
+                last->next.store(nullptr, std::memory_order_relaxed);
+                return old_head;
+            }
+        }
+        count = 0;
+        return nullptr;
     }
 
-    //禁止拷贝和移动
-    LockFreeFixedSizePool(const LockFreeFixedSizePool&) = delete;
-    LockFreeFixedSizePool& operator=(const LockFreeFixedSizePool&) = delete;
-    LockFreeFixedSizePool(const LockFreeFixedSizePool&&) = delete;
-    LockFreeFixedSizePool& operator=(const LockFreeFixedSizePool&&) = delete;
+    // 把一串块挂回全局链表
+    void push_global(Block* first, Block* last) {
+        Block* old_head = free_list.load(std::memory_order_relaxed);
+        do {
+            last->next.store(old_head, std::memory_order_relaxed);
+        } while (!free_list.compare_exchange_weak(old_head, first, std::memory_order_release, std::memory_order_relaxed));
+    }
 
-    template<typename... Args>
-    T* allocate(Args&&... args) {
+    Block* allocate_from_cpu_cache() {
+        {
+            auto& slot = cpu_cache->local();
+            std::lock_guard<SpinLock> lock(slot.lock);
+            auto& list = slot.lists[0];
+            if (list.count == 0) {
+                list.head = pop_global(ThreadCache::BATCH_SIZE, list.count);
+            }
+            if (list.count > 0) return list.pop();
+        }
+        // 全局链表为空时在锁外切分（可能申请新 chunk），多切出的块放入本 CPU 缓存
+        uint32_t count = 0;
+        Block* block = carve_blocks(ThreadCache::BATCH_SIZE, count);
+        if (count > 1) {
+            auto& slot = cpu_cache->local();
+            std::lock_guard<SpinLock> lock(slot.lock);
+            for (Block* rest = block->next.load(std::memory_order_relaxed); rest;) {
+                Block* next = rest->next.load(std::memory_order_relaxed);
+                slot.lists[0].push(rest);
+                rest = next;
+            }
+        }
+        return block;
+    }
+
+    void deallocate_to_cpu_cache(Block* block) {
+        auto& slot = cpu_cache->local();
+        std::lock_guard<SpinLock> lock(slot.lock);
+        auto& list = slot.lists[0];
+        list.push(block);
+        if (list.count > CPU_CACHE_CAPACITY) {
+            auto [first, last] = list.take(CPU_CACHE_CAPACITY / 2);
+            push_global(first, last);
+        }
+    }
+
+    // 线程缓存按类型共享，切换到另一个内存池实例前先把缓存的块还给原来的内存池
+    // 同时比较代号：地址相同的新内存池不能沿用旧内存池留下的块
+    bool owns_local_cache() const {
+        return local_cache.pool_instance == this && local_cache.generation == lifetime.generation;
+    }
+
+    void bind_local_cache() {
+        if (!owns_local_cache()) {
+            local_cache.detach_pool();
+            local_cache.pool_instance = this;
+            local_cache.generation = lifetime.generation;
+            pool_lifetime::link(local_cache);
+        }
+    }
 
+    Block* allocate_from_thread_cache() {
+        bind_local_cache();
         if (local_cache.count == 0) {
             fill_local_cache(local_cache);
         }
@@ -192,57 +998,213 @@ public:
             block = local_cache.blocks[--local_cache.count];
         } else {
             // 本地缓存填充失败，直接从全局获取单个块
-            Block* old_block = free_list.load(std::memory_order_acquire);
-            // 先尝试从空闲列表中获取一个块
-            while(old_block) {
-                if (free_list.compare_exchange_weak(old_block, old_block->next.load())) {
-                    block = old_block;
-                    break;
-                }
-            }
+            uint32_t count = 0;
+            block = pop_global(1, count);
 
-            // 如果空闲列表为空，则分配一个新的块
+            // 如果空闲列表为空，则从 chunk 中切出一个
             if (!block) {
-                allocate_new_chunk();
-                old_block = free_list.load(std::memory_order_acquire);
-                while(old_block) {
-                    if (free_list.compare_exchange_weak(old_block, old_block->next.load())) {
-                        block = old_block;
-                        break;
-                    }
-                }
+                block = carve_blocks(1, count);
             }
         }
-       allocate_count.fetch_add(1);
-        if (block) {
-            // 构造新对象
-            return new (block->as_object()) T(std::forward<Args>(args)...);
+        return block;
+    }
+
+    // 交给用户前的检查与构造
+    template<typename... Args>
+    T* construct(Block* block, Args&&... args) {
+        MEMORYPOOL_ASAN_UNPOISON(block->data, sizeof(T));
+#if MEMORYPOOL_HARDENED
+        if (!hardening::check_fill(block->data, sizeof(T), hardening::POISON_BYTE)) {
+            report_pool_error(PoolError::UseAfterFree, block->data, sizeof(T));
         }
-        return nullptr;
+        block->canary = hardening::HEADER_CANARY;
+        block->free_flag.store(false, std::memory_order_relaxed);
+#endif
+        return new (block->as_object()) T(std::forward<Args>(args)...);
     }
 
-    void deallocate(T* ptr) {
-        if (!ptr) return;
+public:
+    explicit LockFreeFixedSizePool(const RetentionPolicy& policy = {}, PageBacking backing = PageBacking::Standard,
+                                   CacheMode mode = CacheMode::Thread)
+        : retention(policy) {
+        if (backing != PageBacking::Standard) {
+            arena = std::make_unique<HugePageArena>(backing);
+            chunks.set_arena(arena.get());
+        }
+        if (mode == CacheMode::PerCpu) {
+            if (percpu::available()) {
+                cpu_cache = std::make_unique<PerCpuCache<Block, 1>>();
+            } else {
+                LOG_WARNING("rseq is not registered, falling back to thread caches");
+            }
+        }
+        allocate_new_chunk();
+        if (retention.trim_interval.count() > 0) {
+            trimmer = std::make_unique<BackgroundTrimmer>(retention.trim_interval, [this] {
+                chunks.trim(free_list, pop_lock, retention);
+            });
+        }
+        lifetime.owner = this;
+        lifetime.prepare_fork = [](void* owner) { static_cast<LockFreeFixedSizePool*>(owner)->prepare_fork(); };
+        lifetime.after_fork = [](void* owner) { static_cast<LockFreeFixedSizePool*>(owner)->after_fork(); };
+        pool_lifetime::register_pool(lifetime);
+    }
 
-        ptr->~T();
+    ~LockFreeFixedSizePool() {
+        // 先注销：其他线程此后不再向本池归还缓存，正在归还的线程持有登记锁，注销会等它完成
+        pool_lifetime::unregister_pool(lifetime);
+        trimmer.reset();
+        // 当前线程缓存中的块随 chunk 一起释放，避免线程退出时写回已销毁的内存池
+        if (owns_local_cache()) {
+            local_cache.count = 0;
+            local_cache.pool_instance = nullptr;
+        }
+    }
 
-        /*
-            Block 结构的第一个成员就是 data 数组
-            as_object() 方法返回的是 data 数组的起始地址
-            通过 alignas(T) 确保 Block 的对齐要求满足 T 的需求
-            因此，指向 T 对象的指针实际上就是指向 Block 结构体中 data 数组的指针，而 data 数组又在 Block 的起始位置，所以可以安全地将 T 指针转回 Block 指针。
-            内存布局:
+    //禁止拷贝和移动
+    LockFreeFixedSizePool(const LockFreeFixedSizePool&) = delete;
+    LockFreeFixedSizePool& operator=(const LockFreeFixedSizePool&) = delete;
+    LockFreeFixedSizePool(const LockFreeFixedSizePool&&) = delete;
+    LockFreeFixedSizePool& operator=(const LockFreeFixedSizePool&&) = delete;
 
-            Block 对象:
-            +----------------------+
+    template<typename... Args>
+    T* allocate(Args&&... args) {
+        Block* block = nullptr;
+        if (cpu_cache) {
+            block = allocate_from_cpu_cache();
+        } else {
+            block = allocate_from_thread_cache();
+        }
+       allocate_count.fetch_add(1);
+        if (block) {
+            return construct(block, std::forward<Args>(args)...);
+        }
+        return nullptr;
+    }
+
+    // 批量分配 n 个对象（每个都以 args 构造）写入 out，返回实际分配的数量
+    // 先取本地缓存，其余一次 CAS 从全局链表整段取下
+    template<typename... Args>
+    size_t allocate_bulk(size_t n, T** out, const Args&... args) {
+        size_t filled = 0;
+        if (cpu_cache) {
+            auto& slot = cpu_cache->local();
+            std::lock_guard<SpinLock> lock(slot.lock);
+            auto& list = slot.lists[0];
+            while (filled < n && list.count > 0) out[filled++] = list.pop()->as_object();
+        } else {
+            bind_local_cache();
+            while (filled < n && local_cache.count > 0) out[filled++] = local_cache.blocks[--local_cache.count]->as_object();
+        }
+        while (filled < n) {
+            uint32_t count = 0;
+            Block* block = pop_global(n - filled, count);
+            if (!block) {
+                block = carve_blocks(n - filled, count);
+                if (!block) break;
+            }
+            for (; block; block = block->next.load(std::memory_order_relaxed)) {
+                out[filled++] = block->as_object();
+            }
+        }
+        allocate_count.fetch_add(filled, std::memory_order_relaxed);
+        for (size_t i = 0; i < filled; ++i) {
+            out[i] = construct(reinterpret_cast<Block*>(out[i]), args...);
+        }
+        return filled;
+    }
+
+    // 批量释放：析构后串成一段，补满本地缓存的一半，其余一次 CAS 归还全局链表
+    void deallocate_bulk(T* const* ptrs, size_t n) {
+#if MEMORYPOOL_HARDENED
+        // 每个块都要检查并经过隔离区
+        for (size_t i = 0; i < n; ++i) deallocate(ptrs[i]);
+#else
+        Block* first = nullptr;
+        Block* last = nullptr;
+        size_t count = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (!ptrs[i]) continue;
+            ptrs[i]->~T();
+            Block* block = reinterpret_cast<Block*>(ptrs[i]);
+            MEMORYPOOL_ASAN_POISON(block->data, sizeof(T));
+            block->next.store(first, std::memory_order_relaxed);
+            if (!last) last = block;
+            first = block;
+            ++count;
+        }
+        if (!first) return;
+
+        if (cpu_cache) {
+            auto& slot = cpu_cache->local();
+            std::lock_guard<SpinLock> lock(slot.lock);
+            auto& list = slot.lists[0];
+            while (first && list.count < CPU_CACHE_CAPACITY / 2) {
+                Block* next = first->next.load(std::memory_order_relaxed);
+                list.push(first);
+                first = next;
+            }
+        } else {
+            bind_local_cache();
+            while (first && local_cache.count < static_cast<int>(ThreadCache::BATCH_SIZE)) {
+                Block* next = first->next.load(std::memory_order_relaxed);
+                local_cache.blocks[local_cache.count++] = first;
+                first = next;
+            }
+        }
+        if (first) push_global(first, last);
+        deallocated_count.fetch_add(count, std::memory_order_relaxed);
+#endif
+    }
+
+    void deallocate(T* ptr) {
+        if (!ptr) return;
+
+#if MEMORYPOOL_HARDENED
+        // 在析构之前检查，避免重复析构
+        if (reinterpret_cast<Block*>(ptr)->free_flag.exchange(true, std::memory_order_acq_rel)) {
+            report_pool_error(PoolError::DoubleFree, ptr, sizeof(T));
+            return;
+        }
+#endif
+        ptr->~T();
+
+        /*
+            Block 结构的第一个成员就是 data 数组
+            as_object() 方法返回的是 data 数组的起始地址
+            通过 alignas(T) 确保 Block 的对齐要求满足 T 的需求
+            因此，指向 T 对象的指针实际上就是指向 Block 结构体中 data 数组的指针，而 data 数组又在 Block 的起始位置，所以可以安全地将 T 指针转回 Block 指针。
+            内存布局:
+
+            Block 对象:
+            +----------------------+
             | data[sizeof(T)]      | <-- 用户获得的 T* 指针指向这里
             +----------------------+
             | next                 |
             +----------------------+
         */
         Block* block = reinterpret_cast<Block*>(ptr);
+#if MEMORYPOOL_HARDENED
+        if (block->canary != hardening::HEADER_CANARY) {
+            report_pool_error(PoolError::BufferOverflow, ptr, sizeof(T));
+        }
+        std::memset(block->data, hardening::POISON_BYTE, sizeof(T));
+#endif
+        MEMORYPOOL_ASAN_POISON(block->data, sizeof(T));
+#if MEMORYPOOL_HARDENED
+        block = quarantine.push(block);
+        if (!block) {
+            deallocated_count.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+#endif
+        if (cpu_cache) {
+            deallocate_to_cpu_cache(block);
+            deallocated_count.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
 
-        local_cache.pool_instance = this;
+        bind_local_cache();
         // 确定本地缓存容量
         const int cache_capacity = static_cast<int>(sizeof(local_cache.blocks) / sizeof(local_cache.blocks[0]));
         
@@ -278,6 +1240,12 @@ public:
         deallocated_count.fetch_add(1, std::memory_order_relaxed);
     }
 
+    // 由本池分配的对象找到所属内存池，PoolPtr 因此只需保存对象指针
+    static LockFreeFixedSizePool* owner_of(const T* ptr) {
+        auto base = reinterpret_cast<uintptr_t>(ptr) & ~(CHUNK_ALIGNMENT - 1);
+        return reinterpret_cast<const ChunkHeader*>(base)->pool;
+    }
+
     size_t get_allocated_count() const {
         return allocate_count.load();
     }
@@ -289,24 +1257,125 @@ public:
     size_t get_active_objects() const {
         return get_allocated_count() - get_deallocated_count();
     }
+
+    // 归还当前线程缓存后回收完全空闲的 chunk，返回释放的字节数
+    size_t trim() {
+        if (owns_local_cache()) {
+            local_cache.return_thread_cache();
+        }
+        if (cpu_cache) {
+            for (size_t cpu = 0; cpu < cpu_cache->size(); ++cpu) {
+                auto& slot = (*cpu_cache)[cpu];
+                std::lock_guard<SpinLock> lock(slot.lock);
+                auto [first, last] = slot.lists[0].take(slot.lists[0].count);
+                if (first) push_global(first, last);
+            }
+        }
+#if MEMORYPOOL_HARDENED
+        quarantine.drain([this](Block* block) {
+            Block* old_head = free_list.load(std::memory_order_relaxed);
+            do {
+                block->next.store(old_head, std::memory_order_relaxed);
+            } while (!free_list.compare_exchange_weak(old_head, block, std::memory_order_release, std::memory_order_relaxed));
+        });
+#endif
+        return chunks.trim(free_list, pop_lock, retention);
+    }
+
+    // 预先申请 chunk，使已提交的块数至少为 objects，返回已提交的块数
+    // 新 chunk 按 options 预先触发缺页；lock_memory 时 mlock 所有已提交的 chunk
+    size_t reserve(size_t objects, const ReserveOptions& options = {}) {
+        while (capacity() < objects && allocate_new_chunk(&options)) {}
+        if (options.lock_memory) chunks.pin_committed();
+        return capacity();
+    }
+
+    // 从全局链表取一批块填入当前线程（PerCpu 模式下为当前 CPU）的缓存，不申请新 chunk
+    // 一般在 reserve() 之后、由即将分配的线程调用
+    void prewarm() {
+        if (cpu_cache) {
+            auto& slot = cpu_cache->local();
+            std::lock_guard<SpinLock> lock(slot.lock);
+            auto& list = slot.lists[0];
+            if (list.count >= CPU_CACHE_CAPACITY / 2) return;
+            uint32_t count = 0;
+            Block* block = pop_global(CPU_CACHE_CAPACITY / 2 - list.count, count);
+            while (block) {
+                Block* next = block->next.load(std::memory_order_relaxed);
+                list.push(block);
+                block = next;
+            }
+            return;
+        }
+        bind_local_cache();
+        int wanted = static_cast<int>(ThreadCache::BATCH_SIZE) - local_cache.count;
+        if (wanted <= 0) return;
+        uint32_t count = 0;
+        Block* block = pop_global(static_cast<size_t>(wanted), count);
+        for (; block; block = block->next.load(std::memory_order_relaxed)) {
+            local_cache.blocks[local_cache.count++] = block;
+        }
+    }
+
+    // 已提交的 chunk 可以容纳的块数
+    size_t capacity() const {
+        return chunks.committed_bytes() / CHUNK_BYTES * BLOCK_PER_CHUNK;
+    }
+
+    size_t chunk_count() const {
+        return chunks.chunk_count();
+    }
+
+    size_t committed_bytes() const {
+        return chunks.committed_bytes();
+    }
 };
 
-// RAII 智能指针包装器
-template<typename T>
+// 能由对象地址找回所属内存池的池类型
+template<typename Pool, typename T>
+concept OwnerFromAddress = requires(const T* ptr) {
+    { Pool::owner_of(ptr) } -> std::same_as<Pool*>;
+};
+
+namespace pool_ptr_detail {
+    struct NoPool {};
+}
+
+// RAII 智能指针包装器，Pool 可以是任何提供 deallocate(T*) 的池（如 ObjectPool）
+// Pool 能由对象地址找回自身时（LockFreeFixedSizePool）只保存对象指针，与 std::unique_ptr 一样大
+template<typename T, typename Pool = LockFreeFixedSizePool<T>>
 class PoolPtr {
 private:
+    static constexpr bool COMPACT = OwnerFromAddress<Pool, T>;
+
     T* ptr_;
-    LockFreeFixedSizePool<T>* pool_;
+    [[no_unique_address]] std::conditional_t<COMPACT, pool_ptr_detail::NoPool, Pool*> pool_{};
+
+    Pool* owner() const {
+        if constexpr (COMPACT) {
+            return Pool::owner_of(ptr_);
+        } else {
+            return pool_;
+        }
+    }
     
 public:
-    PoolPtr(T* p, LockFreeFixedSizePool<T>* pool) : ptr_(p), pool_(pool) {}
+    PoolPtr(T* p, Pool* pool) : ptr_(p) {
+        if constexpr (COMPACT) {
+            (void)pool;
+        } else {
+            pool_ = pool;
+        }
+    }
+
+    explicit PoolPtr(T* p) requires COMPACT : ptr_(p) {}
     
     PoolPtr(const PoolPtr&) = delete;
     PoolPtr& operator=(const PoolPtr&) = delete;
     
     PoolPtr(PoolPtr&& other) noexcept : ptr_(other.ptr_), pool_(other.pool_) {
         other.ptr_ = nullptr;
-        other.pool_ = nullptr;
+        other.pool_ = {};
     }
     
     PoolPtr& operator=(PoolPtr&& other) noexcept {
@@ -315,7 +1384,7 @@ public:
             ptr_ = other.ptr_;
             pool_ = other.pool_;
             other.ptr_ = nullptr;
-            other.pool_ = nullptr;
+            other.pool_ = {};
         }
         return *this;
     }
@@ -331,8 +1400,8 @@ public:
     explicit operator bool() const noexcept { return ptr_ != nullptr; }
     
     void reset() {
-        if (ptr_ && pool_) {
-            pool_->deallocate(ptr_);
+        if (ptr_ && owner()) {
+            owner()->deallocate(ptr_);
             ptr_ = nullptr;
         }
     }
@@ -344,34 +1413,155 @@ public:
     }
 };
 
+// 指定块大小参数的固定大小内存池指针
+template<typename T, size_t N>
+using FixedPoolPtr = PoolPtr<T, LockFreeFixedSizePool<T, N>>;
+
 // 便利的创建函数
-template<typename T>
+template<typename T, typename Pool = LockFreeFixedSizePool<T>>
 class PoolAllocator {
 private:
-    LockFreeFixedSizePool<T> pool_;
+    Pool pool_;
     
 public:
     template<typename... Args>
-    PoolPtr<T> make(Args&&... args) {
+    PoolPtr<T, Pool> make(Args&&... args) {
         T* ptr = pool_.allocate(std::forward<Args>(args)...);
-        return PoolPtr<T>(ptr, &pool_);
+        return PoolPtr<T, Pool>(ptr, &pool_);
     }
     
-    LockFreeFixedSizePool<T>& get_pool() { return pool_; }
+    Pool& get_pool() { return pool_; }
 };
 
-class LockFreeMultiSizePool {
-private:
-    static constexpr std::array<size_t, 16> SIZE_CALSSES = {  //max 2k
+// 大小类策略的公共参数，策略类可以覆盖
+struct SizeClassPolicyBase {
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;         // chunk 最小大小 64k
+    static constexpr size_t MIN_BLOCKS_PER_CHUNK = 16;      // 大尺寸类的 chunk 按 block 数放大
+};
+
+// 默认大小类，最大 2k
+struct DefaultSizeClasses : SizeClassPolicyBase {
+    static constexpr std::array<size_t, 16> CLASSES = {
         8, 16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048
     };
+};
+
+namespace size_class_detail {
+    // 生成大小类，返回数量；out 为空时只计数
+    // linear_limit 以下按 16 字节线性增长，之后每翻一倍均分为 steps 档
+    // steps 不是 2 的幂时步长除不尽，步长和上下界都向上取整到 8 字节
+    constexpr size_t generate(size_t* out, size_t min, size_t max, size_t steps, size_t linear_limit) {
+        size_t count = 0;
+        size_t size = align_of(min, 8);
+        max = align_of(max, 8);
+        while (true) {
+            if (out) out[count] = size;
+            ++count;
+            if (size >= max) break;
+            size_t step = size < linear_limit ? 16 : std::bit_floor(size) / steps;
+            size = std::min(size + align_of(std::max<size_t>(step, 8), 8), max);
+        }
+        return count;
+    }
+
+    template<size_t Min, size_t Max, size_t Steps, size_t LinearLimit>
+    constexpr auto make_classes() {
+        std::array<size_t, generate(nullptr, Min, Max, Steps, LinearLimit)> classes{};
+        generate(classes.data(), Min, Max, Steps, LinearLimit);
+        return classes;
+    }
+}
+
+// 几何间隔：从 Min 开始，每翻一倍均分为 StepsPerDoubling 档
+template<size_t Min = 16, size_t Max = 8192, size_t StepsPerDoubling = 4>
+struct GeometricSizeClasses : SizeClassPolicyBase {
+    static constexpr auto CLASSES = size_class_detail::make_classes<Min, Max, StepsPerDoubling, 0>();
+};
+
+// jemalloc 风格：8 字节起步，128 字节以内按 16 字节递增，之后每翻一倍分 4 档
+template<size_t Max = 16 * 1024>
+struct JemallocSizeClasses : SizeClassPolicyBase {
+    static constexpr auto CLASSES = size_class_detail::make_classes<8, Max, 4, 128>();
+};
+
+// 用户自定义的大小类表，需要升序且为 8 的倍数
+template<size_t... Sizes>
+struct CustomSizeClasses : SizeClassPolicyBase {
+    static constexpr std::array<size_t, sizeof...(Sizes)> CLASSES = {Sizes...};
+};
+
+// 编译期生成的 size -> 大小类下标映射表，按 8 字节粒度 O(1) 查表
+template<typename Policy>
+struct SizeClassMap {
+    static constexpr const auto& CLASSES = Policy::CLASSES;
+    static constexpr size_t COUNT = CLASSES.size();
+    static constexpr size_t GRANULE = 8;
+    static constexpr size_t MAX_SIZE = CLASSES[COUNT - 1];
+
+    static constexpr bool valid() {
+        for (size_t i = 0; i < COUNT; ++i) {
+            if (CLASSES[i] == 0 || CLASSES[i] % GRANULE != 0) return false;
+            if (i > 0 && CLASSES[i] <= CLASSES[i - 1]) return false;
+        }
+        return true;
+    }
+    static_assert(COUNT > 0 && COUNT < 256, "size class count must fit in uint8_t");
+    static_assert(valid(), "size classes must be ascending multiples of 8");
+
+    static constexpr auto LOOKUP = [] {
+        std::array<uint8_t, MAX_SIZE / GRANULE + 1> table{};
+        size_t index = 0;
+        for (size_t i = 0; i < table.size(); ++i) {
+            while (CLASSES[index] < i * GRANULE) ++index;
+            table[i] = static_cast<uint8_t>(index);
+        }
+        return table;
+    }();
+
+    // 超过最大大小类时返回 COUNT
+    static constexpr size_t index(size_t size) {
+        return size <= MAX_SIZE ? LOOKUP[(size + GRANULE - 1) / GRANULE] : COUNT;
+    }
+};
+
+// 统计计数的分片数量，线程按首次使用的顺序轮流分配到各个分片
+constexpr size_t STAT_SHARDS = 16;
+
+inline size_t stat_shard_index() {
+    static std::atomic<size_t> next_shard{0};
+    static thread_local size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed) % STAT_SHARDS;
+    return shard;
+}
+
+template<typename Policy = DefaultSizeClasses>
+class BasicMultiSizePool {
+private:
+    static constexpr const auto& SIZE_CLASSES = Policy::CLASSES;
 
     // 内存结构： FreeBlock + data
-    struct FreeBlock {
-        size_t size;
+    // 头部按 max_align_t 对齐，保证 data 满足 ALIGNMENT
+    struct alignas(std::max_align_t) FreeBlock {
         std::atomic<FreeBlock*> next;
+        uint32_t size;
+#if MEMORYPOOL_HARDENED
+        std::atomic<bool> free_flag;
+        uint32_t requested;         // 用户申请的字节数，之后到 redzone 末尾填充金丝雀
+        uint64_t canary;            // 紧挨 data，检测向前越界
+#else
         bool free_flag;
-        FreeBlock(size_t s):size(s), next(nullptr), free_flag(false) {}
+#endif
+        FreeBlock(size_t s):next(nullptr), size(static_cast<uint32_t>(s)), free_flag(false) {}
+
+        // 标记为空闲，已经空闲时返回 false
+        bool mark_free() {
+#if MEMORYPOOL_HARDENED
+            return !free_flag.exchange(true, std::memory_order_acq_rel);
+#else
+            if (free_flag) return false;
+            free_flag = true;
+            return true;
+#endif
+        }
 
         void* data() { // 指向data 数据
             return reinterpret_cast<std::byte*>(this) + sizeof(FreeBlock);
@@ -384,8 +1574,8 @@ private:
 
     struct ChunkClass {
         std::atomic<FreeBlock*> free_list;
-        std::atomic<size_t> allocated_count;
-        std::atomic<size_t> deallocated_count;
+        // 取块与 trim 摘链表串行，遍历链表时读到的 next 不会因 ABA 被错误地装回链表头；归还仍是无锁的
+        SpinLock pop_lock;
 
         size_t block_size;  // 每个block size
         size_t total_block_size; // 一个block + data的大小
@@ -395,79 +1585,1102 @@ private:
         explicit ChunkClass(size_t size):
             free_list(nullptr),
             block_size(size),
-            total_block_size(align_of(sizeof(FreeBlock) + size, ALIGNMENT)),
-            block_count(CHUNK_SIZE / total_block_size)
+            total_block_size(align_of(sizeof(FreeBlock) + size + REDZONE, ALIGNMENT)),
+            block_count(chunk_size_for(total_block_size) / total_block_size)
             {}
     };
 
-    struct MultiSizeThreadCache {
+    struct MultiSizeThreadCache : pool_lifetime::ThreadCacheHook {
+        // 空闲块通过自身的 next 指针串成链表，长度上限按大小类自适应调整
         struct ClassCache {
-            FreeBlock* blocks[32]; // 每个大小类缓存块
-            int count;  // 当前缓存的数量
+            FreeBlock* head;
+            uint32_t count;         // 当前缓存的数量
+            uint32_t max_count;     // 当前上限，从 0 开始慢启动
+            uint32_t low_water;     // 上次回收以来的最小长度，持续大于 0 说明这些块一直闲置
+            uint32_t overflows;     // 超过上限的次数
         };
-        ClassCache caches[SIZE_CALSSES.size()];
-        LockFreeMultiSizePool* pool_ptr; // 指向全局内存池
+        ClassCache caches[SIZE_CLASSES.size()];
+        BasicMultiSizePool* pool_ptr; // 指向全局内存池
+        uint64_t generation; // 绑定时内存池的代号
+        bool exited; // 线程退出后不再使用缓存，避免块滞留在即将回收的 TLS 中
+        bool counted; // 是否已计入 cache_threads
+        size_t bytes; // 本线程缓存的总字节数
+        size_t limit; // 本线程缓存的字节上限，由全局预算按线程数平分
+        uint32_t slow_ops; // 慢路径次数，每 SCAVENGE_PERIOD 次回收一次闲置缓存
 
         ~MultiSizeThreadCache() {
+            pool_lifetime::unlink(*this);
+            detach_pool();
+            if (counted) cache_threads.fetch_sub(1, std::memory_order_relaxed);
+            counted = false;
+            exited = true;
+        }
 
-            if (!pool_ptr) return; 
-            // 遍历所有大小类
-            for (size_t index = 0; index < SIZE_CALSSES.size(); ++index) {
-                auto& class_cache = caches[index];
-                if (class_cache.count == 0) continue;
-                
-                // 将块连接成链表
-                for (int i = 0; i < class_cache.count - 1; ++i) {
-                    class_cache.blocks[i]->next.store(class_cache.blocks[i + 1], std::memory_order_relaxed);
-                }
-                
-                auto& chunk_class = pool_ptr->chunk_classes[index];
-                FreeBlock* old_head = chunk_class.free_list.load(std::memory_order_relaxed);
-                FreeBlock* cache_head = class_cache.blocks[0];
-                FreeBlock* cache_tail = class_cache.blocks[class_cache.count - 1];
-                
-                // 归还到全局链表
-                do {
-                    cache_tail->next.store(old_head, std::memory_order_relaxed);
-                } while (!chunk_class.free_list.compare_exchange_weak(old_head, cache_head, 
-                                                                    std::memory_order_release, 
-                                                                    std::memory_order_relaxed));
-                class_cache.count = 0;
+        static void detach_hook(pool_lifetime::ThreadCacheHook* hook) {
+            static_cast<MultiSizeThreadCache*>(hook)->detach_pool();
+        }
+
+        // 解除绑定：内存池仍然存活时归还缓存，已经析构时缓存的块随它的 chunk 一起释放了，直接丢弃
+        // 自适应的上限保留，重新绑定后不必再次慢启动
+        void detach_pool() {
+            if (pool_ptr && bytes > 0) {
+                auto lock = pool_lifetime::lock_if_alive(generation);
+                if (lock.owns_lock()) flush();
+            }
+            for (auto& cache : caches) {
+                cache.head = nullptr;
+                cache.count = 0;
+                cache.low_water = 0;
             }
+            bytes = 0;
+            pool_ptr = nullptr;
         }
 
+        FreeBlock* pop(size_t index) {
+            auto& cache = caches[index];
+            FreeBlock* block = cache.head;
+            cache.head = block->next.load(std::memory_order_relaxed);
+            if (--cache.count < cache.low_water) cache.low_water = cache.count;
+            bytes -= SIZE_CLASSES[index];
+            return block;
+        }
+
+        void push(size_t index, FreeBlock* block) {
+            auto& cache = caches[index];
+            block->next.store(cache.head, std::memory_order_relaxed);
+            cache.head = block;
+            ++cache.count;
+            bytes += SIZE_CLASSES[index];
+        }
+
+        // 把链表头部的 n 个块一次性归还全局链表
+        void release(size_t index, uint32_t n) {
+            auto& cache = caches[index];
+            n = std::min(n, cache.count);
+            if (n == 0 || !pool_ptr) return;
+
+            FreeBlock* first = cache.head;
+            FreeBlock* last = first;
+            for (uint32_t i = 1; i < n; ++i) {
+                last = last->next.load(std::memory_order_relaxed);
+            }
+            cache.head = last->next.load(std::memory_order_relaxed);
+            cache.count -= n;
+            cache.low_water = std::min(cache.low_water, cache.count);
+            bytes -= n * SIZE_CLASSES[index];
+
+            auto& free_list = pool_ptr->chunk_classes[index].free_list;
+            FreeBlock* old_head = free_list.load(std::memory_order_relaxed);
+            do {
+                last->next.store(old_head, std::memory_order_relaxed);
+            } while (!free_list.compare_exchange_weak(old_head, first, std::memory_order_release, std::memory_order_relaxed));
+            MEMORYPOOL_STAT(bump(pool_ptr->local_shard().classes[index].releases));
+        }
+
+        // 将所有大小类的缓存归还全局链表
+        void flush() {
+            for (size_t index = 0; index < SIZE_CLASSES.size(); ++index) {
+                release(index, caches[index].count);
+            }
+        }
     };
 
-    std::array<ChunkClass, SIZE_CALSSES.size()> chunk_classes;
-    LockFreeStack<std::unique_ptr<std::byte[]>> allocated_chunks;
+    std::array<ChunkClass, SIZE_CLASSES.size()> chunk_classes;
+    std::unique_ptr<HugePageArena> arena;
+    std::array<ChunkRegistry, SIZE_CLASSES.size()> allocated_chunks;
+    RetentionPolicy retention;
+    std::unique_ptr<BackgroundTrimmer> trimmer;
 
     static constexpr size_t ALIGNMENT = alignof(std::max_align_t);
-    static constexpr size_t CHUNK_SIZE = 64 * 1024; // 64k
+#if MEMORYPOOL_HARDENED
+    static constexpr size_t REDZONE = hardening::REDZONE;
+    std::array<hardening::Quarantine<FreeBlock>, SIZE_CLASSES.size()> quarantine;
+#else
+    static constexpr size_t REDZONE = 0;
+#endif
+
+    // 交给用户前的检查与标记，非加固模式下只清除空闲标记
+    static void* hand_out(FreeBlock* block, size_t size);
+
+    // chunk 大小随大小类增长，至少容纳 MIN_BLOCKS_PER_CHUNK 个 block
+    static constexpr size_t chunk_size_for(size_t total_block_size) {
+        return std::max(Policy::CHUNK_SIZE, align_of(total_block_size * Policy::MIN_BLOCKS_PER_CHUNK, 4096));
+    }
+
+#if MEMORYPOOL_STATS
+    // 计数按线程分片，每个分片独占缓存行，热路径上不再争用同一个计数器，读取时合并
+    struct alignas(CACHE_LINE_SIZE) StatShard {
+        struct ClassCounters {
+            std::atomic<uint64_t> allocations;
+            std::atomic<uint64_t> deallocations;
+            std::atomic<uint64_t> cache_hits;   // 直接从线程缓存取得
+            std::atomic<uint64_t> refills;      // 从全局链表批量填充线程缓存
+            std::atomic<uint64_t> releases;     // 线程缓存批量归还全局链表
+        };
+        ClassCounters classes[SIZE_CLASSES.size()];
+        std::atomic<uint64_t> large_allocations;
+        std::atomic<uint64_t> large_deallocations;
+        std::atomic<int64_t> large_bytes;
+    };
+    std::array<StatShard, STAT_SHARDS> stat_shards{};
+
+    StatShard& local_shard() { return stat_shards[stat_shard_index()]; }
+
+    static void bump(std::atomic<uint64_t>& counter, uint64_t n = 1) { counter.fetch_add(n, std::memory_order_relaxed); }
+#endif
+
+    // 线程缓存的自适应参数（参考 tcmalloc 的慢启动）
+    static constexpr uint32_t CACHE_BATCH = 16;                 // 与全局链表之间一次转移的块数
+    static constexpr uint32_t MAX_CACHE_OVERFLOWS = 3;          // 连续超限这么多次后缩小上限
+    static constexpr uint32_t SCAVENGE_PERIOD = 1024;           // 每多少次慢路径回收一次闲置缓存
+    static constexpr size_t MAX_CLASS_CACHE_BYTES = 256 * 1024; // 单个大小类缓存的字节上限
+    static constexpr size_t MIN_THREAD_CACHE_BYTES = 64 * 1024; // 线程数很多时每个线程至少可以缓存的字节数
+
+    static constexpr uint32_t max_cache_count(size_t index) {
+        return static_cast<uint32_t>(std::clamp<size_t>(MAX_CLASS_CACHE_BYTES / SIZE_CLASSES[index], CACHE_BATCH, 1024));
+    }
 
     static inline thread_local MultiSizeThreadCache thread_cache;
-    size_t get_size_class_index(size_t size);
-    void allocate_chunk_for_size_class(size_t index);
+    static inline std::atomic<size_t> cache_threads{0};   // 使用线程缓存的线程数，用于平分预算
+    // CacheMode::PerCpu 时创建，之后不再使用线程缓存
+    std::unique_ptr<PerCpuCache<FreeBlock, SIZE_CLASSES.size()>> cpu_cache;
+    pool_lifetime::Registration lifetime;
+
+    // 由 pool_lifetime 的 fork 处理函数调用：fork 前持有本池的全部锁，加锁顺序与分配路径一致
+    void prepare_fork();
+    void after_fork();
+
+    // 线程缓存按 Policy 类型共享，绑定的内存池和代号都相同才属于本池
+    bool owns_thread_cache() const {
+        return thread_cache.pool_ptr == this && thread_cache.generation == lifetime.generation;
+    }
+    void bind_thread_cache() {
+        if (!owns_thread_cache()) rebind_thread_cache();
+    }
+    // 缓存还给原来的内存池（已析构则丢弃）后绑定到本池
+    void rebind_thread_cache();
+
+    // 按需增长时新 chunk 只设置切分游标；warm 非空时由 reserve() 调用，预先触发缺页后整个 chunk 串入空闲链表
+    bool allocate_chunk_for_size_class(size_t index, const ReserveOptions* warm = nullptr);
+    // 初始化 chunk 中 [first, first + count) 号块，串成以 nullptr 结尾的链表
+    FreeBlock* init_blocks(size_t index, ChunkRecord* chunk, size_t first, size_t count);
+    // 从切分中的 chunk 取最多 n 个从未使用过的块，用尽时申请新 chunk；返回以 nullptr 结尾的链表
+    FreeBlock* carve_chain(size_t index, size_t n, uint32_t& count);
+    size_t class_capacity(size_t index) const;
     bool fill_class_cache(size_t index);
+    void list_too_long(size_t index);
+    void on_slow_path();
+    void scavenge();
+    void* allocate_from_cpu_cache(size_t index, size_t size);
+    void deallocate_to_cpu_cache(size_t index, FreeBlock* block);
+    void flush_cpu_caches();
+    // 一次 CAS 从全局链表取下最多 n 个块，返回以 nullptr 结尾的链表，count 为实际数量
+    FreeBlock* pop_chain(size_t index, size_t n, uint32_t& count);
+    // 把 first..last 一段块一次 CAS 挂回全局链表
+    void push_chain(size_t index, FreeBlock* first, FreeBlock* last);
 
 public:
-    LockFreeMultiSizePool();
-    LockFreeMultiSizePool(const LockFreeMultiSizePool&) = delete;
-    LockFreeMultiSizePool& operator=(const LockFreeMultiSizePool&) = delete;
-    LockFreeMultiSizePool(const LockFreeMultiSizePool&&) = delete;
-    LockFreeMultiSizePool& operator=(const LockFreeMultiSizePool&&) = delete;
+    explicit BasicMultiSizePool(const RetentionPolicy& policy = {}, PageBacking backing = PageBacking::Standard,
+                                CacheMode mode = CacheMode::Thread);
+    ~BasicMultiSizePool();
+    BasicMultiSizePool(const BasicMultiSizePool&) = delete;
+    BasicMultiSizePool& operator=(const BasicMultiSizePool&) = delete;
+    BasicMultiSizePool(const BasicMultiSizePool&&) = delete;
+    BasicMultiSizePool& operator=(const BasicMultiSizePool&&) = delete;
+
+    struct ClassStats {
+        size_t block_size;
+        uint64_t allocations;
+        uint64_t deallocations;
+        uint64_t cache_hits;
+        uint64_t refills;
+        uint64_t releases;
+        size_t chunks;
+        size_t bytes_in_use;        // 按块大小计算的在用字节数
+        size_t bytes_reserved;      // 已提交给该大小类的字节数
+        double fragmentation;       // 已提交但未被使用的比例
+    };
+
+    struct Stats {
+        std::array<ClassStats, SIZE_CLASSES.size()> classes;
+        uint64_t allocations;       // 包含大对象
+        uint64_t deallocations;
+        uint64_t large_allocations;
+        uint64_t large_deallocations;
+        size_t large_bytes_in_use;
+        size_t bytes_in_use;        // 包含大对象
+        size_t bytes_reserved;      // 大小类已提交的字节数，大对象见 PageHeap::stats()
+        size_t chunks;
+        double cache_hit_rate;
+        double fragmentation;
+    };
+
+    // 能够从大小类中分配的最大尺寸，更大的请求交给 PageHeap
+    static constexpr size_t max_class_size() { return SIZE_CLASSES[SIZE_CLASSES.size() - 1]; }
 
     void* allocate(size_t size);
 
     void deallocate(void* ptr, size_t size);
 
+    // 超过 ALIGNMENT 的对齐要求：多申请 alignment 字节，并在对齐地址前保存原始指针
+    void* allocate(size_t size, size_t alignment);
+
+    void deallocate(void* ptr, size_t size, size_t alignment);
+
+    // 批量分配 n 个 size 字节的块写入 out，返回实际分配的数量
+    // 先取本地缓存，其余一次 CAS 从全局链表整段取下
+    size_t allocate_bulk(size_t size, size_t n, void** out);
+
+    // 批量释放同一大小的 n 个块：补满本地缓存，其余串成一段一次 CAS 归还全局链表
+    void deallocate_bulk(void* const* ptrs, size_t n, size_t size);
+
+    // 为 size 所在的大小类预先申请 chunk，使该类已提交的块数至少为 count，返回该类已提交的块数
+    // 新 chunk 按 options 预先触发缺页；lock_memory 时 mlock 该类所有已提交的 chunk；大对象不预留，返回 0
+    size_t reserve(size_t size, size_t count, const ReserveOptions& options = {});
+
+    // 每个大小类预留 bytes_per_class 字节
+    void reserve_bytes(size_t bytes_per_class, const ReserveOptions& options = {});
+
+    // 每个大小类从全局链表取最多一批块填入当前线程（PerCpu 模式下为当前 CPU）的缓存，不申请新 chunk
+    // 一般在 reserve() 之后、由即将分配的线程调用
+    void prewarm();
+
+    // 合并各分片得到的快照，MEMORYPOOL_STATS 关闭时计数项为 0
+    Stats stats() const;
+
     void print_stats() const;
 
+    // 归还当前线程缓存后回收完全空闲的 chunk，返回释放的字节数
+    size_t trim();
+
+    // 把当前线程缓存的块全部归还全局链表，适合线程即将长时间空闲时调用
+    void flush_thread_cache();
+
+    // 当前线程缓存的字节数
+    size_t thread_cache_bytes() const;
+
+    // 实际使用的缓存方式，请求 PerCpu 但 rseq 不可用时为 Thread
+    CacheMode cache_mode() const { return cpu_cache ? CacheMode::PerCpu : CacheMode::Thread; }
+
+    // 所有 CPU 缓存中的字节数，线程缓存模式下为 0
+    size_t cpu_cache_bytes();
+
+    size_t chunk_count() const;
+
+    size_t committed_bytes() const;
+
+    // 归还当前线程缓存（所属内存池已析构时丢弃）后恢复初始状态
     static void reset_global_state() {
+        thread_cache.detach_pool();
+        pool_lifetime::unlink(thread_cache);
+        if (thread_cache.counted) cache_threads.fetch_sub(1, std::memory_order_relaxed);
         MultiSizeThreadCache empty_cache{};
         thread_cache = empty_cache;
     }
 };
 
+template<typename Policy>
+BasicMultiSizePool<Policy>::BasicMultiSizePool(const RetentionPolicy& policy, PageBacking backing, CacheMode mode): retention(policy) {
+    for (size_t i = 0; i < SIZE_CLASSES.size(); ++i) {
+        new (&chunk_classes[i]) ChunkClass(SIZE_CLASSES[i]);
+    }
+    // 所有大小类共享同一个大页 arena
+    if (backing != PageBacking::Standard) {
+        arena = std::make_unique<HugePageArena>(backing);
+        for (auto& chunks : allocated_chunks) {
+            chunks.set_arena(arena.get());
+        }
+    }
+    if (mode == CacheMode::PerCpu) {
+        if (percpu::available()) {
+            cpu_cache = std::make_unique<PerCpuCache<FreeBlock, SIZE_CLASSES.size()>>();
+        } else {
+            LOG_WARNING("rseq is not registered, falling back to thread caches");
+        }
+    }
+    if (retention.trim_interval.count() > 0) {
+        trimmer = std::make_unique<BackgroundTrimmer>(retention.trim_interval, [this] {
+            for (size_t i = 0; i < SIZE_CLASSES.size(); ++i) {
+                allocated_chunks[i].trim(chunk_classes[i].free_list, chunk_classes[i].pop_lock, retention);
+            }
+        });
+    }
+    lifetime.owner = this;
+    lifetime.prepare_fork = [](void* owner) { static_cast<BasicMultiSizePool*>(owner)->prepare_fork(); };
+    lifetime.after_fork = [](void* owner) { static_cast<BasicMultiSizePool*>(owner)->after_fork(); };
+    pool_lifetime::register_pool(lifetime);
+    if (!cpu_cache) {
+        bind_thread_cache();
+    }
+}
+
+template<typename Policy>
+BasicMultiSizePool<Policy>::~BasicMultiSizePool() {
+    // 先注销：其他线程此后不再向本池归还缓存，正在归还的线程持有登记锁，注销会等它完成
+    pool_lifetime::unregister_pool(lifetime);
+    trimmer.reset();
+    // 当前线程缓存中的块随 chunk 一起释放，避免线程退出时写回已销毁的内存池
+    if (owns_thread_cache()) {
+        reset_global_state();
+    }
+}
+
+template<typename Policy>
+void BasicMultiSizePool<Policy>::rebind_thread_cache() {
+    thread_cache.detach_pool();
+    thread_cache.pool_ptr = this;
+    thread_cache.generation = lifetime.generation;
+    // 线程退出阶段 TLS 已经析构，不再挂入 thread_detach 的链表
+    if (!thread_cache.exited) {
+        thread_cache.detach = &MultiSizeThreadCache::detach_hook;
+        pool_lifetime::link(thread_cache);
+    }
+}
+
+template<typename Policy>
+bool BasicMultiSizePool<Policy>::fill_class_cache(size_t index) {
+    if (index >= SIZE_CLASSES.size()) return false;
+
+    auto& class_cache = thread_cache.caches[index];
+
+    // 已经有缓存，不需要填充
+    if (class_cache.count > 0) return true;
+
+    // 慢启动：上限不足一批时逐个增加，之后每次未命中增加一批，直到该类的最大值
+    if (class_cache.max_count < CACHE_BATCH) {
+        ++class_cache.max_count;
+    } else if (class_cache.max_count < max_cache_count(index)) {
+        class_cache.max_count = std::min(class_cache.max_count + CACHE_BATCH, max_cache_count(index));
+    }
+    on_slow_path();
+    uint32_t batch = std::min(class_cache.max_count, CACHE_BATCH);
+
+    // 尝试从全局链表获取多个块，链表为空时从 chunk 中切出新的块；取下的一串块直接作为本地缓存链表
+    uint32_t count = 0;
+    FreeBlock* head = pop_chain(index, batch, count);
+    if (!head) head = carve_chain(index, batch, count);
+    if (!head) return false;
+    class_cache.head = head;
+    class_cache.count = count;
+    thread_cache.bytes += count * SIZE_CLASSES[index];
+    MEMORYPOOL_STAT(bump(local_shard().classes[index].refills));
+
+    return true;
+}
+
+// 释放使缓存超过上限：归还一批，并根据超限次数调整上限
+template<typename Policy>
+void BasicMultiSizePool<Policy>::list_too_long(size_t index) {
+    auto& class_cache = thread_cache.caches[index];
+    thread_cache.release(index, CACHE_BATCH);
+    if (class_cache.max_count < CACHE_BATCH) {
+        ++class_cache.max_count;
+    } else if (class_cache.max_count > CACHE_BATCH && ++class_cache.overflows > MAX_CACHE_OVERFLOWS) {
+        class_cache.max_count -= CACHE_BATCH;
+        class_cache.overflows = 0;
+    }
+    on_slow_path();
+}
+
+template<typename Policy>
+void BasicMultiSizePool<Policy>::on_slow_path() {
+    if (!thread_cache.counted) {
+        thread_cache.counted = true;
+        cache_threads.fetch_add(1, std::memory_order_relaxed);
+    }
+    size_t threads = std::max<size_t>(cache_threads.load(std::memory_order_relaxed), 1);
+    thread_cache.limit = std::max(MIN_THREAD_CACHE_BYTES, retention.thread_cache_budget / threads);
+    if (++thread_cache.slow_ops >= SCAVENGE_PERIOD) {
+        scavenge();
+    }
+}
+
+// 回收闲置缓存：自上次回收以来一直没有用到的块归还一半，并缩小上限；仍超出预算时每类再归还一半
+template<typename Policy>
+void BasicMultiSizePool<Policy>::scavenge() {
+    thread_cache.slow_ops = 0;
+    for (size_t index = 0; index < SIZE_CLASSES.size(); ++index) {
+        auto& class_cache = thread_cache.caches[index];
+        if (class_cache.low_water > 0) {
+            thread_cache.release(index, std::max<uint32_t>(class_cache.low_water / 2, 1));
+            if (class_cache.max_count > CACHE_BATCH) {
+                class_cache.max_count = std::max(class_cache.max_count - CACHE_BATCH, CACHE_BATCH);
+            }
+        }
+        class_cache.low_water = class_cache.count;
+    }
+    for (size_t index = 0; index < SIZE_CLASSES.size() && thread_cache.bytes > thread_cache.limit; ++index) {
+        thread_cache.release(index, (thread_cache.caches[index].count + 1) / 2);
+    }
+}
+
+template<typename Policy>
+void* BasicMultiSizePool<Policy>::hand_out(FreeBlock* block, size_t size) {
+    block->free_flag = false;
+    std::byte* data = static_cast<std::byte*>(block->data());
+    MEMORYPOOL_ASAN_UNPOISON(data, block->size + REDZONE);
+#if MEMORYPOOL_HARDENED
+    if (!hardening::check_fill(data, block->size + REDZONE, hardening::POISON_BYTE)) {
+        report_pool_error(PoolError::UseAfterFree, data, block->size);
+    }
+    block->requested = static_cast<uint32_t>(size);
+    block->canary = hardening::HEADER_CANARY;
+    std::memset(data + size, hardening::CANARY_BYTE, block->size + REDZONE - size);
+#endif
+    // 用户数据之后的空隙保持不可访问
+    MEMORYPOOL_ASAN_POISON(data + size, block->size + REDZONE - size);
+    return data;
+}
+
+template<typename Policy>
+void* BasicMultiSizePool<Policy>::allocate(size_t size) {
+    if (size == 0) return nullptr;
+
+#if MEMORYPOOL_PROFILING
+    HeapProfiler::on_allocate(size);
+#endif
+    size_t index = SizeClassMap<Policy>::index(size);
+    if (index >= SIZE_CLASSES.size()) {  // 分配大对象
+#if MEMORYPOOL_STATS
+        auto& shard = local_shard();
+        bump(shard.large_allocations);
+        shard.large_bytes.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed);
+#endif
+        return PageHeap::instance().allocate(size);
+    }
+    if (cpu_cache) {
+        return allocate_from_cpu_cache(index, size);
+    }
+
+    bind_thread_cache(); // 设置当前线程的内存池实例
+
+    // 尝试从本地缓存分配
+    auto& class_cache = thread_cache.caches[index];
+    if (class_cache.count > 0) {
+        FreeBlock* block = thread_cache.pop(index);
+#if MEMORYPOOL_STATS
+        auto& counters = local_shard().classes[index];
+        bump(counters.allocations);
+        bump(counters.cache_hits);
+#endif
+        return hand_out(block, size); // 返回数据指针
+    }
+    // 尝试批量获取块到本地缓存
+    if (!thread_cache.exited && fill_class_cache(index)) {
+        FreeBlock* block = thread_cache.pop(index);
+        MEMORYPOOL_STAT(bump(local_shard().classes[index].allocations));
+        return hand_out(block, size); // 返回数据指针
+    }
+
+    // 尝试从空闲列表获取，再从 chunk 中切出
+    uint32_t count = 0;
+    FreeBlock* block = pop_chain(index, 1, count);
+    if (!block) {
+        block = carve_chain(index, 1, count);
+    }
+
+    if(block) {
+        MEMORYPOOL_STAT(bump(local_shard().classes[index].allocations));
+        return hand_out(block, size); // 返回数据指针
+    }
+    return nullptr;
+}
+
+template<typename Policy>
+void BasicMultiSizePool<Policy>::deallocate(void* ptr, size_t size) {
+    if (ptr == nullptr) return;
+
+    size_t index = SizeClassMap<Policy>::index(size);
+    if (index >= SIZE_CLASSES.size()) {
+#if MEMORYPOOL_STATS
+        auto& shard = local_shard();
+        bump(shard.large_deallocations);
+        shard.large_bytes.fetch_sub(static_cast<int64_t>(size), std::memory_order_relaxed);
+#endif
+        PageHeap::instance().deallocate(ptr, size);  // 大对象归还页堆
+        return;
+    }
+
+    ChunkClass& chunk_class = chunk_classes[index];
+    FreeBlock* block_ptr = FreeBlock::from_data(ptr);  // 获取block
+    
+    //LOG_INFO("free detected, ptr:{}, size:{}", ptr, size);
+    if (!block_ptr->mark_free()) {
+        report_pool_error(PoolError::DoubleFree, ptr, size);
+        return;
+    }
+    MEMORYPOOL_ASAN_UNPOISON(ptr, block_ptr->size + REDZONE);
+#if MEMORYPOOL_HARDENED
+    if (block_ptr->canary != hardening::HEADER_CANARY
+        || !hardening::check_fill(static_cast<std::byte*>(ptr) + block_ptr->requested, block_ptr->size + REDZONE - block_ptr->requested, hardening::CANARY_BYTE)) {
+        report_pool_error(PoolError::BufferOverflow, ptr, size);
+    }
+    std::memset(ptr, hardening::POISON_BYTE, block_ptr->size + REDZONE);
+#endif
+    MEMORYPOOL_ASAN_POISON(ptr, block_ptr->size + REDZONE);
+#if MEMORYPOOL_HARDENED
+    // 隔离区满时取出最早的块继续走正常的释放路径
+    block_ptr = quarantine[index].push(block_ptr);
+    if (!block_ptr) {
+        MEMORYPOOL_STAT(bump(local_shard().classes[index].deallocations));
+        return;
+    }
+#endif
+    if (cpu_cache) {
+        deallocate_to_cpu_cache(index, block_ptr);
+        return;
+    }
+
+    bind_thread_cache(); // 设置当前线程的内存池实例
+    // 线程退出阶段直接归还全局链表
+    if (thread_cache.exited) {
+        FreeBlock* old_block = chunk_class.free_list.load(std::memory_order_relaxed);
+        do {
+            block_ptr->next.store(old_block, std::memory_order_relaxed);
+        } while (!chunk_class.free_list.compare_exchange_weak(old_block, block_ptr, std::memory_order_release, std::memory_order_relaxed));
+        MEMORYPOOL_STAT(bump(local_shard().classes[index].deallocations));
+        return;
+    }
+    // 先放入本地缓存，超过该类上限或线程预算时批量归还
+    thread_cache.push(index, block_ptr);
+    if (thread_cache.caches[index].count > thread_cache.caches[index].max_count) {
+        list_too_long(index);
+    } else if (thread_cache.bytes > thread_cache.limit) {
+        scavenge();
+    }
+    MEMORYPOOL_STAT(bump(local_shard().classes[index].deallocations));
+}
+
+template<typename Policy>
+void* BasicMultiSizePool<Policy>::allocate(size_t size, size_t alignment) {
+    if (alignment <= ALIGNMENT) return allocate(size);
+
+    // 池中地址按 ALIGNMENT 对齐，对齐后的地址与原始地址至少相差 ALIGNMENT，足够存放原始指针
+    auto* raw = static_cast<std::byte*>(allocate(size + alignment));
+    if (!raw) return nullptr;
+    auto addr = reinterpret_cast<uintptr_t>(raw) + 1;
+    auto* aligned = reinterpret_cast<std::byte*>(align_of(addr, alignment));
+    reinterpret_cast<void**>(aligned)[-1] = raw;
+    return aligned;
+}
+
+template<typename Policy>
+void BasicMultiSizePool<Policy>::deallocate(void* ptr, size_t size, size_t alignment) {
+    if (alignment <= ALIGNMENT) {
+        deallocate(ptr, size);
+        return;
+    }
+    if (ptr == nullptr) return;
+    deallocate(reinterpret_cast<void**>(ptr)[-1], size + alignment);
+}
+
+template<typename Policy>
+size_t BasicMultiSizePool<Policy>::allocate_bulk(size_t size, size_t n, void** out) {
+    if (size == 0 || n == 0) return 0;
+
+    size_t index = SizeClassMap<Policy>::index(size);
+    if (index >= SIZE_CLASSES.size()) {
+        size_t filled = 0;
+        while (filled < n && (out[filled] = allocate(size))) ++filled;
+        return filled;
+    }
+#if MEMORYPOOL_PROFILING
+    HeapProfiler::on_allocate(size * n);
+#endif
+
+    // 取出的 FreeBlock 先暂存在 out 中，最后统一交给用户
+    size_t filled = 0;
+    if (cpu_cache) {
+        auto& slot = cpu_cache->local();
+        std::lock_guard<SpinLock> lock(slot.lock);
+        auto& list = slot.lists[index];
+        while (filled < n && list.count > 0) out[filled++] = list.pop();
+    } else {
+        bind_thread_cache();
+        while (filled < n && thread_cache.caches[index].count > 0) out[filled++] = thread_cache.pop(index);
+    }
+    size_t hits = filled;
+    while (filled < n) {
+        uint32_t count = 0;
+        FreeBlock* block = pop_chain(index, n - filled, count);
+        if (!block) {
+            block = carve_chain(index, n - filled, count);
+            if (!block) break;
+        }
+        for (; block; block = block->next.load(std::memory_order_relaxed)) {
+            out[filled++] = block;
+        }
+    }
+    for (size_t i = 0; i < filled; ++i) {
+        out[i] = hand_out(static_cast<FreeBlock*>(out[i]), size);
+    }
+#if MEMORYPOOL_STATS
+    auto& counters = local_shard().classes[index];
+    bump(counters.allocations, filled);
+    bump(counters.cache_hits, hits);
+#else
+    (void)hits;
+#endif
+    return filled;
+}
+
+template<typename Policy>
+void BasicMultiSizePool<Policy>::deallocate_bulk(void* const* ptrs, size_t n, size_t size) {
+    size_t index = SizeClassMap<Policy>::index(size);
+#if MEMORYPOOL_HARDENED
+    // 每个块都要检查并经过隔离区
+    bool per_block = true;
+#else
+    bool per_block = index >= SIZE_CLASSES.size();
+#endif
+    if (per_block) {
+        for (size_t i = 0; i < n; ++i) deallocate(ptrs[i], size);
+        return;
+    }
+
+    FreeBlock* first = nullptr;
+    FreeBlock* last = nullptr;
+    size_t count = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (!ptrs[i]) continue;
+        FreeBlock* block = FreeBlock::from_data(ptrs[i]);
+        if (!block->mark_free()) {
+            report_pool_error(PoolError::DoubleFree, ptrs[i], size);
+            continue;
+        }
+        MEMORYPOOL_ASAN_POISON(ptrs[i], block->size + REDZONE);
+        block->next.store(first, std::memory_order_relaxed);
+        if (!last) last = block;
+        first = block;
+        ++count;
+    }
+    if (!first) return;
+
+    if (cpu_cache) {
+        auto& slot = cpu_cache->local();
+        std::lock_guard<SpinLock> lock(slot.lock);
+        auto& list = slot.lists[index];
+        while (first && list.count < max_cache_count(index)) {
+            FreeBlock* next = first->next.load(std::memory_order_relaxed);
+            list.push(first);
+            first = next;
+        }
+    } else if (!thread_cache.exited) {
+        bind_thread_cache();
+        while (first && thread_cache.caches[index].count < thread_cache.caches[index].max_count
+               && thread_cache.bytes < thread_cache.limit) {
+            FreeBlock* next = first->next.load(std::memory_order_relaxed);
+            thread_cache.push(index, first);
+            first = next;
+        }
+    }
+    if (first) {
+        push_chain(index, first, last);
+        MEMORYPOOL_STAT(bump(local_shard().classes[index].releases));
+    }
+    MEMORYPOOL_STAT(bump(local_shard().classes[index].deallocations, count));
+}
+
+template<typename Policy>
+typename BasicMultiSizePool<Policy>::Stats BasicMultiSizePool<Policy>::stats() const {
+    Stats result{};
+    uint64_t cache_hits = 0;
+    for (size_t i = 0; i < SIZE_CLASSES.size(); ++i) {
+        ClassStats& cls = result.classes[i];
+        cls.block_size = SIZE_CLASSES[i];
+#if MEMORYPOOL_STATS
+        for (const auto& shard : stat_shards) {
+            const auto& counters = shard.classes[i];
+            cls.allocations += counters.allocations.load(std::memory_order_relaxed);
+            cls.deallocations += counters.deallocations.load(std::memory_order_relaxed);
+            cls.cache_hits += counters.cache_hits.load(std::memory_order_relaxed);
+            cls.refills += counters.refills.load(std::memory_order_relaxed);
+            cls.releases += counters.releases.load(std::memory_order_relaxed);
+        }
+#endif
+        cls.chunks = allocated_chunks[i].chunk_count();
+        cls.bytes_reserved = allocated_chunks[i].committed_bytes();
+        // 分片读取不是原子快照，释放计数可能暂时领先
+        cls.bytes_in_use = cls.allocations > cls.deallocations ? (cls.allocations - cls.deallocations) * cls.block_size : 0;
+        cls.fragmentation = cls.bytes_reserved > 0
+            ? 1.0 - std::min(1.0, static_cast<double>(cls.bytes_in_use) / static_cast<double>(cls.bytes_reserved)) : 0.0;
+
+        result.allocations += cls.allocations;
+        result.deallocations += cls.deallocations;
+        result.bytes_in_use += cls.bytes_in_use;
+        result.bytes_reserved += cls.bytes_reserved;
+        result.chunks += cls.chunks;
+        cache_hits += cls.cache_hits;
+    }
+    size_t class_allocations = result.allocations;
+    size_t class_in_use = result.bytes_in_use;
+#if MEMORYPOOL_STATS
+    int64_t large_bytes = 0;
+    for (const auto& shard : stat_shards) {
+        result.large_allocations += shard.large_allocations.load(std::memory_order_relaxed);
+        result.large_deallocations += shard.large_deallocations.load(std::memory_order_relaxed);
+        large_bytes += shard.large_bytes.load(std::memory_order_relaxed);
+    }
+    result.large_bytes_in_use = large_bytes > 0 ? static_cast<size_t>(large_bytes) : 0;
+#endif
+    result.allocations += result.large_allocations;
+    result.deallocations += result.large_deallocations;
+    result.bytes_in_use += result.large_bytes_in_use;
+    result.cache_hit_rate = class_allocations > 0 ? static_cast<double>(cache_hits) / static_cast<double>(class_allocations) : 0.0;
+    result.fragmentation = result.bytes_reserved > 0
+        ? 1.0 - std::min(1.0, static_cast<double>(class_in_use) / static_cast<double>(result.bytes_reserved)) : 0.0;
+    return result;
+}
+
+template<typename Policy>
+void BasicMultiSizePool<Policy>::print_stats() const {
+    Stats snapshot = stats();
+    LOG_INFO("=== Memory Pool Statistics ===");
+    for (const ClassStats& cls : snapshot.classes) {
+        LOG_INFO("Size class {}: allocated: {}, deallocated: {}, cache hits: {}, refills: {}, releases: {}, chunks: {}, in use: {}, committed: {}, fragmentation: {:.2f}",
+            cls.block_size, cls.allocations, cls.deallocations, cls.cache_hits, cls.refills, cls.releases,
+            cls.chunks, cls.bytes_in_use, cls.bytes_reserved, cls.fragmentation);
+    }
+    LOG_INFO("Large: allocated: {}, deallocated: {}, in use: {}", snapshot.large_allocations, snapshot.large_deallocations, snapshot.large_bytes_in_use);
+    LOG_INFO("Total: in use: {}, committed: {}, chunks: {}, cache hit rate: {:.2f}, fragmentation: {:.2f}",
+        snapshot.bytes_in_use, snapshot.bytes_reserved, snapshot.chunks, snapshot.cache_hit_rate, snapshot.fragmentation);
+}
+
+template<typename Policy>
+size_t BasicMultiSizePool<Policy>::trim() {
+    if (owns_thread_cache()) {
+        thread_cache.flush();
+    }
+    if (cpu_cache) {
+        flush_cpu_caches();
+    }
+#if MEMORYPOOL_HARDENED
+    for (size_t i = 0; i < SIZE_CLASSES.size(); ++i) {
+        auto& free_list = chunk_classes[i].free_list;
+        quarantine[i].drain([&free_list](FreeBlock* block) {
+            FreeBlock* old_head = free_list.load(std::memory_order_relaxed);
+            do {
+                block->next.store(old_head, std::memory_order_relaxed);
+            } while (!free_list.compare_exchange_weak(old_head, block, std::memory_order_release, std::memory_order_relaxed));
+        });
+    }
+#endif
+
+    size_t released = 0;
+    for (size_t i = 0; i < SIZE_CLASSES.size(); ++i) {
+        released += allocated_chunks[i].trim(chunk_classes[i].free_list, chunk_classes[i].pop_lock, retention);
+    }
+    return released;
+}
+
+template<typename Policy>
+void BasicMultiSizePool<Policy>::flush_thread_cache() {
+    if (owns_thread_cache()) {
+        thread_cache.flush();
+    }
+}
+
+template<typename Policy>
+size_t BasicMultiSizePool<Policy>::thread_cache_bytes() const {
+    return owns_thread_cache() ? thread_cache.bytes : 0;
+}
+
+template<typename Policy>
+size_t BasicMultiSizePool<Policy>::cpu_cache_bytes() {
+    if (!cpu_cache) return 0;
+    size_t bytes = 0;
+    for (size_t cpu = 0; cpu < cpu_cache->size(); ++cpu) {
+        auto& slot = (*cpu_cache)[cpu];
+        std::lock_guard<SpinLock> lock(slot.lock);
+        for (size_t index = 0; index < SIZE_CLASSES.size(); ++index) {
+            bytes += slot.lists[index].count * SIZE_CLASSES[index];
+        }
+    }
+    return bytes;
+}
+
+template<typename Policy>
+void BasicMultiSizePool<Policy>::prepare_fork() {
+    if (cpu_cache) cpu_cache->lock_all();
+    // fork 时其他线程可能正在 pop_chain 中，子进程里对应大小类的取块锁会永远处于锁定状态
+    for (auto& chunk_class : chunk_classes) {
+        chunk_class.pop_lock.lock();
+    }
+    for (auto& chunks : allocated_chunks) {
+        chunks.lock();
+    }
+    if (arena) arena->lock();
+#if MEMORYPOOL_HARDENED
+    for (auto& q : quarantine) {
+        q.lock();
+    }
+#endif
+}
+
+template<typename Policy>
+void BasicMultiSizePool<Policy>::after_fork() {
+#if MEMORYPOOL_HARDENED
+    for (auto& q : quarantine) {
+        q.unlock();
+    }
+#endif
+    if (arena) arena->unlock();
+    for (auto& chunks : allocated_chunks) {
+        chunks.unlock();
+    }
+    for (auto& chunk_class : chunk_classes) {
+        chunk_class.pop_lock.unlock();
+    }
+    if (cpu_cache) cpu_cache->unlock_all();
+}
+
+template<typename Policy>
+size_t BasicMultiSizePool<Policy>::chunk_count() const {
+    size_t count = 0;
+    for (const auto& chunks : allocated_chunks) {
+        count += chunks.chunk_count();
+    }
+    return count;
+}
+
+template<typename Policy>
+size_t BasicMultiSizePool<Policy>::committed_bytes() const {
+    size_t bytes = 0;
+    for (const auto& chunks : allocated_chunks) {
+        bytes += chunks.committed_bytes();
+    }
+    return bytes;
+}
+
+// 每 CPU 缓存不做慢启动：上限固定为 max_cache_count，未命中时从全局链表取一批
+template<typename Policy>
+void* BasicMultiSizePool<Policy>::allocate_from_cpu_cache(size_t index, size_t size) {
+    FreeBlock* block = nullptr;
+    {
+        auto& slot = cpu_cache->local();
+        std::lock_guard<SpinLock> lock(slot.lock);
+        auto& list = slot.lists[index];
+        if (list.count > 0) {
+            MEMORYPOOL_STAT(bump(local_shard().classes[index].cache_hits));
+        } else {
+            list.head = pop_chain(index, CACHE_BATCH, list.count);
+            if (list.head) MEMORYPOOL_STAT(bump(local_shard().classes[index].refills));
+        }
+        if (list.count > 0) block = list.pop();
+    }
+
+    // 全局链表也为空：在锁外切分（可能申请新 chunk），mmap 期间不阻塞同一 CPU 上的其他线程
+    if (!block) {
+        uint32_t count = 0;
+        block = carve_chain(index, CACHE_BATCH, count);
+        if (!block) return nullptr;
+        if (count > 1) {
+            auto& slot = cpu_cache->local();
+            std::lock_guard<SpinLock> lock(slot.lock);
+            for (FreeBlock* rest = block->next.load(std::memory_order_relaxed); rest;) {
+                FreeBlock* next = rest->next.load(std::memory_order_relaxed);
+                slot.lists[index].push(rest);
+                rest = next;
+            }
+        }
+    }
+    MEMORYPOOL_STAT(bump(local_shard().classes[index].allocations));
+    return hand_out(block, size);
+}
+
+template<typename Policy>
+void BasicMultiSizePool<Policy>::deallocate_to_cpu_cache(size_t index, FreeBlock* block) {
+    auto& slot = cpu_cache->local();
+    {
+        std::lock_guard<SpinLock> lock(slot.lock);
+        auto& list = slot.lists[index];
+        list.push(block);
+        if (list.count > max_cache_count(index)) {
+            auto [first, last] = list.take(CACHE_BATCH);
+            push_chain(index, first, last);
+            MEMORYPOOL_STAT(bump(local_shard().classes[index].releases));
+        }
+    }
+    MEMORYPOOL_STAT(bump(local_shard().classes[index].deallocations));
+}
+
+template<typename Policy>
+void BasicMultiSizePool<Policy>::flush_cpu_caches() {
+    for (size_t cpu = 0; cpu < cpu_cache->size(); ++cpu) {
+        auto& slot = (*cpu_cache)[cpu];
+        std::lock_guard<SpinLock> lock(slot.lock);
+        for (size_t index = 0; index < SIZE_CLASSES.size(); ++index) {
+            auto [first, last] = slot.lists[index].take(slot.lists[index].count);
+            if (first) push_chain(index, first, last);
+        }
+    }
+}
+
+template<typename Policy>
+typename BasicMultiSizePool<Policy>::FreeBlock* BasicMultiSizePool<Policy>::pop_chain(size_t index, size_t n, uint32_t& count) {
+    auto& free_list = chunk_classes[index].free_list;
+    std::lock_guard<SpinLock> guard(chunk_classes[index].pop_lock);
+    FreeBlock* old_head = free_list.load(std::memory_order_acquire);
+    while (old_head) {
+        FreeBlock* last = old_head;
+        count = 1;
+        while (count < n && last->next.load(std::memory_order_relaxed)) {
+            last = last->next.load(std::memory_order_relaxed);
+            ++count;
+        }
+        if (free_list.compare_exchange_weak(old_head, last->next.load(std::memory_order_relaxed),
+                                            std::memory_order_acquire, std::memory_order_relaxed)) {
+            last->next.store(nullptr, std::memory_order_relaxed);
+            return old_head;
+        }
+    }
+    count = 0;
+    return nullptr;
+}
+
+template<typename Policy>
+void BasicMultiSizePool<Policy>::push_chain(size_t index, FreeBlock* first, FreeBlock* last) {
+    auto& free_list = chunk_classes[index].free_list;
+    FreeBlock* old_head = free_list.load(std::memory_order_relaxed);
+    do {
+        last->next.store(old_head, std::memory_order_relaxed);
+    } while (!free_list.compare_exchange_weak(old_head, first, std::memory_order_release, std::memory_order_relaxed));
+}
+
+template<typename Policy>
+size_t BasicMultiSizePool<Policy>::reserve(size_t size, size_t count, const ReserveOptions& options) {
+    size_t index = SizeClassMap<Policy>::index(size);
+    if (size == 0 || index >= SIZE_CLASSES.size()) return 0;
+    while (class_capacity(index) < count && allocate_chunk_for_size_class(index, &options)) {}
+    if (options.lock_memory) allocated_chunks[index].pin_committed();
+    return class_capacity(index);
+}
+
+template<typename Policy>
+void BasicMultiSizePool<Policy>::reserve_bytes(size_t bytes_per_class, const ReserveOptions& options) {
+    for (size_t index = 0; index < SIZE_CLASSES.size(); ++index) {
+        reserve(SIZE_CLASSES[index], bytes_per_class / SIZE_CLASSES[index], options);
+    }
+}
+
+template<typename Policy>
+void BasicMultiSizePool<Policy>::prewarm() {
+    if (cpu_cache) {
+        auto& slot = cpu_cache->local();
+        std::lock_guard<SpinLock> lock(slot.lock);
+        for (size_t index = 0; index < SIZE_CLASSES.size(); ++index) {
+            auto& list = slot.lists[index];
+            if (list.count >= CACHE_BATCH) continue;
+            uint32_t count = 0;
+            FreeBlock* block = pop_chain(index, CACHE_BATCH - list.count, count);
+            if (block) MEMORYPOOL_STAT(bump(local_shard().classes[index].refills));
+            while (block) {
+                FreeBlock* next = block->next.load(std::memory_order_relaxed);
+                list.push(block);
+                block = next;
+            }
+        }
+        return;
+    }
+
+    if (thread_cache.exited) return;
+    bind_thread_cache();
+    on_slow_path();
+    for (size_t index = 0; index < SIZE_CLASSES.size(); ++index) {
+        auto& class_cache = thread_cache.caches[index];
+        if (class_cache.count >= CACHE_BATCH) continue;
+        uint32_t count = 0;
+        FreeBlock* block = pop_chain(index, CACHE_BATCH - class_cache.count, count);
+        if (!block) continue;
+        // 跳过慢启动，否则预热的块会在第一次释放时被当作超限归还
+        class_cache.max_count = std::max(class_cache.max_count, CACHE_BATCH);
+        while (block) {
+            FreeBlock* next = block->next.load(std::memory_order_relaxed);
+            thread_cache.push(index, block);
+            block = next;
+        }
+        MEMORYPOOL_STAT(bump(local_shard().classes[index].refills));
+    }
+}
+
+template<typename Policy>
+size_t BasicMultiSizePool<Policy>::class_capacity(size_t index) const {
+    return allocated_chunks[index].committed_bytes() / chunk_classes[index].total_block_size;
+}
+
+template<typename Policy>
+bool BasicMultiSizePool<Policy>::allocate_chunk_for_size_class(size_t index, const ReserveOptions* warm) {
+    if (index >= SIZE_CLASSES.size()) return false; // 分配大对象
+    ChunkClass& chunk_class = chunk_classes[index];
+    size_t block_count = chunk_class.block_count;
+
+    if (block_count == 0) block_count = 1;
+
+    size_t actual_chunk_size = chunk_class.total_block_size * block_count;
+    ChunkRecord* chunk = allocated_chunks[index].acquire(actual_chunk_size, block_count); // 分配一个chunk
+    if (!chunk) return false;
+    if (warm && warm->prefault) os_memory::prefault(chunk->base, chunk->bytes);
+
+    // 将 block 添加到 free_list：reserve 的整个 chunk，或并发增长时上一个切分对象剩下的部分
+    auto publish = [&](ChunkRecord* record, size_t first, size_t count) {
+        FreeBlock* head = init_blocks(index, record, first, count);
+        auto* tail = reinterpret_cast<FreeBlock*>(record->base + (first + count - 1) * chunk_class.total_block_size);
+        push_chain(index, head, tail);
+    };
+    if (warm) {
+        publish(chunk, 0, block_count);
+        return true;
+    }
+    size_t first = 0;
+    size_t count = 0;
+    if (ChunkRecord* previous = allocated_chunks[index].start_carving(chunk, first, count)) {
+        publish(previous, first, count);
+    }
+    return true;
+}
+
+template<typename Policy>
+typename BasicMultiSizePool<Policy>::FreeBlock* BasicMultiSizePool<Policy>::init_blocks(size_t index, ChunkRecord* chunk, size_t first, size_t count) {
+    ChunkClass& chunk_class = chunk_classes[index];
+    std::byte* ptr = chunk->base + first * chunk_class.total_block_size;
+    FreeBlock* head = nullptr;
+    FreeBlock* prev_block = nullptr;
+    for (size_t i = 0; i < count; ++i) {
+        FreeBlock* block = new(ptr) FreeBlock(chunk_class.block_size);
+#if MEMORYPOOL_HARDENED
+        std::memset(block->data(), hardening::POISON_BYTE, chunk_class.block_size + REDZONE);
+#endif
+        MEMORYPOOL_ASAN_POISON(block->data(), chunk_class.block_size + REDZONE);
+        ptr += chunk_class.total_block_size;
+        if (prev_block) {
+            prev_block->next.store(block, std::memory_order_relaxed);
+        } else {
+            head = block;
+        }
+        prev_block = block;
+    }
+    if (prev_block) prev_block->next.store(nullptr, std::memory_order_relaxed);
+    return head;
+}
+
+template<typename Policy>
+typename BasicMultiSizePool<Policy>::FreeBlock* BasicMultiSizePool<Policy>::carve_chain(size_t index, size_t n, uint32_t& count) {
+    do {
+        size_t first = 0;
+        size_t carved = 0;
+        if (ChunkRecord* chunk = allocated_chunks[index].carve(n, first, carved)) {
+            count = static_cast<uint32_t>(carved);
+            return init_blocks(index, chunk, first, carved);
+        }
+    } while (allocate_chunk_for_size_class(index));
+    count = 0;
+    return nullptr;
+}
+
+// 默认大小类的内存池在 MemoryPool.cpp 中显式实例化
+extern template class BasicMultiSizePool<DefaultSizeClasses>;
+using LockFreeMultiSizePool = BasicMultiSizePool<DefaultSizeClasses>;
+
 class MemoryPoolAllocater {
 private:
     LockFreeMultiSizePool pool;
@@ -502,6 +2715,12 @@ public:
         pool.print_stats();
     }
 
+    size_t trim() {
+        return pool.trim();
+    }
+
+    LockFreeMultiSizePool& get_pool() { return pool; }
+
     void reset_global_state() {
         LockFreeMultiSizePool::reset_global_state();
     }
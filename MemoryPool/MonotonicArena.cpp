@@ -0,0 +1,90 @@
+#include "MonotonicArena.hpp"
+
+MonotonicArena::MonotonicArena(size_t initial_chunk_size, LockFreeMultiSizePool* upstream)
+    : upstream(upstream), next_chunk_size(initial_chunk_size > sizeof(Chunk) ? initial_chunk_size : DEFAULT_CHUNK_SIZE) {}
+
+MonotonicArena::~MonotonicArena() {
+    release();
+}
+
+void MonotonicArena::activate(Chunk* chunk) {
+    current = chunk;
+    cursor = chunk->data();
+    end = chunk->data() + chunk->size;
+}
+
+MonotonicArena::Chunk* MonotonicArena::new_chunk(size_t min_size) {
+    // next_chunk_size 包含头部，数据区是剩下的部分
+    size_t bytes = std::max(next_chunk_size, sizeof(Chunk) + min_size);
+    if (upstream) bytes = align_of(bytes, PageHeap::PAGE_BYTES);
+    size_t size = bytes - sizeof(Chunk);
+    void* memory = upstream ? upstream->allocate(bytes) : ::operator new(bytes);
+    if (!memory) return nullptr;
+
+    // 按几何级数增长，减少 chunk 数量
+    next_chunk_size = std::min(next_chunk_size * 2, MAX_CHUNK_SIZE);
+    ++chunks;
+    reserved += size;
+    return new (memory) Chunk{nullptr, size};
+}
+
+void* MonotonicArena::allocate_slow(size_t size, size_t alignment) {
+    // 数据区加上 chunk 头部和页对齐的余量都不能溢出
+    if (size > SIZE_MAX - alignment - sizeof(Chunk) - PageHeap::PAGE_BYTES) return nullptr;
+    size_t needed = size + alignment - 1;
+
+    // 先尝试 reset/rewind 之后保留下来的 chunk
+    while (current && current->next) {
+        activate(current->next);
+        if (current->size >= needed) {
+            return allocate(size, alignment);
+        }
+    }
+
+    Chunk* chunk = new_chunk(needed);
+    if (!chunk) return nullptr;
+    if (current) {
+        chunk->next = current->next;
+        current->next = chunk;
+    } else {
+        chunk->next = head;
+        head = chunk;
+    }
+    activate(chunk);
+    return allocate(size, alignment);
+}
+
+void MonotonicArena::reset() {
+    if (head) {
+        activate(head);
+    }
+}
+
+void MonotonicArena::rewind(const Mark& m) {
+    if (!m.chunk) {
+        reset();
+        return;
+    }
+    current = m.chunk;
+    cursor = m.cursor;
+    end = m.chunk->data() + m.chunk->size;
+}
+
+void MonotonicArena::release() {
+    Chunk* chunk = head;
+    while (chunk) {
+        Chunk* next = chunk->next;
+        size_t bytes = sizeof(Chunk) + chunk->size;
+        chunk->~Chunk();
+        if (upstream) {
+            upstream->deallocate(chunk, bytes);
+        } else {
+            ::operator delete(chunk);
+        }
+        chunk = next;
+    }
+    head = current = nullptr;
+    cursor = end = nullptr;
+    chunks = 0;
+    reserved = 0;
+}
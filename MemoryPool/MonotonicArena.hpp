@@ -0,0 +1,129 @@
+#pragma once
+
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include <utility>
+
+#include "MemoryPool.hpp"
+
+// 单调递增的 bump 分配器（非线程安全）
+// 适合一批同时死亡的小对象：分配只移动指针，reset() 一次性回收全部内存
+// 不会调用对象的析构函数，需要析构的对象请自行调用 ~T()
+class MonotonicArena {
+private:
+    struct Chunk {
+        Chunk* next;
+        size_t size;    // 数据区大小
+        std::byte* data() { return reinterpret_cast<std::byte*>(this) + sizeof(Chunk); }
+    };
+
+public:
+    // chunk 大小包含 16 字节的头部；从 upstream 申请时再向上取整到页堆的页大小，整页分配不浪费
+    static constexpr size_t DEFAULT_CHUNK_SIZE = 4 * 1024;
+    static constexpr size_t MAX_CHUNK_SIZE = 1024 * 1024;
+
+    // 记录分配位置，用于回退
+    struct Mark {
+        Chunk* chunk;
+        std::byte* cursor;
+    };
+
+    // upstream 非空时 chunk 从 LockFreeMultiSizePool 申请，否则使用 operator new
+    explicit MonotonicArena(size_t initial_chunk_size = DEFAULT_CHUNK_SIZE, LockFreeMultiSizePool* upstream = nullptr);
+    ~MonotonicArena();
+
+    MonotonicArena(const MonotonicArena&) = delete;
+    MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+    // alignment 必须是 2 的幂；size 加上对齐和 chunk 头部后溢出时返回 nullptr
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+        assert(std::has_single_bit(alignment));
+        auto addr = reinterpret_cast<uintptr_t>(cursor);
+        auto aligned = (addr + alignment - 1) & ~(alignment - 1);
+        auto limit = reinterpret_cast<uintptr_t>(end);
+        // 以差值比较，巨大的 size 不会让 aligned + size 回绕
+        if (cursor && aligned <= limit && size <= limit - aligned) {
+            cursor = reinterpret_cast<std::byte*>(aligned + size);
+            return reinterpret_cast<void*>(aligned);
+        }
+        return allocate_slow(size, alignment);
+    }
+
+    // 单个对象不单独回收
+    void deallocate(void*, size_t) {}
+
+    template<typename T, typename... Args>
+    T* create(Args&&... args) {
+        void* ptr = allocate(sizeof(T), alignof(T));
+        return new (ptr) T(std::forward<Args>(args)...);
+    }
+
+    // O(1) 回收全部对象，chunk 保留下来供下一轮复用
+    void reset();
+
+    // 归还所有 chunk
+    void release();
+
+    Mark mark() const { return Mark{current, cursor}; }
+    void rewind(const Mark& m);
+
+    size_t chunk_count() const { return chunks; }
+    size_t reserved_bytes() const { return reserved; }
+
+private:
+    void* allocate_slow(size_t size, size_t alignment);
+    Chunk* new_chunk(size_t min_size);
+    void activate(Chunk* chunk);
+
+    LockFreeMultiSizePool* upstream;
+    Chunk* head = nullptr;
+    Chunk* current = nullptr;
+    std::byte* cursor = nullptr;
+    std::byte* end = nullptr;
+    size_t next_chunk_size;
+    size_t chunks = 0;
+    size_t reserved = 0;
+};
+
+// 作用域结束时把 arena 回退到进入作用域时的位置，可嵌套使用
+class ScopedArena {
+public:
+    explicit ScopedArena(MonotonicArena& arena): arena_(arena), mark_(arena.mark()) {}
+    ~ScopedArena() { arena_.rewind(mark_); }
+
+    ScopedArena(const ScopedArena&) = delete;
+    ScopedArena& operator=(const ScopedArena&) = delete;
+
+    MonotonicArena& arena() { return arena_; }
+
+private:
+    MonotonicArena& arena_;
+    MonotonicArena::Mark mark_;
+};
+
+// 供 std::pmr 容器使用的适配器
+class ArenaMemoryResource : public std::pmr::memory_resource {
+public:
+    explicit ArenaMemoryResource(MonotonicArena& arena): arena_(arena) {}
+
+private:
+    // memory_resource 要求失败时抛出异常，而不是返回空指针
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        void* ptr = arena_.allocate(bytes, alignment);
+        if (!ptr) throw std::bad_alloc();
+        return ptr;
+    }
+
+    void do_deallocate(void*, size_t, size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        auto* resource = dynamic_cast<const ArenaMemoryResource*>(&other);
+        return resource && &resource->arena_ == &arena_;
+    }
+
+    MonotonicArena& arena_;
+};
@@ -0,0 +1,298 @@
+#pragma once
+
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "MemoryPool.hpp"
+
+// 默认的回收钩子：对象有 reset() 成员时调用，否则什么都不做
+template<typename T>
+struct ObjectPoolReset {
+    void operator()(T& object) const {
+        if constexpr (requires { object.reset(); }) {
+            object.reset();
+        }
+    }
+};
+
+// 保持构造状态的对象池
+// release 时不析构对象，只调用 Reset 钩子清理状态后放回空闲链表，下次 acquire 直接复用
+// 对象内部的 vector/string 等保留容量，复用时不再重新申请内存
+// 空闲对象按 CPU 缓存（rseq 不可用时按线程缓存），超出容量的部分放入全局链表；析构或 trim() 时才真正析构
+template<typename T, typename Reset = ObjectPoolReset<T>, size_t N = 4096>
+class ObjectPool {
+private:
+    // 对象构造在首个成员的存储里，Node 不受 T 的布局影响，始终是标准布局，T* 与 Node* 可以互相转换
+    struct Node {
+        alignas(T) std::byte storage[sizeof(T)];
+        std::atomic<Node*> next{nullptr};
+
+        template<typename... Args>
+        explicit Node(Args&&... args) { ::new (static_cast<void*>(storage)) T(std::forward<Args>(args)...); }
+        ~Node() { object()->~T(); }
+
+        Node(const Node&) = delete;
+        Node& operator=(const Node&) = delete;
+
+        T* object() { return std::launder(reinterpret_cast<T*>(storage)); }
+    };
+    static_assert(std::is_standard_layout_v<Node>, "node_of relies on storage being the first member");
+
+    static constexpr uint32_t CPU_CACHE_CAPACITY = 32;
+    static constexpr uint32_t BATCH_SIZE = 16;
+
+    using Slot = typename PerCpuCache<Node, 1>::Slot;
+
+    // rseq 不可用时 current_cpu() 恒为 0，所有线程会挤在同一个 CPU 槽上，改为每个线程一个槽
+    // 槽归内存池所有，线程退出时把对象交回全局链表并让出槽；trim() 与析构可以访问所有线程的槽
+    struct ThreadBinding : pool_lifetime::ThreadCacheHook {
+        ObjectPool* pool = nullptr;
+        uint64_t generation = 0;
+        Slot* slot = nullptr;
+
+        constexpr ThreadBinding() : pool_lifetime::ThreadCacheHook{&ThreadBinding::detach_hook} {}
+
+        ~ThreadBinding() {
+            pool_lifetime::unlink(*this);
+            detach_pool();
+        }
+
+        static void detach_hook(pool_lifetime::ThreadCacheHook* hook) {
+            static_cast<ThreadBinding*>(hook)->detach_pool();
+        }
+
+        // 内存池已经析构时槽随它一起释放了，直接丢弃
+        void detach_pool() {
+            if (pool) {
+                auto lock = pool_lifetime::lock_if_alive(generation);
+                if (lock.owns_lock()) pool->release_thread_slot(*slot);
+            }
+            pool = nullptr;
+            slot = nullptr;
+        }
+    };
+    static inline thread_local ThreadBinding binding;
+
+    LockFreeFixedSizePool<Node, N> storage;
+    std::unique_ptr<PerCpuCache<Node, 1>> cpu_cache;    // percpu::available() 时使用
+    Reset reset_hook;
+
+    // 各 CPU（线程）缓存放不下的空闲对象，按批次进出
+    std::mutex global_mtx;
+    typename PerCpuCache<Node, 1>::List global_idle;
+    // 线程槽只增不减，线程退出后由之后的线程复用；受 global_mtx 保护
+    std::vector<std::unique_ptr<Slot>> thread_slots;
+    std::vector<Slot*> free_thread_slots;
+    size_t fork_locked_slots = 0;       // prepare_fork 锁住的线程槽数
+
+    std::atomic<size_t> constructed{0};
+    std::atomic<size_t> reused{0};
+    pool_lifetime::Registration lifetime;
+
+    static Node* node_of(T* object) { return reinterpret_cast<Node*>(object); }
+
+    Slot& local_slot() {
+        if (cpu_cache) return cpu_cache->local();
+        if (binding.pool != this || binding.generation != lifetime.generation) bind_thread_slot();
+        return *binding.slot;
+    }
+
+    void bind_thread_slot() {
+        binding.detach_pool();
+        {
+            std::lock_guard<std::mutex> lock(global_mtx);
+            if (free_thread_slots.empty()) {
+                thread_slots.push_back(std::make_unique<Slot>());
+                binding.slot = thread_slots.back().get();
+            } else {
+                binding.slot = free_thread_slots.back();
+                free_thread_slots.pop_back();
+            }
+        }
+        binding.pool = this;
+        binding.generation = lifetime.generation;
+        pool_lifetime::link(binding);
+    }
+
+    // 加锁顺序与 acquire/release 一致：CPU（线程）槽 -> global_mtx -> storage
+    // storage 先于本对象登记，登记表从新到旧调用，storage 的钩子在这之后才加锁
+    void prepare_fork() {
+        if (cpu_cache) {
+            cpu_cache->lock_all();
+            global_mtx.lock();
+            return;
+        }
+        // bind_thread_slot 只持有 global_mtx 就会追加槽，锁住已有的槽后确认数量没有变化
+        while (true) {
+            global_mtx.lock();
+            size_t count = thread_slots.size();
+            global_mtx.unlock();
+            for (size_t i = 0; i < count; ++i) thread_slots[i]->lock.lock();
+            global_mtx.lock();
+            if (thread_slots.size() == count) {
+                fork_locked_slots = count;
+                return;
+            }
+            global_mtx.unlock();
+            for (size_t i = count; i-- > 0;) thread_slots[i]->lock.unlock();
+        }
+    }
+
+    void after_fork() {
+        global_mtx.unlock();
+        if (cpu_cache) {
+            cpu_cache->unlock_all();
+            return;
+        }
+        for (size_t i = fork_locked_slots; i-- > 0;) thread_slots[i]->lock.unlock();
+    }
+
+    // 线程解除绑定：槽中的对象交回全局链表，槽留给其他线程
+    void release_thread_slot(Slot& slot) {
+        std::lock_guard<SpinLock> slot_lock(slot.lock);
+        auto& list = slot.lists[0];
+        uint32_t count = list.count;
+        auto [first, last] = list.take(count);
+        std::lock_guard<std::mutex> lock(global_mtx);
+        if (first) {
+            last->next.store(global_idle.head, std::memory_order_relaxed);
+            global_idle.head = first;
+            global_idle.count += count;
+        }
+        free_thread_slots.push_back(&slot);
+    }
+
+    // 从全局链表取一批空闲对象到本 CPU 缓存，调用方持有 slot 锁
+    void refill(typename PerCpuCache<Node, 1>::List& list) {
+        std::lock_guard<std::mutex> lock(global_mtx);
+        uint32_t available = global_idle.count;
+        auto [first, last] = global_idle.take(BATCH_SIZE);
+        if (!first) return;
+        last->next.store(list.head, std::memory_order_relaxed);
+        list.head = first;
+        list.count += available - global_idle.count;
+    }
+
+public:
+    explicit ObjectPool(Reset reset = Reset{}) : reset_hook(std::move(reset)) {
+        if (percpu::available()) cpu_cache = std::make_unique<PerCpuCache<Node, 1>>();
+        lifetime.owner = this;
+        lifetime.prepare_fork = [](void* owner) { static_cast<ObjectPool*>(owner)->prepare_fork(); };
+        lifetime.after_fork = [](void* owner) { static_cast<ObjectPool*>(owner)->after_fork(); };
+        pool_lifetime::register_pool(lifetime);
+    }
+
+    ~ObjectPool() {
+        // 先注销，之后退出的线程不再访问本内存池的线程槽
+        pool_lifetime::unregister_pool(lifetime);
+        trim();
+        if (binding.pool == this) {
+            binding.pool = nullptr;
+            binding.slot = nullptr;
+        }
+    }
+
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    // 有空闲对象时直接复用（忽略 args），否则以 args 构造新对象
+    template<typename... Args>
+    T* acquire(Args&&... args) {
+        {
+            auto& slot = local_slot();
+            std::lock_guard<SpinLock> lock(slot.lock);
+            auto& list = slot.lists[0];
+            if (list.count == 0) refill(list);
+            if (list.count > 0) {
+                reused.fetch_add(1, std::memory_order_relaxed);
+                return list.pop()->object();
+            }
+        }
+        Node* node = storage.allocate(std::forward<Args>(args)...);
+        if (!node) return nullptr;
+        constructed.fetch_add(1, std::memory_order_relaxed);
+        return node->object();
+    }
+
+    // 调用 Reset 钩子后放回空闲链表，不析构
+    void release(T* object) {
+        if (!object) return;
+        reset_hook(*object);
+
+        auto& slot = local_slot();
+        std::lock_guard<SpinLock> lock(slot.lock);
+        auto& list = slot.lists[0];
+        list.push(node_of(object));
+        if (list.count > CPU_CACHE_CAPACITY) {
+            auto [first, last] = list.take(BATCH_SIZE);
+            std::lock_guard<std::mutex> global_lock(global_mtx);
+            last->next.store(global_idle.head, std::memory_order_relaxed);
+            global_idle.head = first;
+            global_idle.count += BATCH_SIZE;
+        }
+    }
+
+    // 供 PoolPtr / PoolAllocator 使用
+    template<typename... Args>
+    T* allocate(Args&&... args) { return acquire(std::forward<Args>(args)...); }
+    void deallocate(T* object) { release(object); }
+
+    // 析构所有空闲对象并回收空 chunk，返回析构的对象数
+    size_t trim() {
+        size_t destroyed = 0;
+        auto destroy = [&](Node* node) {
+            while (node) {
+                Node* next = node->next.load(std::memory_order_relaxed);
+                storage.deallocate(node);
+                node = next;
+                ++destroyed;
+            }
+        };
+        auto drain = [&](Slot& slot) {
+            std::lock_guard<SpinLock> lock(slot.lock);
+            auto [first, last] = slot.lists[0].take(slot.lists[0].count);
+            if (first) {
+                last->next.store(nullptr, std::memory_order_relaxed);
+                destroy(first);
+            }
+        };
+        if (cpu_cache) {
+            for (size_t cpu = 0; cpu < cpu_cache->size(); ++cpu) drain((*cpu_cache)[cpu]);
+        } else {
+            // 槽只增不减，拷贝出指针后逐个加锁
+            std::vector<Slot*> slots;
+            {
+                std::lock_guard<std::mutex> lock(global_mtx);
+                for (auto& slot : thread_slots) slots.push_back(slot.get());
+            }
+            for (Slot* slot : slots) drain(*slot);
+        }
+        {
+            std::lock_guard<std::mutex> lock(global_mtx);
+            auto [first, last] = global_idle.take(global_idle.count);
+            if (first) {
+                last->next.store(nullptr, std::memory_order_relaxed);
+                destroy(first);
+            }
+        }
+        storage.trim();
+        return destroyed;
+    }
+
+    // 调用过构造函数的次数
+    size_t constructed_count() const { return constructed.load(std::memory_order_relaxed); }
+
+    // 复用空闲对象的次数
+    size_t reused_count() const { return reused.load(std::memory_order_relaxed); }
+
+    // 当前存活（包括空闲）的对象数
+    size_t live_objects() const { return storage.get_active_objects(); }
+};
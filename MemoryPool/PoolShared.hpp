@@ -0,0 +1,236 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "MemoryPool.hpp"
+
+// 引用计数的同步方式
+enum class RefCounting {
+    Atomic,     // 可以跨线程共享
+    Local,      // 普通整数，只在单线程内使用
+};
+
+namespace pool_shared_detail {
+    template<RefCounting Mode>
+    struct Counter {
+        std::atomic<uint32_t> value;
+
+        explicit Counter(uint32_t initial) : value(initial) {}
+        void increment() { value.fetch_add(1, std::memory_order_relaxed); }
+        // 返回减一后的值，归零时与之前的释放同步
+        uint32_t decrement() {
+            uint32_t remaining = value.fetch_sub(1, std::memory_order_release) - 1;
+            if (remaining == 0) std::atomic_thread_fence(std::memory_order_acquire);
+            return remaining;
+        }
+        uint32_t load() const { return value.load(std::memory_order_relaxed); }
+        // 非零时加一，供 weak 引用提升使用
+        bool increment_if_nonzero() {
+            uint32_t current = value.load(std::memory_order_relaxed);
+            while (current != 0) {
+                if (value.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel, std::memory_order_relaxed)) return true;
+            }
+            return false;
+        }
+    };
+
+    template<>
+    struct Counter<RefCounting::Local> {
+        uint32_t value;
+
+        explicit Counter(uint32_t initial) : value(initial) {}
+        void increment() { ++value; }
+        uint32_t decrement() { return --value; }
+        uint32_t load() const { return value; }
+        bool increment_if_nonzero() {
+            if (value == 0) return false;
+            ++value;
+            return true;
+        }
+    };
+
+    struct NoCounter {
+        explicit NoCounter(uint32_t) {}
+    };
+}
+
+template<typename T, RefCounting Mode, bool Weak>
+class PoolSharedOwner;
+
+// 控制块与对象位于同一个池块中：不需要像 std::shared_ptr 那样额外分配控制块
+template<typename T, RefCounting Mode = RefCounting::Atomic, bool Weak = false>
+struct PoolSharedBlock {
+    using Counter = pool_shared_detail::Counter<Mode>;
+
+    PoolSharedOwner<T, Mode, Weak>* owner;
+    Counter strong{1};
+    // 所有 strong 引用合计持有一个 weak 引用，weak 归零时才归还池块
+    [[no_unique_address]] std::conditional_t<Weak, Counter, pool_shared_detail::NoCounter> weak{1};
+    alignas(T) std::byte storage[sizeof(T)];
+
+    explicit PoolSharedBlock(PoolSharedOwner<T, Mode, Weak>* o) : owner(o) {}
+
+    T* object() { return std::launder(reinterpret_cast<T*>(storage)); }
+};
+
+// 池块的归还方，PoolShared 的类型因此不依赖具体池的块大小参数
+template<typename T, RefCounting Mode, bool Weak>
+class PoolSharedOwner {
+public:
+    virtual void destroy_block(PoolSharedBlock<T, Mode, Weak>* block) = 0;
+
+protected:
+    ~PoolSharedOwner() = default;
+};
+
+template<typename T, RefCounting Mode, bool Weak>
+class PoolWeak;
+
+// 共享所有权的智能指针，只占一个指针大小
+template<typename T, RefCounting Mode = RefCounting::Atomic, bool Weak = false>
+class PoolShared {
+public:
+    using Block = PoolSharedBlock<T, Mode, Weak>;
+
+    PoolShared() = default;
+    explicit PoolShared(Block* block) : block_(block) {}
+
+    PoolShared(const PoolShared& other) noexcept : block_(other.block_) {
+        if (block_) block_->strong.increment();
+    }
+
+    PoolShared(PoolShared&& other) noexcept : block_(std::exchange(other.block_, nullptr)) {}
+
+    PoolShared& operator=(const PoolShared& other) noexcept {
+        PoolShared(other).swap(*this);
+        return *this;
+    }
+
+    PoolShared& operator=(PoolShared&& other) noexcept {
+        PoolShared(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    ~PoolShared() {
+        reset();
+    }
+
+    T* get() const noexcept { return block_ ? block_->object() : nullptr; }
+    T& operator*() const noexcept { return *block_->object(); }
+    T* operator->() const noexcept { return block_->object(); }
+
+    explicit operator bool() const noexcept { return block_ != nullptr; }
+
+    uint32_t use_count() const noexcept { return block_ ? block_->strong.load() : 0; }
+
+    void reset() {
+        Block* block = std::exchange(block_, nullptr);
+        if (!block || block->strong.decrement() != 0) return;
+        block->object()->~T();
+        if constexpr (Weak) {
+            if (block->weak.decrement() != 0) return;
+        }
+        block->owner->destroy_block(block);
+    }
+
+    void swap(PoolShared& other) noexcept { std::swap(block_, other.block_); }
+
+    bool operator==(const PoolShared& other) const noexcept { return block_ == other.block_; }
+
+private:
+    friend class PoolWeak<T, Mode, Weak>;
+
+    Block* block_ = nullptr;
+};
+
+// weak 引用：只有 Weak = true 的 PoolShared 可以创建，对象析构后池块保留到最后一个 weak 引用释放
+template<typename T, RefCounting Mode, bool Weak>
+class PoolWeak {
+    static_assert(Weak, "PoolWeak requires PoolShared<T, Mode, true>");
+
+public:
+    using Block = PoolSharedBlock<T, Mode, Weak>;
+
+    PoolWeak() = default;
+
+    PoolWeak(const PoolShared<T, Mode, Weak>& shared) noexcept : block_(shared.block_) {
+        if (block_) block_->weak.increment();
+    }
+
+    PoolWeak(const PoolWeak& other) noexcept : block_(other.block_) {
+        if (block_) block_->weak.increment();
+    }
+
+    PoolWeak(PoolWeak&& other) noexcept : block_(std::exchange(other.block_, nullptr)) {}
+
+    PoolWeak& operator=(PoolWeak other) noexcept {
+        std::swap(block_, other.block_);
+        return *this;
+    }
+
+    ~PoolWeak() {
+        reset();
+    }
+
+    // 对象仍然存活时返回新的 strong 引用，否则返回空
+    PoolShared<T, Mode, Weak> lock() const {
+        if (block_ && block_->strong.increment_if_nonzero()) return PoolShared<T, Mode, Weak>(block_);
+        return {};
+    }
+
+    bool expired() const noexcept { return !block_ || block_->strong.load() == 0; }
+
+    void reset() {
+        Block* block = std::exchange(block_, nullptr);
+        if (block && block->weak.decrement() == 0) {
+            block->owner->destroy_block(block);
+        }
+    }
+
+private:
+    Block* block_ = nullptr;
+};
+
+// 从固定大小内存池分配 PoolShared 对象，必须比它创建的所有 PoolShared/PoolWeak 活得更久
+template<typename T, RefCounting Mode = RefCounting::Atomic, bool Weak = false, size_t N = 4096>
+class PoolSharedAllocator final : public PoolSharedOwner<T, Mode, Weak> {
+public:
+    using Block = PoolSharedBlock<T, Mode, Weak>;
+    using Pointer = PoolShared<T, Mode, Weak>;
+
+    PoolSharedAllocator() = default;
+    PoolSharedAllocator(const PoolSharedAllocator&) = delete;
+    PoolSharedAllocator& operator=(const PoolSharedAllocator&) = delete;
+
+    template<typename... Args>
+    Pointer make(Args&&... args) {
+        Block* block = pool_.allocate(this);
+        if (!block) return {};
+        try {
+            new (block->storage) T(std::forward<Args>(args)...);
+        } catch (...) {
+            pool_.deallocate(block);
+            throw;
+        }
+        return Pointer(block);
+    }
+
+    void destroy_block(Block* block) override {
+        pool_.deallocate(block);
+    }
+
+    LockFreeFixedSizePool<Block, N>& get_pool() { return pool_; }
+
+private:
+    LockFreeFixedSizePool<Block, N> pool_;
+};
+
+template<typename T, RefCounting Mode, bool Weak, size_t N, typename... Args>
+PoolShared<T, Mode, Weak> make_pool_shared(PoolSharedAllocator<T, Mode, Weak, N>& allocator, Args&&... args) {
+    return allocator.make(std::forward<Args>(args)...);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+
+#include "MemoryPool.hpp"
+
+// 符合标准 Allocator 要求的适配器，可用于 std::vector、std::unordered_map、std::basic_string 等容器
+// 不持有内存池，内存池的生命周期必须长于使用它的容器
+template<typename T, typename Pool = LockFreeMultiSizePool>
+class PoolStdAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::false_type;
+
+    explicit PoolStdAllocator(Pool& pool) noexcept : pool_(&pool) {}
+
+    template<typename U>
+    PoolStdAllocator(const PoolStdAllocator<U, Pool>& other) noexcept : pool_(other.pool_) {}
+
+    T* allocate(size_t n) {
+        if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        void* ptr = pool_->allocate(bytes(n), alignof(T));
+        if (!ptr) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(ptr);
+    }
+
+    void deallocate(T* ptr, size_t n) noexcept {
+        pool_->deallocate(ptr, bytes(n), alignof(T));
+    }
+
+    Pool& get_pool() const noexcept { return *pool_; }
+
+    template<typename U>
+    bool operator==(const PoolStdAllocator<U, Pool>& other) const noexcept { return pool_ == other.pool_; }
+
+private:
+    template<typename U, typename P>
+    friend class PoolStdAllocator;
+
+    // 内存池不接受 0 字节的请求
+    static size_t bytes(size_t n) noexcept { return n > 0 ? n * sizeof(T) : sizeof(T); }
+
+    Pool* pool_;
+};
+
+// std::pmr 版本，可与 std::pmr 容器以及其他 memory_resource 组合使用
+template<typename Pool = LockFreeMultiSizePool>
+class MultiSizePoolResource : public std::pmr::memory_resource {
+public:
+    explicit MultiSizePoolResource(Pool& pool) noexcept : pool_(pool) {}
+
+    Pool& get_pool() const noexcept { return pool_; }
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        void* ptr = pool_.allocate(bytes > 0 ? bytes : 1, alignment);
+        if (!ptr) {
+            throw std::bad_alloc();
+        }
+        return ptr;
+    }
+
+    void do_deallocate(void* ptr, size_t bytes, size_t alignment) override {
+        pool_.deallocate(ptr, bytes > 0 ? bytes : 1, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        auto* resource = dynamic_cast<const MultiSizePoolResource*>(&other);
+        return resource && &resource->pool_ == &pool_;
+    }
+
+    Pool& pool_;
+};
@@ -0,0 +1,326 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "MemoryPool.hpp"
+#include "logger.hpp"
+
+// slab 缓存的统计信息，字段与 /proc/slabinfo 对应
+struct SlabInfo {
+    std::string name;
+    size_t object_size;
+    size_t objects_per_slab;
+    size_t colors;              // 不同的着色偏移数量
+    size_t active_objects;      // 已分配出去的对象
+    size_t total_objects;       // 所有 slab 中的对象（均已构造）
+    size_t full_slabs;
+    size_t partial_slabs;
+    size_t empty_slabs;
+};
+
+// 所有 slab 缓存的公共部分：名字和全局登记，便于统一查看和回收
+class SlabCacheBase {
+public:
+    SlabCacheBase(const SlabCacheBase&) = delete;
+    SlabCacheBase& operator=(const SlabCacheBase&) = delete;
+
+    const std::string& name() const { return name_; }
+
+    virtual SlabInfo info() const = 0;
+
+    // 释放所有空 slab（先对其中的对象调用析构回调），返回释放的字节数
+    virtual size_t shrink() = 0;
+
+    // 遍历当前存活的所有 slab 缓存，回调期间不能创建或销毁缓存
+    static void for_each(const std::function<void(SlabCacheBase&)>& fn) {
+        std::lock_guard<std::mutex> lock(registry_mutex());
+        for (SlabCacheBase* cache : registry()) fn(*cache);
+    }
+
+    // 回收所有缓存的空 slab，返回释放的字节数
+    static size_t shrink_all() {
+        size_t released = 0;
+        for_each([&](SlabCacheBase& cache) { released += cache.shrink(); });
+        return released;
+    }
+
+protected:
+    explicit SlabCacheBase(std::string name) : name_(std::move(name)) {
+        std::lock_guard<std::mutex> lock(registry_mutex());
+        registry().push_back(this);
+    }
+
+    ~SlabCacheBase() {
+        unregister_cache();
+    }
+
+    // 派生类析构一开始就调用，for_each 不会访问到析构了一半的缓存
+    void unregister_cache() {
+        std::lock_guard<std::mutex> lock(registry_mutex());
+        auto& caches = registry();
+        caches.erase(std::remove(caches.begin(), caches.end(), this), caches.end());
+    }
+
+private:
+    static std::mutex& registry_mutex() {
+        static std::mutex mtx;
+        return mtx;
+    }
+
+    static std::vector<SlabCacheBase*>& registry() {
+        static std::vector<SlabCacheBase*> caches;
+        return caches;
+    }
+
+    std::string name_;
+};
+
+template<typename T>
+struct SlabCacheOptions {
+    std::function<void(void*)> constructor;     // 在未初始化的存储上构造对象，为空时使用 T 的默认构造函数
+    std::function<void(T*)> destructor;         // 析构对象，为空时调用 ~T()
+    bool coloring = true;
+    size_t retain_empty_slabs = 1;              // 释放使空 slab 超过这个数量时立即回收多余的 slab
+};
+
+// 按对象类型创建的 slab 缓存（参考内核 kmem_cache）
+// slab 中的对象在 slab 创建时构造一次、在 slab 释放时析构一次：allocate 返回的是已构造的对象，
+// deallocate 时对象不析构，调用方应把它恢复到构造后的状态，适合构造代价高、长期存活的对象
+// 分配优先使用部分使用的 slab，其次是空 slab，最后才申请新的 slab
+// 同一缓存的各个 slab 中对象的起始偏移按缓存行错开（着色），避免所有 slab 的同号对象落在同一组缓存 set 上
+template<typename T, size_t SlabBytes = 16 * 1024>
+class SlabCache final : public SlabCacheBase {
+    static_assert(std::has_single_bit(SlabBytes), "slab size must be a power of two");
+
+public:
+    using Options = SlabCacheOptions<T>;
+
+private:
+    struct Slab {
+        SlabCache* cache;
+        ChunkRecord* chunk;
+        Slab* prev;
+        Slab* next;
+        std::byte* objects;
+        uint32_t in_use;
+        uint32_t free_top;      // free_stack 中的空闲对象数
+
+        // 空闲对象的序号栈紧跟在头部之后；对象保持构造状态，不能在对象体内存放链接
+        uint16_t* free_stack() { return reinterpret_cast<uint16_t*>(this + 1); }
+        T* object(size_t index) { return reinterpret_cast<T*>(objects + index * OBJECT_SIZE); }
+    };
+
+    struct SlabList {
+        Slab* head = nullptr;
+        size_t count = 0;
+
+        void push(Slab* slab) {
+            slab->prev = nullptr;
+            slab->next = head;
+            if (head) head->prev = slab;
+            head = slab;
+            ++count;
+        }
+
+        void remove(Slab* slab) {
+            if (slab->prev) slab->prev->next = slab->next;
+            else head = slab->next;
+            if (slab->next) slab->next->prev = slab->prev;
+            --count;
+        }
+    };
+
+    static constexpr size_t OBJECT_SIZE = sizeof(T);
+    static constexpr size_t COLOR_STEP = std::max(CACHE_LINE_SIZE, alignof(T));
+
+    static constexpr size_t header_bytes(size_t objects) {
+        return align_of(sizeof(Slab) + objects * sizeof(uint16_t), alignof(T));
+    }
+
+    static constexpr size_t max_objects() {
+        size_t objects = (SlabBytes - sizeof(Slab)) / (OBJECT_SIZE + sizeof(uint16_t));
+        while (objects > 0 && header_bytes(objects) + objects * OBJECT_SIZE > SlabBytes) --objects;
+        return std::min<size_t>(objects, UINT16_MAX);
+    }
+
+    static constexpr size_t OBJECTS_PER_SLAB = max_objects();
+    static_assert(OBJECTS_PER_SLAB > 0, "slab size is too small for this type");
+    static constexpr size_t HEADER_BYTES = header_bytes(OBJECTS_PER_SLAB);
+    // 放满对象后剩余的空间用来着色
+    static constexpr size_t COLORS = (SlabBytes - HEADER_BYTES - OBJECTS_PER_SLAB * OBJECT_SIZE) / COLOR_STEP + 1;
+
+    Options options;
+    ChunkRegistry chunks;
+    std::atomic<size_t> next_color{0};
+
+    mutable std::mutex mtx;
+    SlabList full;
+    SlabList partial;
+    SlabList empty;
+    size_t active = 0;
+
+    static Slab* slab_of(const T* ptr) {
+        return reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(ptr) & ~(SlabBytes - 1));
+    }
+
+    // 申请并初始化一个 slab，对所有对象调用构造回调；在锁外调用
+    Slab* create_slab() {
+        ChunkRecord* chunk = chunks.acquire(SlabBytes, OBJECTS_PER_SLAB, SlabBytes);
+        if (!chunk) return nullptr;
+        size_t color = options.coloring ? next_color.fetch_add(1, std::memory_order_relaxed) % COLORS : 0;
+        auto* slab = new (chunk->base) Slab{this, chunk, nullptr, nullptr,
+                                            chunk->base + HEADER_BYTES + color * COLOR_STEP, 0, 0};
+        size_t constructed = 0;
+        try {
+            for (; constructed < OBJECTS_PER_SLAB; ++constructed) {
+                if (options.constructor) {
+                    options.constructor(slab->object(constructed));
+                } else {
+                    new (slab->object(constructed)) T();
+                }
+            }
+        } catch (...) {
+            for (size_t i = 0; i < constructed; ++i) destroy_object(slab->object(i));
+            chunks.release(chunk, DecommitMode::DontNeed);
+            throw;
+        }
+        // 栈顶是 0 号对象，新 slab 从低地址开始分配
+        for (size_t i = 0; i < OBJECTS_PER_SLAB; ++i) {
+            slab->free_stack()[i] = static_cast<uint16_t>(OBJECTS_PER_SLAB - 1 - i);
+            MEMORYPOOL_ASAN_POISON(slab->object(i), sizeof(T));
+        }
+        slab->free_top = static_cast<uint32_t>(OBJECTS_PER_SLAB);
+        return slab;
+    }
+
+    void destroy_object(T* object) {
+        if (options.destructor) {
+            options.destructor(object);
+        } else {
+            object->~T();
+        }
+    }
+
+    // 析构 slab 中的所有对象并归还内存；在锁外调用
+    size_t destroy_slab(Slab* slab) {
+        for (size_t i = 0; i < OBJECTS_PER_SLAB; ++i) {
+            MEMORYPOOL_ASAN_UNPOISON(slab->object(i), sizeof(T));
+            destroy_object(slab->object(i));
+        }
+        return chunks.release(slab->chunk, DecommitMode::DontNeed);
+    }
+
+public:
+    explicit SlabCache(std::string name, Options opts = {}) : SlabCacheBase(std::move(name)), options(std::move(opts)) {}
+
+    ~SlabCache() {
+        unregister_cache();
+        if (active > 0) {
+            LOG_WARNING("slab cache {} destroyed with {} live objects", this->name(), active);
+        }
+        for (SlabList* list : {&full, &partial, &empty}) {
+            while (Slab* slab = list->head) {
+                list->remove(slab);
+                destroy_slab(slab);
+            }
+        }
+    }
+
+    T* allocate() {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (!partial.head && !empty.head) {
+            // 构造回调可能很慢，申请新 slab 时不持有锁
+            lock.unlock();
+            Slab* slab = create_slab();
+            lock.lock();
+            if (!slab) return nullptr;
+            empty.push(slab);
+        }
+
+        Slab* slab = partial.head ? partial.head : empty.head;
+        (slab->in_use == 0 ? empty : partial).remove(slab);
+        uint16_t index = slab->free_stack()[--slab->free_top];
+        ++slab->in_use;
+        (slab->free_top == 0 ? full : partial).push(slab);
+        ++active;
+
+        T* object = slab->object(index);
+        MEMORYPOOL_ASAN_UNPOISON(object, sizeof(T));
+        return object;
+    }
+
+    // 对象不析构，直接回到所属 slab 的空闲栈
+    void deallocate(T* object) {
+        if (!object) return;
+        Slab* slab = slab_of(object);
+        auto index = static_cast<uint16_t>((reinterpret_cast<std::byte*>(object) - slab->objects) / OBJECT_SIZE);
+
+        Slab* surplus = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+#if MEMORYPOOL_HARDENED
+            uint16_t* stack = slab->free_stack();
+            if (std::find(stack, stack + slab->free_top, index) != stack + slab->free_top) {
+                report_pool_error(PoolError::DoubleFree, object, sizeof(T));
+                return;
+            }
+#endif
+            (slab->free_top == 0 ? full : partial).remove(slab);
+            slab->free_stack()[slab->free_top++] = index;
+            --slab->in_use;
+            (slab->in_use == 0 ? empty : partial).push(slab);
+            --active;
+            MEMORYPOOL_ASAN_POISON(object, sizeof(T));
+
+            if (empty.count > options.retain_empty_slabs) {
+                // 回收最早变空的 slab，刚释放的那个仍可以马上复用
+                surplus = empty.head;
+                while (surplus->next) surplus = surplus->next;
+                empty.remove(surplus);
+            }
+        }
+        if (surplus) destroy_slab(surplus);
+    }
+
+    size_t shrink() override {
+        SlabList released;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            released = empty;
+            empty = {};
+        }
+        size_t bytes = 0;
+        while (Slab* slab = released.head) {
+            released.head = slab->next;
+            bytes += destroy_slab(slab);
+        }
+        return bytes;
+    }
+
+    SlabInfo info() const override {
+        std::lock_guard<std::mutex> lock(mtx);
+        size_t slabs = full.count + partial.count + empty.count;
+        return SlabInfo{this->name(), OBJECT_SIZE, OBJECTS_PER_SLAB, options.coloring ? COLORS : 1,
+                        active, slabs * OBJECTS_PER_SLAB, full.count, partial.count, empty.count};
+    }
+
+    // 由本缓存分配的对象找到所属缓存，PoolPtr 因此只需保存对象指针
+    static SlabCache* owner_of(const T* ptr) {
+        return slab_of(ptr)->cache;
+    }
+
+    static constexpr size_t objects_per_slab() { return OBJECTS_PER_SLAB; }
+    static constexpr size_t color_count() { return COLORS; }
+
+    size_t committed_bytes() const { return chunks.committed_bytes(); }
+};
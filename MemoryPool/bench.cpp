@@ -0,0 +1,419 @@
+// 并发分配器基准：LockFreeMultiSizePool 与 glibc malloc 在几类典型负载下的吞吐、延迟、RSS 与缺页
+// RSS 与缺页都是单次运行前后的差值，不包含同一进程中之前运行留下的内存
+//     memoryPoolBench [--threads N] [--ops N] [--workload 名称] [--allocator 名称] [--json 文件] [--label 标签]
+// 线程数从 1 按 2 的幂增长到 N（默认为 CPU 数）；--json 每个结果写一行 JSON，便于在提交之间比较
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <latch>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "MemoryPool.hpp"
+#include "logger.hpp"
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // 每 LATENCY_SAMPLE_PERIOD 次操作计时一次，计时本身的开销不计入吞吐的主体
+    constexpr uint32_t LATENCY_SAMPLE_PERIOD = 8;
+
+    struct MallocBackend {
+        static constexpr const char* NAME = "malloc";
+        void* allocate(size_t size) { return std::malloc(size); }
+        void deallocate(void* ptr, size_t) { std::free(ptr); }
+    };
+
+    struct PoolBackend {
+        static constexpr const char* NAME = "pool";
+        LockFreeMultiSizePool pool;
+        void* allocate(size_t size) { return pool.allocate(size); }
+        void deallocate(void* ptr, size_t size) { pool.deallocate(ptr, size); }
+    };
+
+    struct PerCpuPoolBackend {
+        static constexpr const char* NAME = "pool-percpu";
+        LockFreeMultiSizePool pool{RetentionPolicy{}, PageBacking::Standard, CacheMode::PerCpu};
+        void* allocate(size_t size) { return pool.allocate(size); }
+        void deallocate(void* ptr, size_t size) { pool.deallocate(ptr, size); }
+    };
+
+    // 单个线程的计时与计数
+    struct ThreadStats {
+        uint64_t ops = 0;
+        std::vector<uint32_t> latencies;    // 纳秒
+        // 负载结束时的快照，之后清理剩余对象的操作不计入结果
+        uint64_t measured_ops = 0;
+        size_t measured_samples = 0;
+    };
+
+    // 包一层分配器，按采样周期记录单次操作的耗时
+    template<typename Backend>
+    class Timed {
+    public:
+        Timed(Backend& backend, ThreadStats& stats) : backend(backend), stats(stats) {}
+
+        void* allocate(size_t size) {
+            if (++stats.ops % LATENCY_SAMPLE_PERIOD != 0) return touch(backend.allocate(size));
+            auto start = Clock::now();
+            void* ptr = backend.allocate(size);
+            record(start);
+            return touch(ptr);
+        }
+
+        void deallocate(void* ptr, size_t size) {
+            if (!ptr) return;
+            if (++stats.ops % LATENCY_SAMPLE_PERIOD != 0) {
+                backend.deallocate(ptr, size);
+                return;
+            }
+            auto start = Clock::now();
+            backend.deallocate(ptr, size);
+            record(start);
+        }
+
+    private:
+        // 写第一个字节，缺页计入负载
+        static void* touch(void* ptr) {
+            if (ptr) *static_cast<volatile char*>(ptr) = 1;
+            return ptr;
+        }
+
+        void record(Clock::time_point start) {
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+            stats.latencies.push_back(static_cast<uint32_t>(std::min<int64_t>(ns, UINT32_MAX)));
+        }
+
+        Backend& backend;
+        ThreadStats& stats;
+    };
+
+    struct Allocation {
+        void* ptr = nullptr;
+        size_t size = 0;
+    };
+
+    // 所有线程共享的运行环境：负载结束后等主线程测量完 RSS 再释放剩余对象
+    struct RunContext {
+        size_t threads;
+        size_t ops_per_thread;
+        std::latch start;
+        std::latch finished;
+        std::latch measured{1};
+
+        RunContext(size_t t, size_t ops) : threads(t), ops_per_thread(ops), start(1), finished(static_cast<ptrdiff_t>(t)) {}
+
+        // 负载结束：通知主线程并等待测量完成
+        void done(ThreadStats& stats) {
+            stats.measured_ops = stats.ops;
+            stats.measured_samples = stats.latencies.size();
+            finished.count_down();
+            measured.wait();
+        }
+    };
+
+    // larson：服务器式的随机替换，每轮结束后把自己的对象交给下一个线程释放
+    template<typename Backend>
+    void larson(Backend& backend, RunContext& ctx, size_t thread, ThreadStats& stats,
+                std::vector<std::vector<Allocation>>& handoff, std::vector<std::mutex>& handoff_mtx) {
+        constexpr size_t SLOTS = 1000;
+        constexpr size_t ROUNDS = 8;
+        Timed<Backend> alloc(backend, stats);
+        std::mt19937 rng(static_cast<uint32_t>(thread));
+        std::vector<Allocation> slots(SLOTS);
+        ctx.start.wait();
+        size_t per_round = ctx.ops_per_thread / 2 / ROUNDS;
+        for (size_t round = 0; round < ROUNDS; ++round) {
+            for (size_t i = 0; i < per_round; ++i) {
+                auto& slot = slots[rng() % SLOTS];
+                alloc.deallocate(slot.ptr, slot.size);
+                slot.size = 16 + rng() % 497;
+                slot.ptr = alloc.allocate(slot.size);
+            }
+            // 与下一个线程交换对象集合，之后释放的是别的线程分配的对象
+            size_t next = (thread + 1) % ctx.threads;
+            std::lock_guard<std::mutex> lock(handoff_mtx[next]);
+            std::swap(slots, handoff[next]);
+            if (slots.empty()) slots.resize(SLOTS);
+        }
+        ctx.done(stats);
+        for (auto& slot : slots) alloc.deallocate(slot.ptr, slot.size);
+    }
+
+    // 单生产者单消费者环形队列，用于跨线程释放
+    class SpscRing {
+    public:
+        explicit SpscRing(size_t capacity) : items(capacity) {}
+
+        bool push(const Allocation& item) {
+            size_t tail = write.load(std::memory_order_relaxed);
+            if (tail - read.load(std::memory_order_acquire) == items.size()) return false;
+            items[tail % items.size()] = item;
+            write.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool pop(Allocation& item) {
+            size_t head = read.load(std::memory_order_relaxed);
+            if (head == write.load(std::memory_order_acquire)) return false;
+            item = items[head % items.size()];
+            read.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+    private:
+        std::vector<Allocation> items;
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> write{0};
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> read{0};
+    };
+
+    // 生产者/消费者：偶数线程分配，奇数线程释放；单线程时自己消费自己
+    template<typename Backend>
+    void producer_consumer(Backend& backend, RunContext& ctx, size_t thread, ThreadStats& stats,
+                           std::vector<std::unique_ptr<SpscRing>>& rings) {
+        Timed<Backend> alloc(backend, stats);
+        std::mt19937 rng(static_cast<uint32_t>(thread));
+        size_t pairs = std::max<size_t>(ctx.threads / 2, 1);
+        bool solo = ctx.threads == 1;
+        bool producer = solo || thread % 2 == 0;
+        SpscRing* ring = thread / 2 < pairs ? rings[thread / 2].get() : nullptr;
+        size_t items = ctx.ops_per_thread / 2;
+        ctx.start.wait();
+        if (ring && producer) {
+            for (size_t i = 0; i < items; ++i) {
+                Allocation item{nullptr, size_t(16) << (rng() % 6)};
+                item.ptr = alloc.allocate(item.size);
+                while (!ring->push(item)) {
+                    if (!solo) {
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    Allocation old;
+                    if (ring->pop(old)) alloc.deallocate(old.ptr, old.size);
+                }
+            }
+        } else if (ring) {
+            Allocation item;
+            for (size_t i = 0; i < items;) {
+                if (ring->pop(item)) {
+                    alloc.deallocate(item.ptr, item.size);
+                    ++i;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        }
+        ctx.done(stats);
+        if (ring && solo) {
+            Allocation item;
+            while (ring->pop(item)) alloc.deallocate(item.ptr, item.size);
+        }
+    }
+
+    // 随机大小混合：70% 16~128B，25% 128B~1K，5% 1K~64K（走页堆）
+    template<typename Backend>
+    void random_sizes(Backend& backend, RunContext& ctx, size_t thread, ThreadStats& stats) {
+        constexpr size_t SLOTS = 4096;
+        Timed<Backend> alloc(backend, stats);
+        std::mt19937 rng(static_cast<uint32_t>(thread) * 7919);
+        std::vector<Allocation> slots(SLOTS);
+        auto pick_size = [&] {
+            uint32_t bucket = rng() % 100;
+            if (bucket < 70) return size_t(16 + rng() % 113);
+            if (bucket < 95) return size_t(128 + rng() % 897);
+            return size_t(1024 + rng() % (63 * 1024));
+        };
+        ctx.start.wait();
+        for (size_t i = 0; i < ctx.ops_per_thread / 2; ++i) {
+            auto& slot = slots[rng() % SLOTS];
+            alloc.deallocate(slot.ptr, slot.size);
+            slot.size = pick_size();
+            slot.ptr = alloc.allocate(slot.size);
+        }
+        ctx.done(stats);
+        for (auto& slot : slots) alloc.deallocate(slot.ptr, slot.size);
+    }
+
+    // 对象寿命分布：多数对象很快死亡（平均 64 次操作），约 5% 长期存活（平均 16K 次操作）
+    // 时间轮按到期时刻释放
+    template<typename Backend>
+    void lifetimes(Backend& backend, RunContext& ctx, size_t thread, ThreadStats& stats) {
+        constexpr size_t WHEEL = 1 << 16;
+        Timed<Backend> alloc(backend, stats);
+        std::mt19937 rng(static_cast<uint32_t>(thread) * 104729);
+        std::exponential_distribution<double> short_lived(1.0 / 64);
+        std::exponential_distribution<double> long_lived(1.0 / 16384);
+        std::vector<std::vector<Allocation>> wheel(WHEEL);
+        ctx.start.wait();
+        size_t tick = 0;
+        for (size_t done = 0; done < ctx.ops_per_thread; ++tick) {
+            auto& due = wheel[tick % WHEEL];
+            for (auto& item : due) alloc.deallocate(item.ptr, item.size);
+            done += due.size();
+            due.clear();
+
+            Allocation item{nullptr, size_t(16 + rng() % 241)};
+            item.ptr = alloc.allocate(item.size);
+            ++done;
+            double life = rng() % 100 < 5 ? long_lived(rng) : short_lived(rng);
+            size_t expire = tick + 1 + std::min<size_t>(static_cast<size_t>(life), WHEEL - 2);
+            wheel[expire % WHEEL].push_back(item);
+        }
+        ctx.done(stats);
+        for (auto& slot : wheel) {
+            for (auto& item : slot) alloc.deallocate(item.ptr, item.size);
+        }
+    }
+
+    struct Usage {
+        uint64_t minor_faults;
+        uint64_t major_faults;
+    };
+
+    Usage current_usage() {
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return Usage{static_cast<uint64_t>(usage.ru_minflt), static_cast<uint64_t>(usage.ru_majflt)};
+    }
+
+    struct Result {
+        std::string workload;
+        std::string allocator;
+        size_t threads;
+        uint64_t ops;
+        double seconds;
+        uint32_t p50;
+        uint32_t p99;
+        uint32_t p999;
+        int64_t rss_delta_kib;     // 负载期间 RSS 的增量，释放多于新增时为负
+        uint64_t minor_faults;
+        uint64_t major_faults;
+    };
+
+    uint32_t percentile(const std::vector<uint32_t>& sorted, double p) {
+        if (sorted.empty()) return 0;
+        return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * static_cast<double>(sorted.size())))];
+    }
+
+    template<typename Backend>
+    Result run(const std::string& workload, size_t threads, size_t ops_per_thread) {
+        auto backend = std::make_unique<Backend>();
+        RunContext ctx(threads, ops_per_thread);
+        std::vector<ThreadStats> stats(threads);
+        for (auto& s : stats) s.latencies.reserve(ops_per_thread / LATENCY_SAMPLE_PERIOD + 16);
+
+        std::vector<std::vector<Allocation>> handoff(threads);
+        std::vector<std::mutex> handoff_mtx(threads);
+        std::vector<std::unique_ptr<SpscRing>> rings;
+        for (size_t i = 0; i < std::max<size_t>(threads / 2, 1); ++i) rings.push_back(std::make_unique<SpscRing>(1024));
+
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                if (workload == "larson") larson(*backend, ctx, t, stats[t], handoff, handoff_mtx);
+                else if (workload == "prodcons") producer_consumer(*backend, ctx, t, stats[t], rings);
+                else if (workload == "random") random_sizes(*backend, ctx, t, stats[t]);
+                else lifetimes(*backend, ctx, t, stats[t]);
+            });
+        }
+
+        // 线程与计时缓冲都已就绪，此后 RSS 的变化来自负载本身
+        size_t rss_before = os_memory::resident_bytes();
+        Usage before = current_usage();
+        auto start = Clock::now();
+        ctx.start.count_down();
+        ctx.finished.wait();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        Usage after = current_usage();
+        size_t rss_after = os_memory::resident_bytes();
+        ctx.measured.count_down();
+        for (auto& worker : workers) worker.join();
+
+        // 交换后留在 handoff 中的对象由主线程释放
+        for (auto& slots : handoff) {
+            for (auto& slot : slots) {
+                if (slot.ptr) backend->deallocate(slot.ptr, slot.size);
+            }
+        }
+
+        std::vector<uint32_t> latencies;
+        uint64_t ops = 0;
+        for (auto& s : stats) {
+            ops += s.measured_ops;
+            latencies.insert(latencies.end(), s.latencies.begin(), s.latencies.begin() + static_cast<ptrdiff_t>(s.measured_samples));
+        }
+        std::sort(latencies.begin(), latencies.end());
+        return Result{workload, Backend::NAME, threads, ops, seconds,
+                      percentile(latencies, 0.50), percentile(latencies, 0.99), percentile(latencies, 0.999),
+                      (static_cast<int64_t>(rss_after) - static_cast<int64_t>(rss_before)) / 1024, after.minor_faults - before.minor_faults, after.major_faults - before.major_faults};
+    }
+
+    std::string to_json(const Result& r, const std::string& label) {
+        return std::format(R"({{"label":"{}","workload":"{}","allocator":"{}","threads":{},"ops":{},"seconds":{:.6f},)"
+                           R"("ops_per_sec":{:.0f},"p50_ns":{},"p99_ns":{},"p999_ns":{},"rss_delta_kib":{},"minor_faults":{},"major_faults":{}}})",
+                           label, r.workload, r.allocator, r.threads, r.ops, r.seconds, static_cast<double>(r.ops) / r.seconds,
+                           r.p50, r.p99, r.p999, r.rss_delta_kib, r.minor_faults, r.major_faults);
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t ops = 400000;
+    std::string only_workload;
+    std::string only_allocator;
+    std::string json_path;
+    std::string label = "default";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        std::string value = argv[i + 1];
+        if (flag == "--threads") max_threads = std::max<size_t>(1, std::stoul(value));
+        else if (flag == "--ops") ops = std::stoul(value);
+        else if (flag == "--workload") only_workload = value;
+        else if (flag == "--allocator") only_allocator = value;
+        else if (flag == "--json") json_path = value;
+        else if (flag == "--label") label = value;
+        else LOG_WARNING("unknown option {}", flag);
+    }
+
+    std::vector<size_t> thread_counts;
+    for (size_t t = 1; t < max_threads; t *= 2) thread_counts.push_back(t);
+    thread_counts.push_back(max_threads);
+
+    std::ofstream json;
+    if (!json_path.empty()) json.open(json_path, std::ios::app);
+
+    using Runner = std::function<Result(const std::string&, size_t, size_t)>;
+    std::vector<std::pair<std::string, Runner>> allocators = {
+        {MallocBackend::NAME, run<MallocBackend>},
+        {PoolBackend::NAME, run<PoolBackend>},
+    };
+    if (percpu::available()) allocators.emplace_back(PerCpuPoolBackend::NAME, run<PerCpuPoolBackend>);
+
+    LOG_INFO("{:<9} {:<12} {:>7} {:>12} {:>7} {:>7} {:>8} {:>9} {:>9}",
+             "workload", "allocator", "threads", "ops/s", "p50ns", "p99ns", "p999ns", "dRSS KiB", "minflt");
+    for (const char* workload : {"larson", "prodcons", "random", "lifetime"}) {
+        if (!only_workload.empty() && only_workload != workload) continue;
+        for (size_t threads : thread_counts) {
+            for (auto& [name, runner] : allocators) {
+                if (!only_allocator.empty() && only_allocator != name) continue;
+                Result r = runner(workload, threads, ops);
+                LOG_INFO("{:<9} {:<12} {:>7} {:>12.0f} {:>7} {:>7} {:>8} {:>9} {:>9}",
+                         r.workload, r.allocator, r.threads, static_cast<double>(r.ops) / r.seconds,
+                         r.p50, r.p99, r.p999, r.rss_delta_kib, r.minor_faults);
+                if (json.is_open()) json << to_json(r, label) << '\n';
+            }
+        }
+    }
+    return 0;
+}
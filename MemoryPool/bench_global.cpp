@@ -0,0 +1,75 @@
+// 全局分配器替换模式的基准：同一份代码分别以 glibc malloc、memoryPoolNew（链接替换 operator new）
+// 和 LD_PRELOAD=libmemoryPoolMalloc.so 三种方式运行，对比耗时
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "logger.hpp"
+
+namespace {
+    // 典型的 STL 容器负载：字符串拼接、vector 扩容、map/unordered_map 插入删除
+    size_t container_workload(int seed, int iterations) {
+        std::mt19937 rng(seed);
+        std::map<int, std::string> ordered;
+        std::unordered_map<int, std::vector<int>> hashed;
+        size_t checksum = 0;
+        for (int i = 0; i < iterations; ++i) {
+            int key = static_cast<int>(rng() % 4096);
+            std::string value(16 + rng() % 200, 'x');
+            ordered[key] = std::move(value);
+            hashed[key].push_back(i);
+            if (i % 3 == 0) {
+                ordered.erase(static_cast<int>(rng() % 4096));
+                hashed.erase(static_cast<int>(rng() % 4096));
+            }
+        }
+        for (auto& [key, value] : ordered) checksum += value.size();
+        return checksum + hashed.size();
+    }
+
+    // malloc/free 直接调用，大小在 16B ~ 64K 之间对数分布
+    size_t malloc_workload(int seed, int iterations) {
+        std::mt19937 rng(seed);
+        std::vector<void*> live(256, nullptr);
+        size_t checksum = 0;
+        for (int i = 0; i < iterations; ++i) {
+            auto& slot = live[rng() % live.size()];
+            std::free(slot);
+            size_t size = size_t(16) << (rng() % 13);
+            slot = std::malloc(size);
+            static_cast<char*>(slot)[0] = 1;
+            checksum += size;
+        }
+        for (void* ptr : live) std::free(ptr);
+        return checksum;
+    }
+
+    template<typename Workload>
+    long long run(Workload workload, int num_threads, int iterations) {
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<std::thread> threads;
+        std::vector<size_t> results(num_threads);
+        for (int t = 0; t < num_threads; ++t) {
+            threads.emplace_back([&, t] { results[t] = workload(t, iterations); });
+        }
+        for (auto& th : threads) th.join();
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::high_resolution_clock::now() - start).count();
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* label = argc > 1 ? argv[1] : "default";
+    constexpr int NUM_THREADS = 4;
+    constexpr int ITERATIONS = 200000;
+
+    LOG_INFO("Global allocator benchmark [{}], {} threads x {} ops:", label, NUM_THREADS, ITERATIONS);
+    LOG_INFO("  containers: {} us", run(container_workload, NUM_THREADS, ITERATIONS));
+    LOG_INFO("  malloc/free: {} us", run(malloc_workload, NUM_THREADS, ITERATIONS));
+    return 0;
+}
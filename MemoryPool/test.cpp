@@ -5,9 +5,30 @@
 #include <string>
 #include <atomic>
 #include <random>
-#include <cstring> 
+#include <cstring>
+#include <cmath>
+#include <latch>
+#include <algorithm>
+#include <memory_resource>
+#include <map>
+#include <list>
+#include <unordered_map>
+#include <optional>
+#include <queue>
+#include <shared_mutex>
+#include <stack>
+
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "MemoryPool.hpp"
+#include "EpochReclaim.hpp"
+#include "LockFreeContainers.hpp"
+#include "MonotonicArena.hpp"
+#include "ObjectPool.hpp"
+#include "PoolShared.hpp"
+#include "PoolStdAllocator.hpp"
+#include "SlabCache.hpp"
 #include "logger.hpp"
 #include "threadpool.hpp"
 
@@ -126,6 +147,1865 @@ TEST(MemoryPoolTest, multisizePool) {
     //allocator.print_stats();
 }
 
+TEST(MemoryPoolTest, TrimReleasesEmptyChunks) {
+    constexpr int NUM_ALLOCATIONS = 200000;
+    constexpr size_t OBJECT_SIZE = 64;
+    RetentionPolicy policy;
+    policy.retain_empty_chunks = 0;
+    LockFreeMultiSizePool pool(policy);
+
+    size_t rss_start = os_memory::resident_bytes();
+    std::vector<void*> ptrs;
+    ptrs.reserve(NUM_ALLOCATIONS);
+    for (int i = 0; i < NUM_ALLOCATIONS; ++i) {
+        void* ptr = pool.allocate(OBJECT_SIZE);
+        ASSERT_NE(ptr, nullptr);
+        std::memset(ptr, 0xab, OBJECT_SIZE);
+        ptrs.push_back(ptr);
+    }
+    size_t rss_peak = os_memory::resident_bytes();
+    size_t committed_peak = pool.committed_bytes();
+
+    for (void* ptr : ptrs) {
+        pool.deallocate(ptr, OBJECT_SIZE);
+    }
+    size_t released = pool.trim();
+    size_t rss_after = os_memory::resident_bytes();
+
+    LOG_INFO("RSS start: {} KiB, peak: {} KiB, after trim: {} KiB, released: {} KiB",
+        rss_start / 1024, rss_peak / 1024, rss_after / 1024, released / 1024);
+    EXPECT_EQ(released, committed_peak);
+    EXPECT_EQ(pool.committed_bytes(), 0u);
+    EXPECT_LT(rss_after, rss_peak);
+
+    // decommit 之后的 chunk 可以被重新使用
+    size_t chunks = pool.chunk_count();
+    for (int i = 0; i < 1000; ++i) {
+        ptrs[i] = pool.allocate(OBJECT_SIZE);
+        std::memset(ptrs[i], 0xcd, OBJECT_SIZE);
+    }
+    EXPECT_EQ(pool.chunk_count(), chunks);
+    for (int i = 0; i < 1000; ++i) {
+        pool.deallocate(ptrs[i], OBJECT_SIZE);
+    }
+}
+
+TEST(MemoryPoolTest, FixedPoolBackgroundTrim) {
+    RetentionPolicy policy;
+    policy.retain_empty_chunks = 0;
+    policy.trim_interval = std::chrono::milliseconds(10);
+    LockFreeFixedSizePool<std::array<char, 48>> pool(policy);
+
+    std::vector<std::array<char, 48>*> ptrs;
+    for (int i = 0; i < 50000; ++i) {
+        ptrs.push_back(pool.allocate());
+    }
+    size_t committed_peak = pool.committed_bytes();
+    for (auto* ptr : ptrs) {
+        pool.deallocate(ptr);
+    }
+
+    // 后台线程无法回收当前线程缓存中的块，只要求大部分 chunk 被释放
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (pool.committed_bytes() > committed_peak / 10 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_LE(pool.committed_bytes(), committed_peak / 10);
+
+    pool.trim();
+    EXPECT_EQ(pool.committed_bytes(), 0u);
+}
+
+struct ChaseNode {
+    ChaseNode* next = nullptr;
+    char payload[56];
+};
+
+TEST(MemoryPoolTest, HugePagePointerChase) {
+    constexpr size_t NUM_NODES = 1 << 20;
+    constexpr size_t NUM_HOPS = 2 * NUM_NODES;
+
+    // 随机顺序串联节点，每一跳几乎都落在不同的页上
+    auto chase = [&](PageBacking backing) {
+        LockFreeFixedSizePool<ChaseNode, 64 * 1024> pool({}, backing);
+        std::vector<ChaseNode*> nodes(NUM_NODES);
+        for (auto& node : nodes) {
+            node = pool.allocate();
+        }
+        std::mt19937 gen(42);
+        std::shuffle(nodes.begin(), nodes.end(), gen);
+        for (size_t i = 0; i < NUM_NODES; ++i) {
+            nodes[i]->next = nodes[(i + 1) % NUM_NODES];
+        }
+
+        ChaseNode* current = nodes[0];
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < NUM_HOPS; ++i) {
+            current = current->next;
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        EXPECT_EQ(current, nodes[0]);
+
+        for (auto* node : nodes) {
+            pool.deallocate(node);
+        }
+        return std::chrono::duration<double, std::nano>(end - start).count() / NUM_HOPS;
+    };
+
+    LOG_INFO("Pointer chase 4K pages: {:.2f} ns/hop", chase(PageBacking::Standard));
+    LOG_INFO("Pointer chase transparent huge pages: {:.2f} ns/hop", chase(PageBacking::TransparentHugePages));
+    LOG_INFO("Pointer chase MAP_HUGETLB: {:.2f} ns/hop", chase(PageBacking::HugeTLB));
+}
+
+TEST(MemoryPoolTest, MonotonicArena) {
+    LockFreeMultiSizePool upstream;
+    MonotonicArena arena(256, &upstream);
+
+    auto* a = arena.create<int>(1);
+    auto* b = static_cast<std::byte*>(arena.allocate(100, 64));
+    EXPECT_EQ(*a, 1);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(b) % 64, 0u);
+
+    // 超过 chunk 大小的请求单独占用一个 chunk
+    void* big = arena.allocate(10000);
+    std::memset(big, 0, 10000);
+    size_t chunks = arena.chunk_count();
+
+    {
+        ScopedArena scope(arena);
+        for (int i = 0; i < 100; ++i) {
+            scope.arena().allocate(32);
+        }
+    }
+    // reset 之后复用已有的 chunk，不再申请新内存
+    arena.reset();
+    EXPECT_EQ(arena.create<int>(2), a);
+    for (int i = 0; i < 100; ++i) {
+        arena.allocate(32);
+    }
+    size_t chunks_after = arena.chunk_count();
+    arena.reset();
+    for (int i = 0; i < 100; ++i) {
+        arena.allocate(32);
+    }
+    EXPECT_EQ(arena.chunk_count(), chunks_after);
+    EXPECT_GE(chunks_after, chunks);
+
+    ArenaMemoryResource resource(arena);
+    std::pmr::vector<std::pmr::string> names(&resource);
+    for (int i = 0; i < 100; ++i) {
+        names.emplace_back("arena allocated string number " + std::to_string(i));
+    }
+    EXPECT_EQ(names[42], "arena allocated string number 42");
+
+    // 溢出的请求直接失败，pmr 接口抛出 bad_alloc
+    MonotonicArena fresh;
+    EXPECT_EQ(fresh.allocate(SIZE_MAX - 100), nullptr);
+    EXPECT_EQ(fresh.allocate(SIZE_MAX - 100, 4096), nullptr);
+    ArenaMemoryResource fresh_resource(fresh);
+    EXPECT_THROW((void)fresh_resource.allocate(SIZE_MAX - 100), std::bad_alloc);
+}
+
+TEST(MemoryPoolTest, MonotonicArenaPerformance) {
+    constexpr int NUM_REQUESTS = 2000;
+    constexpr int OBJECTS_PER_REQUEST = 256;
+    std::vector<size_t> sizes(OBJECTS_PER_REQUEST);
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<size_t> dis(16, 128);
+    for (auto& size : sizes) {
+        size = dis(gen);
+    }
+    std::vector<void*> ptrs(OBJECTS_PER_REQUEST);
+
+    // 每个请求分配一批对象，请求结束后全部释放
+    auto test_new_delete = [&]() {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int r = 0; r < NUM_REQUESTS; ++r) {
+            for (int i = 0; i < OBJECTS_PER_REQUEST; ++i) {
+                ptrs[i] = ::operator new(sizes[i]);
+            }
+            for (int i = 0; i < OBJECTS_PER_REQUEST; ++i) {
+                ::operator delete(ptrs[i]);
+            }
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    };
+
+    auto test_multi_pool = [&]() {
+        LockFreeMultiSizePool pool;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int r = 0; r < NUM_REQUESTS; ++r) {
+            for (int i = 0; i < OBJECTS_PER_REQUEST; ++i) {
+                ptrs[i] = pool.allocate(sizes[i]);
+            }
+            for (int i = 0; i < OBJECTS_PER_REQUEST; ++i) {
+                pool.deallocate(ptrs[i], sizes[i]);
+            }
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    };
+
+    auto test_arena = [&]() {
+        MonotonicArena arena;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int r = 0; r < NUM_REQUESTS; ++r) {
+            for (int i = 0; i < OBJECTS_PER_REQUEST; ++i) {
+                ptrs[i] = arena.allocate(sizes[i]);
+            }
+            arena.reset();
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    };
+
+    LOG_INFO("new/delete per-request time: {} microseconds", test_new_delete().count());
+    LOG_INFO("Multi size pool per-request time: {} microseconds", test_multi_pool().count());
+    LOG_INFO("Monotonic arena per-request time: {} microseconds", test_arena().count());
+}
+
+struct alignas(64) OverAligned {
+    int value;
+};
+
+TEST(MemoryPoolTest, StdAllocatorAdapters) {
+    LockFreeMultiSizePool pool;
+
+    PoolStdAllocator<int> int_alloc(pool);
+    std::vector<int, PoolStdAllocator<int>> numbers(int_alloc);
+    for (int i = 0; i < 10000; ++i) {
+        numbers.push_back(i);
+    }
+    EXPECT_EQ(numbers[9999], 9999);
+
+    using PoolString = std::basic_string<char, std::char_traits<char>, PoolStdAllocator<char>>;
+    using PoolMap = std::unordered_map<int, PoolString, std::hash<int>, std::equal_to<int>,
+        PoolStdAllocator<std::pair<const int, PoolString>>>;
+    PoolMap names(16, std::hash<int>(), std::equal_to<int>(), PoolStdAllocator<std::pair<const int, PoolString>>(pool));
+    for (int i = 0; i < 1000; ++i) {
+        names.emplace(i, PoolString("a string long enough to leave SSO " + std::to_string(i), PoolStdAllocator<char>(pool)));
+    }
+    EXPECT_EQ(names.at(500), "a string long enough to leave SSO 500");
+
+    std::vector<OverAligned, PoolStdAllocator<OverAligned>> aligned{PoolStdAllocator<OverAligned>(pool)};
+    for (int i = 0; i < 100; ++i) {
+        aligned.push_back(OverAligned{i});
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(aligned.data()) % alignof(OverAligned), 0u);
+    }
+
+    MultiSizePoolResource resource(pool);
+    std::pmr::map<int, std::pmr::string> pmr_map(&resource);
+    for (int i = 0; i < 1000; ++i) {
+        pmr_map.emplace(i, "pmr string value that is not small " + std::to_string(i));
+    }
+    EXPECT_EQ(pmr_map.at(999), "pmr string value that is not small 999");
+    void* page = resource.allocate(256, 4096);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(page) % 4096, 0u);
+    resource.deallocate(page, 256, 4096);
+}
+
+TEST(MemoryPoolTest, NodeContainerPerformance) {
+    constexpr int NUM_ELEMENTS = 100000;
+
+    auto run = [&](auto alloc) {
+        using Traits = std::allocator_traits<decltype(alloc)>;
+        using PairAlloc = typename Traits::template rebind_alloc<std::pair<const int, int>>;
+        using IntAlloc = typename Traits::template rebind_alloc<int>;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        {
+            std::map<int, int, std::less<int>, PairAlloc> map{PairAlloc(alloc)};
+            for (int i = 0; i < NUM_ELEMENTS; ++i) {
+                map.emplace(i * 7 % NUM_ELEMENTS, i);
+            }
+        }
+        auto map_end = std::chrono::high_resolution_clock::now();
+        {
+            std::list<int, IntAlloc> list{IntAlloc(alloc)};
+            for (int i = 0; i < NUM_ELEMENTS; ++i) {
+                list.push_back(i);
+            }
+        }
+        auto list_end = std::chrono::high_resolution_clock::now();
+        {
+            std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, PairAlloc> hash(16, std::hash<int>(), std::equal_to<int>(), PairAlloc(alloc));
+            for (int i = 0; i < NUM_ELEMENTS; ++i) {
+                hash.emplace(i, i);
+            }
+        }
+        auto hash_end = std::chrono::high_resolution_clock::now();
+        auto us = [](auto d) { return std::chrono::duration_cast<std::chrono::microseconds>(d).count(); };
+        return std::array<long long, 3>{us(map_end - start), us(list_end - map_end), us(hash_end - list_end)};
+    };
+
+    auto std_times = run(std::allocator<int>());
+    LockFreeMultiSizePool pool;
+    auto pool_times = run(PoolStdAllocator<int>(pool));
+
+    LOG_INFO("std::allocator  map: {} us, list: {} us, unordered_map: {} us", std_times[0], std_times[1], std_times[2]);
+    LOG_INFO("PoolStdAllocator map: {} us, list: {} us, unordered_map: {} us", pool_times[0], pool_times[1], pool_times[2]);
+}
+
+template<typename Policy>
+void check_size_class_map() {
+    using Map = SizeClassMap<Policy>;
+    // 查表得到的是第一个不小于 size 的大小类
+    for (size_t size = 1; size <= Map::MAX_SIZE; ++size) {
+        size_t index = Map::index(size);
+        ASSERT_LT(index, Map::COUNT);
+        EXPECT_GE(Policy::CLASSES[index], size);
+        if (index > 0) {
+            EXPECT_LT(Policy::CLASSES[index - 1], size);
+        }
+    }
+    EXPECT_EQ(Map::index(Map::MAX_SIZE + 1), Map::COUNT);
+}
+
+TEST(MemoryPoolTest, SizeClassPolicies) {
+    using Jemalloc = JemallocSizeClasses<>;
+    using Geometric = GeometricSizeClasses<32, 64 * 1024, 2>;
+    using Custom = CustomSizeClasses<64, 256, 4096, 8192>;
+    // 每翻一倍分 3 档，步长除不尽 8
+    using Thirds = GeometricSizeClasses<16, 8192, 3>;
+    static_assert(Jemalloc::CLASSES.front() == 8 && Jemalloc::CLASSES.back() == 16 * 1024);
+    static_assert(Geometric::CLASSES.front() == 32 && Geometric::CLASSES.back() == 64 * 1024);
+    static_assert(Thirds::CLASSES.front() == 16 && Thirds::CLASSES.back() == 8192);
+    static_assert(SizeClassMap<DefaultSizeClasses>::index(2048) == 15);
+
+    check_size_class_map<DefaultSizeClasses>();
+    check_size_class_map<Jemalloc>();
+    check_size_class_map<Geometric>();
+    check_size_class_map<Thirds>();
+    check_size_class_map<Custom>();
+
+    // 2.5k~8k 的消息对象落在大小类中，而不是 aligned_alloc
+    BasicMultiSizePool<Jemalloc> pool;
+    std::vector<std::pair<void*, size_t>> messages;
+    for (size_t size = 2560; size <= 8192; size += 256) {
+        void* ptr = pool.allocate(size);
+        ASSERT_NE(ptr, nullptr);
+        std::memset(ptr, 0x5a, size);
+        messages.emplace_back(ptr, size);
+    }
+    EXPECT_GT(pool.chunk_count(), 0u);
+    for (auto& [ptr, size] : messages) {
+        pool.deallocate(ptr, size);
+    }
+
+    BasicMultiSizePool<Custom> custom;
+    void* ptr = custom.allocate(5000);
+    std::memset(ptr, 0, 5000);
+    custom.deallocate(ptr, 5000);
+    EXPECT_EQ(custom.chunk_count(), 1u);
+}
+
+TEST(MemoryPoolTest, PageHeapLargeAllocations) {
+    auto& heap = PageHeap::instance();
+    heap.trim();
+
+    // 相邻 span 释放后应合并回完整的空闲区
+    std::vector<std::pair<void*, size_t>> spans;
+    for (size_t size : {300 * 1024, 520 * 1024, 8 * 1024, 700 * 1024, 96 * 1024}) {
+        void* ptr = heap.allocate(size);
+        ASSERT_NE(ptr, nullptr);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % PageHeap::PAGE_BYTES, 0u);
+        std::memset(ptr, 0x3c, size);
+        spans.emplace_back(ptr, size);
+    }
+    auto busy = heap.stats();
+    for (size_t i = 0; i < spans.size(); i += 2) heap.deallocate(spans[i].first, spans[i].second);
+    for (size_t i = 1; i < spans.size(); i += 2) heap.deallocate(spans[i].first, spans[i].second);
+    heap.flush_thread_cache();
+    auto idle = heap.stats();
+    EXPECT_EQ(idle.segments, busy.segments);
+    EXPECT_EQ(idle.largest_free_run, idle.free_pages / idle.segments);
+    EXPECT_EQ(heap.trim(), idle.segments * PageHeap::SEGMENT_SIZE);
+    EXPECT_EQ(heap.stats().segments, 0u);
+
+    // 超过 1M 的请求直接 mmap，释放后缓存复用
+    LockFreeMultiSizePool pool;
+    void* huge = pool.allocate(3 * 1024 * 1024 + 1);
+    ASSERT_NE(huge, nullptr);
+    std::memset(huge, 0, 3 * 1024 * 1024 + 1);
+    EXPECT_EQ(heap.stats().huge_mapped_bytes, 3 * 1024 * 1024 + PageHeap::HUGE_GRANULE);
+    pool.deallocate(huge, 3 * 1024 * 1024 + 1);
+    EXPECT_EQ(heap.stats().huge_cached_bytes, 3 * 1024 * 1024 + PageHeap::HUGE_GRANULE);
+    EXPECT_EQ(pool.allocate(3 * 1024 * 1024 + 100), huge);
+    pool.deallocate(huge, 3 * 1024 * 1024 + 100);
+    heap.trim();
+    EXPECT_EQ(heap.stats().huge_cached_bytes, 0u);
+}
+
+TEST(MemoryPoolTest, LargeAllocationPerformance) {
+    constexpr int NUM_THREADS = 4;
+    constexpr int ITERATIONS = 20000;
+    constexpr int LIVE = 64;
+    LockFreeMultiSizePool pool;
+
+    // 对数均匀分布的大小，覆盖 16B ~ 1M
+    auto run = [&](auto alloc, auto dealloc) {
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < NUM_THREADS; ++t) {
+            threads.emplace_back([&, t]() {
+                std::mt19937 rng(t);
+                std::uniform_real_distribution<double> exponent(4.0, 20.0);
+                std::vector<std::pair<void*, size_t>> live(LIVE, {nullptr, 0});
+                for (int i = 0; i < ITERATIONS; ++i) {
+                    auto& slot = live[rng() % LIVE];
+                    if (slot.first) dealloc(slot.first, slot.second);
+                    slot.second = static_cast<size_t>(std::exp2(exponent(rng)));
+                    slot.first = alloc(slot.second);
+                    static_cast<char*>(slot.first)[0] = 1;
+                }
+                for (auto& [ptr, size] : live) {
+                    if (ptr) dealloc(ptr, size);
+                }
+            });
+        }
+        for (auto& th : threads) th.join();
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::high_resolution_clock::now() - start).count();
+    };
+
+    auto pool_time = run([&](size_t size) { return pool.allocate(size); },
+                         [&](void* ptr, size_t size) { pool.deallocate(ptr, size); });
+    auto malloc_time = run([](size_t size) { return std::malloc(size); },
+                           [](void* ptr, size_t) { std::free(ptr); });
+
+    LOG_INFO("Mixed-size allocation (16B-1M, {} threads x {} ops):", NUM_THREADS, ITERATIONS);
+    LOG_INFO("  Pool:   {} us", pool_time);
+    LOG_INFO("  malloc: {} us", malloc_time);
+    auto stats = PageHeap::instance().stats();
+    LOG_INFO("  Page heap segments: {}, free pages: {}", stats.segments, stats.free_pages);
+}
+
+TEST(MemoryPoolTest, PoolStatistics) {
+    LockFreeMultiSizePool pool;
+    constexpr int NUM_THREADS = 4;
+    constexpr int COUNT = 1000;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < NUM_THREADS; ++t) {
+        threads.emplace_back([&pool]() {
+            std::vector<void*> ptrs;
+            for (int i = 0; i < COUNT; ++i) ptrs.push_back(pool.allocate(64));
+            for (void* ptr : ptrs) pool.deallocate(ptr, 64);
+            for (int i = 0; i < COUNT; ++i) pool.deallocate(pool.allocate(64), 64);
+        });
+    }
+    for (auto& th : threads) th.join();
+
+    std::vector<void*> held;
+    for (int i = 0; i < 100; ++i) held.push_back(pool.allocate(200));
+    void* large = pool.allocate(100 * 1024);
+
+    auto stats = pool.stats();
+    size_t index = SizeClassMap<DefaultSizeClasses>::index(64);
+    const auto& cls = stats.classes[index];
+    EXPECT_EQ(cls.block_size, 64u);
+    EXPECT_GT(cls.chunks, 0u);
+    EXPECT_GE(cls.fragmentation, 0.0);
+    EXPECT_LE(cls.fragmentation, 1.0);
+    EXPECT_EQ(stats.chunks, pool.chunk_count());
+    EXPECT_EQ(stats.bytes_reserved, pool.committed_bytes());
+#if MEMORYPOOL_STATS
+    EXPECT_EQ(cls.allocations, 2u * NUM_THREADS * COUNT);
+    EXPECT_EQ(cls.deallocations, cls.allocations);
+    EXPECT_EQ(cls.bytes_in_use, 0u);
+    EXPECT_GT(cls.cache_hits, cls.allocations / 2);
+    EXPECT_GT(cls.refills, 0u);
+    EXPECT_EQ(stats.classes[SizeClassMap<DefaultSizeClasses>::index(200)].bytes_in_use, 100u * 256);
+    EXPECT_EQ(stats.large_allocations, 1u);
+    EXPECT_EQ(stats.large_bytes_in_use, 100u * 1024);
+    EXPECT_EQ(stats.bytes_in_use, 100u * 256 + 100 * 1024);
+    EXPECT_GT(stats.cache_hit_rate, 0.5);
+#endif
+    pool.print_stats();
+
+    pool.deallocate(large, 100 * 1024);
+    for (void* ptr : held) pool.deallocate(ptr, 200);
+#if MEMORYPOOL_STATS
+    EXPECT_EQ(pool.stats().bytes_in_use, 0u);
+#endif
+
+#if MEMORYPOOL_PROFILING
+    auto& profiler = HeapProfiler::instance();
+    profiler.reset();
+    // 新间隔在下一次采样后才生效，之前最多还要分配一个默认间隔
+    profiler.set_sample_interval(64 * 1024);
+    for (int i = 0; i < 2000; ++i) pool.deallocate(pool.allocate(1024), 1024);
+    auto sites = profiler.snapshot();
+    ASSERT_FALSE(sites.empty());
+    EXPECT_GE(sites.front().samples, 10u);
+    profiler.dump(1);
+
+    // 停止后不再采样，重新设置间隔后恢复
+    profiler.set_sample_interval(0);
+    for (int i = 0; i < 1000; ++i) pool.deallocate(pool.allocate(1024), 1024);
+    profiler.reset();
+    for (int i = 0; i < 1000; ++i) pool.deallocate(pool.allocate(1024), 1024);
+    EXPECT_TRUE(profiler.snapshot().empty());
+    profiler.set_sample_interval(64 * 1024);
+    for (int i = 0; i < 2000; ++i) pool.deallocate(pool.allocate(1024), 1024);
+    sites = profiler.snapshot();
+    ASSERT_FALSE(sites.empty());
+    EXPECT_GE(sites.front().samples, 10u);
+    profiler.set_sample_interval(HeapProfiler::DEFAULT_SAMPLE_INTERVAL);
+#endif
+}
+
+TEST(MemoryPoolTest, AdaptiveThreadCache) {
+    constexpr int NUM_THREADS = 4;
+    constexpr int ROUNDS = 2000;
+    constexpr int BURST = 200;
+    LockFreeMultiSizePool pool;
+    size_t index = SizeClassMap<DefaultSizeClasses>::index(64);
+
+    auto global_ops = [&]() -> uint64_t {
+        auto stats = pool.stats();
+        return stats.classes[index].refills + stats.classes[index].releases;
+    };
+
+    // 每轮突发分配 200 个 64 字节对象再全部释放，远超固定 32 个的缓存容量
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < NUM_THREADS; ++t) {
+        threads.emplace_back([&]() {
+            std::vector<void*> ptrs(BURST);
+            for (int round = 0; round < ROUNDS; ++round) {
+                for (auto& ptr : ptrs) ptr = pool.allocate(64);
+                for (auto* ptr : ptrs) pool.deallocate(ptr, 64);
+            }
+        });
+    }
+    for (auto& th : threads) th.join();
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::high_resolution_clock::now() - start).count();
+    uint64_t total_ops = 2ull * NUM_THREADS * ROUNDS * BURST;
+    uint64_t total_global = global_ops();
+
+    // 上限增长后，稳定阶段几乎不再访问全局链表
+    uint64_t before = global_ops();
+    std::vector<void*> ptrs(BURST);
+    for (int round = 0; round < 100; ++round) {
+        for (auto& ptr : ptrs) ptr = pool.allocate(64);
+        for (auto* ptr : ptrs) pool.deallocate(ptr, 64);
+    }
+    uint64_t steady_global = global_ops() - before;
+#if MEMORYPOOL_STATS
+    EXPECT_LT(steady_global, 100u * 2 * BURST / 100);
+    // 固定 32 个缓存、每批 16 个时，每轮约需 2 * (200 - 32) / 16 次全局操作
+    EXPECT_LT(total_global, total_ops / 200);
+#endif
+    LOG_INFO("Adaptive thread cache ({} threads x {} rounds x {} objects): {} us", NUM_THREADS, ROUNDS, BURST, elapsed);
+    LOG_INFO("  Global list ops: {} / {} operations, steady state: {} / {}", total_global, total_ops, steady_global, 100 * 2 * BURST);
+
+    // 刷新接口：线程缓存全部归还
+    EXPECT_GT(pool.thread_cache_bytes(), 0u);
+    pool.flush_thread_cache();
+    EXPECT_EQ(pool.thread_cache_bytes(), 0u);
+
+    // 全局预算：单线程缓存不超过预算（下限 64K）
+    RetentionPolicy small_budget;
+    small_budget.thread_cache_budget = 64 * 1024;
+    LockFreeMultiSizePool limited(small_budget);
+    std::vector<std::pair<void*, size_t>> blocks;
+    for (size_t size : {64, 128, 256, 512, 1024, 2048}) {
+        for (int i = 0; i < 200; ++i) blocks.emplace_back(limited.allocate(size), size);
+    }
+    for (auto& [ptr, size] : blocks) limited.deallocate(ptr, size);
+    EXPECT_LE(limited.thread_cache_bytes(), 64u * 1024);
+    limited.flush_thread_cache();
+}
+
+TEST(MemoryPoolTest, PerCpuCaches) {
+    constexpr int OBJECTS = 64;
+    constexpr int ROUNDS = 50;
+    constexpr size_t SIZE = 256;
+
+    struct Result {
+        CacheMode mode;
+        long long elapsed;
+        size_t committed;
+        size_t cached;
+    };
+    // 每个线程突发分配/释放若干轮后停住，在所有线程都停住时统计内存池持有的内存
+    auto run = [&](CacheMode mode, int num_threads) {
+        LockFreeMultiSizePool pool({}, PageBacking::Standard, mode);
+        std::latch parked(num_threads);
+        std::latch resume(1);
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < num_threads; ++t) {
+            threads.emplace_back([&]() {
+                void* ptrs[OBJECTS];
+                for (int round = 0; round < ROUNDS; ++round) {
+                    for (auto& ptr : ptrs) ptr = pool.allocate(SIZE);
+                    for (auto* ptr : ptrs) pool.deallocate(ptr, SIZE);
+                }
+                parked.count_down();
+                resume.wait();
+            });
+        }
+        parked.wait();
+        Result result{pool.cache_mode(), std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::high_resolution_clock::now() - start).count(), pool.committed_bytes(), pool.cpu_cache_bytes()};
+        resume.count_down();
+        for (auto& th : threads) th.join();
+        return result;
+    };
+
+    LOG_INFO("Per-CPU caches ({} CPUs, rseq: {}), {} rounds x {} objects per thread:", percpu::cpu_count(), percpu::available(), ROUNDS, OBJECTS);
+    for (int num_threads : {16, 1024}) {
+        Result thread_mode = run(CacheMode::Thread, num_threads);
+        Result cpu_mode = run(CacheMode::PerCpu, num_threads);
+        EXPECT_EQ(cpu_mode.mode, percpu::available() ? CacheMode::PerCpu : CacheMode::Thread);
+        LOG_INFO("  {} threads: thread caches {} us, {} KiB committed; per-CPU caches {} us, {} KiB committed, {} KiB cached",
+            num_threads, thread_mode.elapsed, thread_mode.committed / 1024, cpu_mode.elapsed, cpu_mode.committed / 1024, cpu_mode.cached / 1024);
+        if (cpu_mode.mode == CacheMode::PerCpu) {
+            // 缓存占用只与核数有关：每个 CPU 每个大小类最多 256K
+            EXPECT_LE(cpu_mode.cached, percpu::cpu_count() * 256 * 1024);
+            if (num_threads > static_cast<int>(percpu::cpu_count())) {
+                EXPECT_LE(cpu_mode.committed, thread_mode.committed);
+            }
+        }
+    }
+
+    // 固定大小内存池的每 CPU 缓存
+    LockFreeFixedSizePool<TestObject> fixed({}, PageBacking::Standard, CacheMode::PerCpu);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t]() {
+            std::vector<TestObject*> objects;
+            for (int i = 0; i < 100; ++i) objects.push_back(fixed.allocate(t * 100 + i, "percpu"));
+            for (int i = 0; i < 100; ++i) EXPECT_EQ(objects[i]->getData(), t * 100 + i);
+            for (auto* obj : objects) fixed.deallocate(obj);
+        });
+    }
+    for (auto& th : threads) th.join();
+    EXPECT_EQ(fixed.get_active_objects(), 0u);
+    fixed.trim();
+}
+
+TEST(MemoryPoolTest, BulkAllocation) {
+    struct Packet {
+        uint32_t length = 0;
+        char payload[252];
+    };
+    constexpr size_t TOTAL_OBJECTS = 1 << 20;
+
+    auto per_object_ns = [](auto&& body) {
+        auto start = std::chrono::high_resolution_clock::now();
+        body();
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+        return static_cast<double>(elapsed) / TOTAL_OBJECTS;
+    };
+
+    // 正确性：批量分配的地址互不相同、可写，计数与单个接口一致
+    {
+        LockFreeFixedSizePool<Packet> pool;
+        std::vector<Packet*> packets(300);
+        ASSERT_EQ(pool.allocate_bulk(packets.size(), packets.data()), packets.size());
+        for (size_t i = 0; i < packets.size(); ++i) packets[i]->length = static_cast<uint32_t>(i);
+        std::vector<Packet*> sorted = packets;
+        std::sort(sorted.begin(), sorted.end());
+        EXPECT_EQ(std::adjacent_find(sorted.begin(), sorted.end()), sorted.end());
+        for (size_t i = 0; i < packets.size(); ++i) EXPECT_EQ(packets[i]->length, i);
+        EXPECT_EQ(pool.get_active_objects(), packets.size());
+        pool.deallocate_bulk(packets.data(), packets.size());
+        EXPECT_EQ(pool.get_active_objects(), 0u);
+
+        LockFreeMultiSizePool multi;
+        std::vector<void*> blocks(300);
+        ASSERT_EQ(multi.allocate_bulk(200, blocks.size(), blocks.data()), blocks.size());
+        for (void* ptr : blocks) std::memset(ptr, 0x5a, 200);
+        multi.deallocate_bulk(blocks.data(), blocks.size(), 200);
+#if MEMORYPOOL_STATS
+        auto stats = multi.stats();
+        EXPECT_EQ(stats.allocations, blocks.size());
+        EXPECT_EQ(stats.deallocations, blocks.size());
+#endif
+        multi.trim();
+    }
+
+    LOG_INFO("Bulk allocation, {} objects of {} bytes (ns per object, single / bulk):", TOTAL_OBJECTS, sizeof(Packet));
+    for (size_t burst : {32, 128, 256}) {
+        LockFreeFixedSizePool<Packet> fixed;
+        std::vector<Packet*> packets(burst);
+        double fixed_single = per_object_ns([&] {
+            for (size_t round = 0; round < TOTAL_OBJECTS / burst; ++round) {
+                for (auto& packet : packets) packet = fixed.allocate();
+                for (auto* packet : packets) fixed.deallocate(packet);
+            }
+        });
+        double fixed_bulk = per_object_ns([&] {
+            for (size_t round = 0; round < TOTAL_OBJECTS / burst; ++round) {
+                fixed.allocate_bulk(burst, packets.data());
+                fixed.deallocate_bulk(packets.data(), burst);
+            }
+        });
+
+        LockFreeMultiSizePool multi;
+        std::vector<void*> blocks(burst);
+        double multi_single = per_object_ns([&] {
+            for (size_t round = 0; round < TOTAL_OBJECTS / burst; ++round) {
+                for (auto& ptr : blocks) ptr = multi.allocate(sizeof(Packet));
+                for (auto* ptr : blocks) multi.deallocate(ptr, sizeof(Packet));
+            }
+        });
+        double multi_bulk = per_object_ns([&] {
+            for (size_t round = 0; round < TOTAL_OBJECTS / burst; ++round) {
+                multi.allocate_bulk(sizeof(Packet), burst, blocks.data());
+                multi.deallocate_bulk(blocks.data(), burst, sizeof(Packet));
+            }
+        });
+        multi.flush_thread_cache();
+        LOG_INFO("  burst {}: fixed pool {:.1f} / {:.1f}, multi-size pool {:.1f} / {:.1f}", burst, fixed_single, fixed_bulk, multi_single, multi_bulk);
+    }
+}
+
+namespace {
+    // 典型的消息结构：内部容器在复用时保留容量
+    struct Message {
+        uint64_t id = 0;
+        std::string topic;
+        std::vector<char> payload;
+        std::vector<std::pair<std::string, std::string>> headers;
+
+        void reset() {
+            id = 0;
+            topic.clear();
+            payload.clear();
+            headers.clear();
+        }
+    };
+
+    void fill_message(Message& message, uint64_t id) {
+        message.id = id;
+        message.topic.assign("market-data/equities/level2/snapshot/", 37);
+        message.payload.resize(1024, static_cast<char>(id));
+        for (int i = 0; i < 4; ++i) {
+            message.headers.emplace_back("x-header-name-" + std::to_string(i), "header-value-long-enough-for-heap");
+        }
+    }
+}
+
+TEST(MemoryPoolTest, ObjectPoolRecycling) {
+    // 复用时不再构造，Reset 钩子清空内容但保留容量
+    {
+        ObjectPool<Message> pool;
+        Message* first = pool.acquire();
+        fill_message(*first, 1);
+        const char* payload_data = first->payload.data();
+        pool.release(first);
+        EXPECT_TRUE(first->payload.empty());
+
+        Message* second = pool.acquire();
+        EXPECT_EQ(second, first);
+        EXPECT_EQ(second->id, 0u);
+        EXPECT_GE(second->payload.capacity(), 1024u);
+        fill_message(*second, 2);
+        EXPECT_EQ(second->payload.data(), payload_data);
+        pool.release(second);
+        EXPECT_EQ(pool.constructed_count(), 1u);
+        EXPECT_EQ(pool.reused_count(), 1u);
+        EXPECT_EQ(pool.trim(), 1u);
+        EXPECT_EQ(pool.live_objects(), 0u);
+    }
+
+    // 自定义钩子以及 PoolPtr / PoolAllocator 集成
+    {
+        struct ClearCounter {
+            int* calls;
+            void operator()(std::vector<int>& v) const { v.clear(); ++*calls; }
+        };
+        int calls = 0;
+        ObjectPool<std::vector<int>, ClearCounter> pool(ClearCounter{&calls});
+        {
+            PoolPtr<std::vector<int>, decltype(pool)> ptr(pool.acquire(10, 7), &pool);
+            EXPECT_EQ(ptr->size(), 10u);
+        }
+        EXPECT_EQ(calls, 1);
+
+        PoolAllocator<Message, ObjectPool<Message>> allocator;
+        std::vector<PoolPtr<Message, ObjectPool<Message>>> messages;
+        for (int i = 0; i < 100; ++i) {
+            messages.push_back(allocator.make());
+            fill_message(*messages.back(), i);
+        }
+        messages.clear();
+        for (int i = 0; i < 100; ++i) messages.push_back(allocator.make());
+        for (auto& message : messages) EXPECT_TRUE(message->payload.empty());
+        EXPECT_EQ(allocator.get_pool().constructed_count(), 100u);
+    }
+
+    // 多线程：线程退出后缓存的对象交回全局继续复用；内存池先于仍缓存对象的线程析构
+    {
+        auto pool = std::make_unique<ObjectPool<Message>>();
+        std::vector<std::thread> workers;
+        for (int t = 0; t < 4; ++t) {
+            workers.emplace_back([&] {
+                std::vector<Message*> held;
+                for (int i = 0; i < 8; ++i) held.push_back(pool->acquire());
+                for (Message* message : held) pool->release(message);
+            });
+            workers.back().join();
+        }
+        // 按 CPU 缓存时对象可能留在其他 CPU 的槽中
+        if (!percpu::available()) {
+            EXPECT_EQ(pool->constructed_count(), 8u);
+        }
+
+        std::latch cached(1);
+        std::latch destroyed(1);
+        std::thread holder([&] {
+            pool->release(pool->acquire());
+            cached.count_down();
+            destroyed.wait();
+        });
+        cached.wait();
+        EXPECT_EQ(pool->live_objects(), pool->constructed_count());
+        pool.reset();
+        destroyed.count_down();
+        holder.join();
+    }
+
+    // 基准：每条消息填充后立即释放，对比每次构造/析构与复用
+    constexpr int NUM_MESSAGES = 200000;
+    constexpr int IN_FLIGHT = 64;
+    auto run = [&](auto&& acquire, auto&& release) {
+        std::vector<Message*> window(IN_FLIGHT, nullptr);
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < NUM_MESSAGES; ++i) {
+            Message*& slot = window[i % IN_FLIGHT];
+            if (slot) release(slot);
+            slot = acquire();
+            fill_message(*slot, i);
+        }
+        for (Message* message : window) release(message);
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+    };
+    LockFreeFixedSizePool<Message> fixed;
+    ObjectPool<Message> recycled;
+    auto fixed_time = run([&] { return fixed.allocate(); }, [&](Message* m) { fixed.deallocate(m); });
+    auto recycled_time = run([&] { return recycled.acquire(); }, [&](Message* m) { recycled.release(m); });
+    LOG_INFO("Message workload ({} messages, {} in flight): construct per use {} us, object pool {} us (constructed {})",
+        NUM_MESSAGES, IN_FLIGHT, fixed_time, recycled_time, recycled.constructed_count());
+    EXPECT_LE(recycled.constructed_count(), static_cast<size_t>(IN_FLIGHT));
+}
+
+TEST(MemoryPoolTest, PoolSharedPointers) {
+    struct Order {
+        uint64_t id;
+        double price;
+        int quantity;
+        Order(uint64_t i, double p, int q) : id(i), price(p), quantity(q) {}
+    };
+
+    // 共享、weak 提升与归还
+    {
+        PoolSharedAllocator<Order, RefCounting::Atomic, true> allocator;
+        auto first = make_pool_shared(allocator, 1u, 10.5, 3);
+        static_assert(sizeof(first) == sizeof(void*));
+        auto second = first;
+        EXPECT_EQ(first.use_count(), 2u);
+        PoolWeak<Order, RefCounting::Atomic, true> weak(first);
+        EXPECT_FALSE(weak.expired());
+        first.reset();
+        EXPECT_EQ(weak.lock()->quantity, 3);
+        second.reset();
+        EXPECT_TRUE(weak.expired());
+        EXPECT_FALSE(weak.lock());
+        EXPECT_EQ(allocator.get_pool().get_active_objects(), 1u);  // weak 引用仍持有池块
+        weak.reset();
+        EXPECT_EQ(allocator.get_pool().get_active_objects(), 0u);
+
+        // 跨线程共享
+        PoolSharedAllocator<Order> shared_allocator;
+        auto order = shared_allocator.make(2u, 1.0, 1);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([order]() {
+                for (int i = 0; i < 10000; ++i) {
+                    auto copy = order;
+                    EXPECT_EQ(copy->id, 2u);
+                }
+            });
+        }
+        for (auto& th : threads) th.join();
+        EXPECT_EQ(order.use_count(), 1u);
+    }
+
+    // 基准：创建后复制若干次再全部释放
+    constexpr int NUM_OBJECTS = 200000;
+    constexpr int COPIES = 4;
+    auto run = [&](auto&& make) {
+        auto start = std::chrono::high_resolution_clock::now();
+        uint64_t checksum = 0;
+        for (int i = 0; i < NUM_OBJECTS; ++i) {
+            auto object = make(i);
+            for (int c = 0; c < COPIES; ++c) {
+                auto copy = object;
+                checksum += copy->id;
+            }
+        }
+        EXPECT_GT(checksum, 0u);
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+    };
+    PoolSharedAllocator<Order> atomic_allocator;
+    PoolSharedAllocator<Order, RefCounting::Local> local_allocator;
+    PoolSharedAllocator<Order, RefCounting::Atomic, true> weak_allocator;
+    auto std_time = run([](int i) { return std::make_shared<Order>(i, 1.0, 1); });
+    auto atomic_time = run([&](int i) { return atomic_allocator.make(i, 1.0, 1); });
+    auto local_time = run([&](int i) { return local_allocator.make(i, 1.0, 1); });
+    auto weak_time = run([&](int i) { return weak_allocator.make(i, 1.0, 1); });
+    LOG_INFO("Shared pointers ({} objects x {} copies): std::make_shared {} us, PoolShared atomic {} us, local {} us, atomic+weak {} us",
+        NUM_OBJECTS, COPIES, std_time, atomic_time, local_time, weak_time);
+}
+
+TEST(MemoryPoolTest, CompactPoolPtr) {
+    static_assert(sizeof(PoolPtr<int>) == sizeof(std::unique_ptr<int>));
+    static_assert(sizeof(FixedPoolPtr<TestObject, 64 * 1024>) == sizeof(void*));
+
+    // 不同内存池、不同块大小参数的指针都能找回各自的内存池
+    LockFreeFixedSizePool<int> first;
+    LockFreeFixedSizePool<int> second;
+    LockFreeFixedSizePool<std::array<char, 5000>, 1 << 16> large_chunks;
+    LockFreeFixedSizePool<std::array<char, 5000>, 64> single_block;
+    std::vector<PoolPtr<int>> ints;
+    for (int i = 0; i < 3000; ++i) {
+        auto& pool = i % 2 ? first : second;
+        ints.emplace_back(pool.allocate(i));
+        EXPECT_EQ(LockFreeFixedSizePool<int>::owner_of(ints.back().get()), &pool);
+    }
+    PoolPtr<std::array<char, 5000>, decltype(large_chunks)> large(large_chunks.allocate());
+    PoolPtr<std::array<char, 5000>, decltype(single_block)> single(single_block.allocate());
+    EXPECT_EQ(decltype(large_chunks)::owner_of(large.get()), &large_chunks);
+    EXPECT_EQ(decltype(single_block)::owner_of(single.get()), &single_block);
+    EXPECT_EQ(first.get_active_objects(), 1500u);
+    ints.clear();
+    large.reset();
+    single.reset();
+    EXPECT_EQ(first.get_active_objects(), 0u);
+    EXPECT_EQ(second.get_active_objects(), 0u);
+    EXPECT_EQ(large_chunks.get_active_objects(), 0u);
+    EXPECT_EQ(single_block.get_active_objects(), 0u);
+
+    // 大页 arena 中切分的 chunk 同样对齐
+    LockFreeFixedSizePool<int> huge({}, PageBacking::TransparentHugePages);
+    std::vector<PoolPtr<int>> huge_ints;
+    for (int i = 0; i < 3000; ++i) huge_ints.emplace_back(huge.allocate(i));
+    for (auto& ptr : huge_ints) EXPECT_EQ(LockFreeFixedSizePool<int>::owner_of(ptr.get()), &huge);
+    huge_ints.clear();
+    EXPECT_EQ(huge.get_active_objects(), 0u);
+}
+
+TEST(MemoryPoolTest, CacheAlignedLayout) {
+    // 48 字节的每线程计数器：紧凑布局下相邻块共享缓存行
+    struct PerThreadCounter {
+        std::atomic<uint64_t> hits{0};
+        uint64_t misses = 0;
+        uint64_t bytes = 0;
+        uint64_t reserved[3] = {};
+    };
+    static_assert(sizeof(PerThreadCounter) == 48);
+    constexpr int NUM_THREADS = 4;
+    constexpr int INCREMENTS = 2000000;
+
+    auto run = [&](auto& pool) {
+        // 由同一线程连续分配，保证拿到相邻的块
+        std::vector<PerThreadCounter*> counters;
+        for (int t = 0; t < NUM_THREADS; ++t) counters.push_back(pool.allocate());
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < NUM_THREADS; ++t) {
+            threads.emplace_back([counter = counters[t]]() {
+                for (int i = 0; i < INCREMENTS; ++i) counter->hits.fetch_add(1, std::memory_order_relaxed);
+            });
+        }
+        for (auto& th : threads) th.join();
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+        // 统计与相邻计数器共享缓存行的对数
+        std::vector<PerThreadCounter*> sorted = counters;
+        std::sort(sorted.begin(), sorted.end());
+        size_t shared_lines = 0;
+        for (int t = 1; t < NUM_THREADS; ++t) {
+            auto line = [](const void* ptr) { return reinterpret_cast<uintptr_t>(ptr) / CACHE_LINE_SIZE; };
+            auto end = reinterpret_cast<const std::byte*>(sorted[t - 1]) + sizeof(PerThreadCounter) - 1;
+            if (line(end) == line(sorted[t])) ++shared_lines;
+        }
+        for (auto* counter : counters) {
+            EXPECT_EQ(counter->hits.load(), static_cast<uint64_t>(INCREMENTS));
+            pool.deallocate(counter);
+        }
+        return std::make_pair(elapsed, shared_lines);
+    };
+
+    LockFreeFixedSizePool<PerThreadCounter> compact;
+    LockFreeFixedSizePool<PerThreadCounter, 4096, BlockLayout::CacheAligned> aligned;
+    auto [compact_time, compact_shared] = run(compact);
+    auto [aligned_time, aligned_shared] = run(aligned);
+    EXPECT_EQ(aligned_shared, 0u);
+    LOG_INFO("False sharing ({} threads x {} increments): compact layout {} us ({} shared lines), cache-aligned layout {} us ({} shared lines)",
+        NUM_THREADS, INCREMENTS, compact_time, compact_shared, aligned_time, aligned_shared);
+
+    // 链接存放在对象体内：64 字节对象不再额外占用一个缓存行
+    struct Line {
+        char bytes[64];
+    };
+    LockFreeFixedSizePool<Line, 4096, BlockLayout::CacheAligned> lines;
+    std::vector<Line*> objects;
+    for (int i = 0; i < 1000; ++i) {
+        objects.push_back(lines.allocate());
+        std::memset(objects.back()->bytes, i & 0xff, sizeof(Line));
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(objects.back()) % CACHE_LINE_SIZE, 0u);
+    }
+#if !MEMORYPOOL_HARDENED && !defined(MEMORYPOOL_ASAN)
+    std::sort(objects.begin(), objects.end());
+    size_t adjacent = 0;
+    for (size_t i = 1; i < objects.size(); ++i) {
+        if (reinterpret_cast<std::byte*>(objects[i]) - reinterpret_cast<std::byte*>(objects[i - 1]) == sizeof(Line)) ++adjacent;
+    }
+    EXPECT_GT(adjacent, objects.size() / 2);
+#endif
+    for (auto* object : objects) lines.deallocate(object);
+    EXPECT_EQ(lines.get_active_objects(), 0u);
+    lines.trim();
+}
+
+namespace {
+    // B+ 树内部节点：长期存活，查找时只读第一个缓存行中的 keys
+    struct IndexNode {
+        uint64_t keys[112];
+        IndexNode* children[8];
+    };
+}
+
+TEST(MemoryPoolTest, SlabCacheColoring) {
+    using NodeCache = SlabCache<IndexNode>;
+    constexpr size_t PER_SLAB = NodeCache::objects_per_slab();
+    constexpr size_t SLAB_BYTES = 16 * 1024;
+    ASSERT_GT(NodeCache::color_count(), 1u);
+
+    // 构造/析构回调只在 slab 创建和回收时对每个对象调用一次
+    {
+        std::atomic<size_t> constructed{0};
+        std::atomic<size_t> destroyed{0};
+        NodeCache::Options options;
+        options.constructor = [&](void* ptr) {
+            auto* node = new (ptr) IndexNode();
+            node->keys[0] = UINT64_MAX;
+            ++constructed;
+        };
+        options.destructor = [&](IndexNode* node) {
+            node->~IndexNode();
+            ++destroyed;
+        };
+        NodeCache cache("index_node", options);
+
+        std::vector<IndexNode*> nodes;
+        for (size_t i = 0; i < 3 * PER_SLAB; ++i) {
+            IndexNode* node = cache.allocate();
+            ASSERT_NE(node, nullptr);
+            EXPECT_EQ(node->keys[0], UINT64_MAX);
+            node->keys[1] = i;
+            nodes.push_back(node);
+        }
+        EXPECT_EQ(constructed.load(), 3 * PER_SLAB);
+        SlabInfo info = cache.info();
+        EXPECT_EQ(info.full_slabs, 3u);
+        EXPECT_EQ(info.active_objects, 3 * PER_SLAB);
+
+        bool listed = false;
+        SlabCacheBase::for_each([&](SlabCacheBase& each) { listed |= each.name() == "index_node"; });
+        EXPECT_TRUE(listed);
+
+        // 释放后只保留一个空 slab，其余立即析构回收
+        for (auto* node : nodes) cache.deallocate(node);
+        info = cache.info();
+        EXPECT_EQ(info.active_objects, 0u);
+        EXPECT_EQ(info.empty_slabs, 1u);
+        EXPECT_EQ(destroyed.load(), 2 * PER_SLAB);
+
+        // 空 slab 中的对象保持构造状态，复用时不再调用构造回调
+        IndexNode* reused = cache.allocate();
+        EXPECT_EQ(constructed.load(), 3 * PER_SLAB);
+        cache.deallocate(reused);
+
+        // 指针只保存对象地址，由地址找回所属 slab 缓存
+        {
+            PoolPtr<IndexNode, NodeCache> owned(cache.allocate());
+            static_assert(sizeof(owned) == sizeof(IndexNode*));
+            EXPECT_EQ(NodeCache::owner_of(owned.get()), &cache);
+        }
+        EXPECT_GT(cache.shrink(), 0u);
+        EXPECT_EQ(destroyed.load(), 3 * PER_SLAB);
+        EXPECT_EQ(cache.committed_bytes(), 0u);
+    }
+
+    // 每个 slab 的 0 号节点是查找的热点，只读它们的第一个缓存行
+    constexpr size_t SLABS = 512;
+    constexpr int ROUNDS = 2000;
+    auto walk = [&](bool coloring, size_t& offsets) {
+        NodeCache::Options options;
+        options.coloring = coloring;
+        NodeCache cache(coloring ? "index_node_colored" : "index_node_plain", options);
+        std::vector<IndexNode*> nodes;
+        std::vector<IndexNode*> hot;
+        for (size_t i = 0; i < SLABS * PER_SLAB; ++i) {
+            nodes.push_back(cache.allocate());
+            nodes.back()->keys[0] = i;
+            if (i % PER_SLAB == 0) hot.push_back(nodes.back());
+        }
+        std::vector<uintptr_t> slab_offsets;
+        for (auto* node : hot) slab_offsets.push_back(reinterpret_cast<uintptr_t>(node) % SLAB_BYTES);
+        std::sort(slab_offsets.begin(), slab_offsets.end());
+        offsets = static_cast<size_t>(std::unique(slab_offsets.begin(), slab_offsets.end()) - slab_offsets.begin());
+
+        uint64_t sum = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int round = 0; round < ROUNDS; ++round) {
+            for (auto* node : hot) sum += node->keys[0];
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+        EXPECT_EQ(sum, ROUNDS * (SLABS * (SLABS - 1) / 2 * PER_SLAB));
+        for (auto* node : nodes) cache.deallocate(node);
+        return elapsed;
+    };
+
+    size_t plain_offsets = 0;
+    size_t colored_offsets = 0;
+    auto plain_us = walk(false, plain_offsets);
+    auto colored_us = walk(true, colored_offsets);
+    LOG_INFO("Slab hot-node walk, {} slabs x {} rounds: plain {} us ({} offsets), colored {} us ({} offsets)",
+             SLABS, ROUNDS, plain_us, plain_offsets, colored_us, colored_offsets);
+    EXPECT_EQ(plain_offsets, 1u);
+    EXPECT_EQ(colored_offsets, NodeCache::color_count());
+}
+
+TEST(MemoryPoolTest, ThreadPoolResource) {
+    constexpr int NUM_TASKS = 200000;
+    LockFreeMultiSizePool multi;
+    MultiSizePoolResource resource(multi);
+
+    // 提交吞吐量：任务与 promise 共享状态来自 new/delete 或内存池
+    auto submit = [&](std::pmr::memory_resource* task_resource) {
+        ThreadPool pool(4, task_resource);
+        pool.Start();
+        std::vector<std::future<int>> res;
+        res.reserve(NUM_TASKS);
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < NUM_TASKS; ++i) {
+            res.emplace_back(pool.enqueue([i] { return i; }));
+        }
+        auto submitted = std::chrono::high_resolution_clock::now();
+        long long sum = 0;
+        for (auto& r : res) sum += r.get();
+        auto end = std::chrono::high_resolution_clock::now();
+        pool.Stop();
+        EXPECT_EQ(sum, static_cast<long long>(NUM_TASKS) * (NUM_TASKS - 1) / 2);
+        auto ms = [](auto d) { return std::chrono::duration_cast<std::chrono::milliseconds>(d).count(); };
+        return std::pair{ms(submitted - start), ms(end - start)};
+    };
+
+    auto [default_submit, default_total] = submit(std::pmr::new_delete_resource());
+    auto [pool_submit, pool_total] = submit(&resource);
+    LOG_INFO("ThreadPool {} tasks (ms, submit / total): new_delete {} / {}, LockFreeMultiSizePool {} / {}",
+             NUM_TASKS, default_submit, default_total, pool_submit, pool_total);
+#if MEMORYPOOL_STATS
+    auto stats = multi.stats();
+    EXPECT_GE(stats.allocations, 2u * NUM_TASKS);
+    EXPECT_EQ(stats.allocations, stats.deallocations);
+#endif
+}
+
+TEST(MemoryPoolTest, ReserveAndPrewarm) {
+    constexpr size_t FIRST_ALLOCATIONS = 10000;
+    constexpr size_t SIZES[] = {32, 64, 128, 256, 512};
+
+    // 正确性：预留之后前 FIRST_ALLOCATIONS 次分配不再申请 chunk
+    {
+        struct Order {
+            uint64_t id = 0;
+            double price = 0;
+        };
+        LockFreeFixedSizePool<Order> fixed;
+        EXPECT_GE(fixed.reserve(FIRST_ALLOCATIONS), FIRST_ALLOCATIONS);
+        size_t chunks = fixed.chunk_count();
+        fixed.prewarm();
+        std::vector<Order*> objects;
+        for (size_t i = 0; i < FIRST_ALLOCATIONS; ++i) objects.push_back(fixed.allocate(Order{i, 1.0}));
+        EXPECT_EQ(fixed.chunk_count(), chunks);
+        for (auto* object : objects) fixed.deallocate(object);
+
+        LockFreeMultiSizePool multi;
+        for (size_t size : SIZES) EXPECT_GE(multi.reserve(size, FIRST_ALLOCATIONS / std::size(SIZES)), FIRST_ALLOCATIONS / std::size(SIZES));
+        EXPECT_EQ(multi.reserve(LockFreeMultiSizePool::max_class_size() + 1, 10), 0u);
+        chunks = multi.chunk_count();
+        multi.prewarm();
+        EXPECT_GT(multi.thread_cache_bytes(), 0u);
+        std::vector<void*> blocks;
+        for (size_t i = 0; i < FIRST_ALLOCATIONS; ++i) blocks.push_back(multi.allocate(SIZES[i % std::size(SIZES)]));
+        EXPECT_EQ(multi.chunk_count(), chunks);
+        for (size_t i = 0; i < blocks.size(); ++i) multi.deallocate(blocks[i], SIZES[i % std::size(SIZES)]);
+
+        // 锁定的 chunk 不会被 trim 回收；RLIMIT_MEMLOCK 不足时只记录警告
+        LockFreeMultiSizePool pinned;
+        pinned.reserve(64, 1024, ReserveOptions{.prefault = true, .lock_memory = true});
+        void* block = pinned.allocate(64);
+        ASSERT_NE(block, nullptr);
+        pinned.deallocate(block, 64);
+        pinned.trim();
+    }
+
+    // 在新线程中测量，线程缓存不受之前测试的影响
+    auto first_allocations = [&](bool warm) {
+        std::vector<int64_t> latencies(FIRST_ALLOCATIONS);
+        std::thread worker([&] {
+            LockFreeMultiSizePool pool;
+            if (warm) {
+                for (size_t size : SIZES) pool.reserve(size, FIRST_ALLOCATIONS / std::size(SIZES));
+                pool.prewarm();
+            }
+            std::vector<void*> blocks(FIRST_ALLOCATIONS);
+            for (size_t i = 0; i < FIRST_ALLOCATIONS; ++i) {
+                auto start = std::chrono::steady_clock::now();
+                blocks[i] = pool.allocate(SIZES[i % std::size(SIZES)]);
+                latencies[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                std::memset(blocks[i], 0x5a, SIZES[i % std::size(SIZES)]);
+            }
+            for (size_t i = 0; i < FIRST_ALLOCATIONS; ++i) pool.deallocate(blocks[i], SIZES[i % std::size(SIZES)]);
+        });
+        worker.join();
+        std::sort(latencies.begin(), latencies.end());
+        return latencies;
+    };
+
+    LOG_INFO("First {} allocations after startup (ns, p50 / p99 / p99.9 / max):", FIRST_ALLOCATIONS);
+    for (bool warm : {false, true}) {
+        auto latencies = first_allocations(warm);
+        LOG_INFO("  {}: {} / {} / {} / {}", warm ? "prewarmed" : "cold",
+                 latencies[FIRST_ALLOCATIONS / 2], latencies[FIRST_ALLOCATIONS * 99 / 100],
+                 latencies[FIRST_ALLOCATIONS * 999 / 1000], latencies.back());
+    }
+}
+
+TEST(MemoryPoolTest, LazyChunkCarving) {
+    constexpr size_t POOLS = 256;
+    using WordPool = LockFreeFixedSizePool<uint64_t, 64 * 1024>;
+
+    // 每个池增长一个 64 KiB 的 chunk 后只分配一个对象
+    // eager 通过 reserve（不预取页面）把整个 chunk 串入空闲链表，模拟原来的增长方式
+    auto grow = [&](bool eager, size_t& rss_growth) {
+        std::vector<std::unique_ptr<WordPool>> pools;
+        std::vector<uint64_t*> words;
+        size_t rss_before = os_memory::resident_bytes();
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < POOLS; ++i) {
+            pools.push_back(std::make_unique<WordPool>());
+            if (eager) pools.back()->reserve(pools.back()->capacity() + 1, ReserveOptions{.prefault = false});
+            words.push_back(pools.back()->allocate(i));
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+        rss_growth = os_memory::resident_bytes() - std::min(rss_before, os_memory::resident_bytes());
+        for (size_t i = 0; i < POOLS; ++i) {
+            EXPECT_EQ(*words[i], i);
+            pools[i]->deallocate(words[i]);
+        }
+        return elapsed;
+    };
+
+    size_t eager_rss = 0;
+    size_t lazy_rss = 0;
+    auto eager_us = grow(true, eager_rss);
+    auto lazy_us = grow(false, lazy_rss);
+    LOG_INFO("Growing {} pools by one 64 KiB chunk: eager {} us / {} KiB RSS, lazy {} us / {} KiB RSS",
+             POOLS, eager_us, eager_rss / 1024, lazy_us, lazy_rss / 1024);
+    EXPECT_LT(lazy_rss, eager_rss);
+
+    // 切分中的 chunk：未切出的 block 视为空闲，全部释放后可以被 trim 回收
+    RetentionPolicy policy;
+    policy.retain_empty_chunks = 0;
+    LockFreeMultiSizePool multi(policy);
+    std::vector<void*> blocks;
+    for (int i = 0; i < 100; ++i) blocks.push_back(multi.allocate(8));
+    EXPECT_EQ(multi.chunk_count(), 1u);
+    for (void* block : blocks) multi.deallocate(block, 8);
+    multi.trim();
+    EXPECT_EQ(multi.committed_bytes(), 0u);
+    // 回收后重新切分同一个 chunk
+    void* block = multi.allocate(8);
+    ASSERT_NE(block, nullptr);
+    EXPECT_EQ(multi.chunk_count(), 1u);
+    multi.deallocate(block, 8);
+
+    // 多线程增长：并发切分与 trim 交错，分配到的 block 互不重叠
+    LockFreeMultiSizePool shared(policy);
+    std::vector<std::vector<uint64_t*>> per_thread(4);
+    std::vector<std::thread> threads;
+    std::atomic<bool> trimming{true};
+    std::thread trimmer([&] {
+        while (trimming.load()) shared.trim();
+    });
+    for (size_t t = 0; t < per_thread.size(); ++t) {
+        threads.emplace_back([&, t] {
+            for (uint64_t i = 0; i < 20000; ++i) {
+                auto* word = static_cast<uint64_t*>(shared.allocate(sizeof(uint64_t)));
+                *word = t << 32 | i;
+                per_thread[t].push_back(word);
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    trimming = false;
+    trimmer.join();
+    for (size_t t = 0; t < per_thread.size(); ++t) {
+        for (uint64_t i = 0; i < per_thread[t].size(); ++i) {
+            EXPECT_EQ(*per_thread[t][i], t << 32 | i);
+            shared.deallocate(per_thread[t][i], sizeof(uint64_t));
+        }
+    }
+}
+
+TEST(MemoryPoolTest, FragmentationChurn) {
+    constexpr size_t LIVE_OBJECTS = 200000;
+    constexpr int ROUNDS = 8;
+    using Record = std::array<char, 64>;
+
+    // 长时间运行的负载：每轮随机释放一半存活对象、trim，再分配回四分之一，存活对象逐轮减少
+    // 返回最后一轮的已提交字节数；每个池在新线程中运行，线程缓存不会残留到下一次测量
+    auto churn = [&](bool pack) {
+        size_t final_committed = 0;
+        std::thread([&] {
+            RetentionPolicy policy;
+            policy.retain_empty_chunks = 0;
+            policy.pack_by_occupancy = pack;
+            LockFreeFixedSizePool<Record> pool(policy);
+            std::mt19937 rng(42);
+            std::vector<Record*> live;
+            for (size_t i = 0; i < LIVE_OBJECTS; ++i) live.push_back(pool.allocate());
+
+            for (int round = 0; round < ROUNDS; ++round) {
+                std::shuffle(live.begin(), live.end(), rng);
+                size_t freed = live.size() / 2;
+                for (size_t i = 0; i < freed; ++i) pool.deallocate(live[live.size() - 1 - i]);
+                live.resize(live.size() - freed);
+                pool.trim();
+                for (size_t i = 0; i < freed / 2; ++i) live.push_back(pool.allocate());
+
+                size_t committed = pool.committed_bytes();
+                double fragmentation = 1.0 - static_cast<double>(live.size() * sizeof(Record)) / committed;
+                LOG_INFO("Churn ({}) round {}: live {}, committed {} KiB, fragmentation {:.2f}, RSS {} KiB",
+                         pack ? "packed" : "unpacked", round, live.size(), committed / 1024, fragmentation,
+                         os_memory::resident_bytes() / 1024);
+            }
+            pool.trim();
+            final_committed = pool.committed_bytes();
+            for (Record* record : live) pool.deallocate(record);
+        }).join();
+        return final_committed;
+    };
+
+    size_t unpacked = churn(false);
+    size_t packed = churn(true);
+    LOG_INFO("Committed after churn: unpacked {} KiB, packed {} KiB", unpacked / 1024, packed / 1024);
+    EXPECT_LT(packed, unpacked);
+}
+
+TEST(MemoryPoolTest, ThreadExitTeardown) {
+    using Record = std::array<char, 96>;
+
+    // 重启模式：工作线程还持有缓存时内存池先析构，线程退出时不能再写回已销毁的内存池
+    for (int round = 0; round < 100; ++round) {
+        auto fixed = std::make_unique<LockFreeFixedSizePool<Record>>();
+        auto multi = std::make_unique<LockFreeMultiSizePool>();
+        std::latch cached(1);
+        std::latch destroyed(1);
+        std::thread worker([&] {
+            std::vector<Record*> records;
+            std::vector<void*> blocks;
+            for (int i = 0; i < 20; ++i) {
+                records.push_back(fixed->allocate());
+                blocks.push_back(multi->allocate(48));
+            }
+            for (Record* record : records) fixed->deallocate(record);
+            for (void* block : blocks) multi->deallocate(block, 48);
+            cached.count_down();
+            destroyed.wait();
+        });
+        cached.wait();
+        fixed.reset();
+        multi.reset();
+        // 新内存池可能复用旧地址，代号不同，不会沿用旧池留下的缓存
+        LockFreeMultiSizePool replacement;
+        void* block = replacement.allocate(48);
+        ASSERT_NE(block, nullptr);
+        replacement.deallocate(block, 48);
+        destroyed.count_down();
+        worker.join();
+    }
+
+    // 大量短生命周期线程：退出时归还缓存，已提交内存保持平稳
+    LockFreeFixedSizePool<Record> fixed;
+    LockFreeMultiSizePool multi;
+    auto run_threads = [&](int count) {
+        for (int t = 0; t < count; ++t) {
+            std::thread([&] {
+                std::vector<void*> blocks;
+                std::vector<Record*> records;
+                for (size_t i = 0; i < 64; ++i) {
+                    blocks.push_back(multi.allocate(16 + i * 8));
+                    records.push_back(fixed.allocate());
+                }
+                for (size_t i = 0; i < blocks.size(); ++i) multi.deallocate(blocks[i], 16 + i * 8);
+                for (Record* record : records) fixed.deallocate(record);
+            }).join();
+        }
+    };
+    // 预热到稳定状态（加固模式下隔离区先要填满）
+    run_threads(1000);
+    size_t committed_warm = multi.committed_bytes() + fixed.committed_bytes();
+    size_t rss_warm = os_memory::resident_bytes();
+    run_threads(3000);
+    size_t committed_after = multi.committed_bytes() + fixed.committed_bytes();
+    LOG_INFO("Thread churn: committed {} KiB -> {} KiB, RSS {} KiB -> {} KiB", committed_warm / 1024,
+             committed_after / 1024, rss_warm / 1024, os_memory::resident_bytes() / 1024);
+    EXPECT_EQ(committed_after, committed_warm);
+
+    // thread_detach 立即归还当前线程在所有内存池中的缓存，之后仍可以继续分配
+    std::thread([&] {
+        void* block = multi.allocate(64);
+        Record* record = fixed.allocate();
+        multi.deallocate(block, 64);
+        fixed.deallocate(record);
+        EXPECT_GT(multi.thread_cache_bytes(), 0u);
+        pool_lifetime::thread_detach();
+        EXPECT_EQ(multi.thread_cache_bytes(), 0u);
+        block = multi.allocate(64);
+        EXPECT_NE(block, nullptr);
+        multi.deallocate(block, 64);
+    }).join();
+
+    // fork 后子进程可以继续使用内存池
+    pid_t child = fork();
+    ASSERT_GE(child, 0);
+    if (child == 0) {
+        void* block = multi.allocate(128);
+        Record* record = fixed.allocate();
+        bool ok = block && record;
+        multi.deallocate(block, 128);
+        fixed.deallocate(record);
+        pool_lifetime::thread_detach();
+        _exit(ok ? 0 : 1);
+    }
+    int status = 0;
+    ASSERT_EQ(waitpid(child, &status, 0), child);
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+namespace {
+    struct MailboxMessage : MpscQueueHook {
+        uint32_t producer;
+        uint32_t sequence;
+
+        MailboxMessage(uint32_t p, uint32_t s) : producer(p), sequence(s) {}
+    };
+}
+
+TEST(MemoryPoolTest, LockFreeContainers) {
+    constexpr uint32_t THREADS = 4;
+    constexpr uint32_t PER_THREAD = 50000;
+    auto encode = [](uint32_t producer, uint32_t sequence) { return uint64_t(producer) << 32 | sequence; };
+
+    // 生产者与消费者并发，检查每个值恰好取出一次；queue 还检查同一生产者的值按顺序出队
+    auto run = [&](auto& container, bool fifo) {
+        std::vector<std::atomic<uint8_t>> seen(THREADS * PER_THREAD);
+        std::atomic<uint32_t> consumed{0};
+        std::atomic<bool> ordered{true};
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < THREADS; ++t) {
+            threads.emplace_back([&, t] {
+                for (uint32_t i = 0; i < PER_THREAD; ++i) EXPECT_TRUE(container.push(encode(t, i)));
+            });
+            threads.emplace_back([&] {
+                std::vector<int64_t> last(THREADS, -1);
+                while (consumed.load(std::memory_order_relaxed) < THREADS * PER_THREAD) {
+                    std::optional<uint64_t> value = container.pop();
+                    if (!value) continue;
+                    uint32_t producer = static_cast<uint32_t>(*value >> 32);
+                    uint32_t sequence = static_cast<uint32_t>(*value);
+                    seen[producer * PER_THREAD + sequence].fetch_add(1, std::memory_order_relaxed);
+                    if (fifo && static_cast<int64_t>(sequence) <= last[producer]) ordered = false;
+                    last[producer] = sequence;
+                    consumed.fetch_add(1, std::memory_order_relaxed);
+                }
+            });
+        }
+        for (auto& thread : threads) thread.join();
+        EXPECT_TRUE(std::all_of(seen.begin(), seen.end(), [](auto& count) { return count.load() == 1; }));
+        EXPECT_TRUE(ordered.load());
+        EXPECT_TRUE(container.empty());
+        // 出队的节点分批回收，滞留的数量有上限
+        EXPECT_LT(container.pending_reclaim(), 1024u);
+    };
+
+    TreiberStack<uint64_t> stack;
+    run(stack, false);
+    MSQueue<uint64_t> queue;
+    run(queue, true);
+
+    // 容器析构时仍有元素：值正常析构，节点归还内存池
+    {
+        LockFreeStack<std::string> strings;
+        MSQueue<std::string> string_queue;
+        for (int i = 0; i < 100; ++i) {
+            strings.push(std::string(64, 'a' + i % 26));
+            string_queue.push(std::string(64, 'a' + i % 26));
+        }
+        std::string top;
+        EXPECT_TRUE(strings.pop(top));
+        EXPECT_EQ(top, std::string(64, 'a' + 99 % 26));
+        EXPECT_EQ(string_queue.pop(), std::string(64, 'a'));
+    }
+
+    // MPSC：消息从固定大小内存池分配，唯一的消费者取出后归还
+    LockFreeFixedSizePool<MailboxMessage> messages;
+    MpscQueue<MailboxMessage> mailbox;
+    std::vector<std::thread> producers;
+    for (uint32_t t = 0; t < THREADS; ++t) {
+        producers.emplace_back([&, t] {
+            for (uint32_t i = 0; i < PER_THREAD; ++i) mailbox.push(messages.allocate(t, i));
+        });
+    }
+    std::vector<uint32_t> next_sequence(THREADS, 0);
+    for (uint32_t received = 0; received < THREADS * PER_THREAD;) {
+        MailboxMessage* message = mailbox.pop();
+        if (!message) {
+            std::this_thread::yield();
+            continue;
+        }
+        EXPECT_EQ(message->sequence, next_sequence[message->producer]++);
+        messages.deallocate(message);
+        ++received;
+    }
+    for (auto& thread : producers) thread.join();
+    EXPECT_TRUE(mailbox.empty());
+
+    // 与互斥锁保护的 STL 容器对比：每个线程交替 push/pop
+    constexpr int OPS = 200000;
+    auto bench = [&](auto push, auto pop) {
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < THREADS; ++t) {
+            threads.emplace_back([&] {
+                for (int i = 0; i < OPS; ++i) {
+                    push(static_cast<uint64_t>(i));
+                    pop();
+                }
+            });
+        }
+        for (auto& thread : threads) thread.join();
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+        return static_cast<double>(elapsed) / (THREADS * OPS);
+    };
+
+    std::mutex mtx;
+    std::stack<uint64_t> std_stack;
+    std::queue<uint64_t> std_queue;
+    double treiber_ns = bench([&](uint64_t v) { stack.push(v); }, [&] { return stack.pop(); });
+    double std_stack_ns = bench([&](uint64_t v) { std::lock_guard lock(mtx); std_stack.push(v); },
+                                [&] { std::lock_guard lock(mtx); std_stack.pop(); });
+    double ms_ns = bench([&](uint64_t v) { queue.push(v); }, [&] { return queue.pop(); });
+    double std_queue_ns = bench([&](uint64_t v) { std::lock_guard lock(mtx); std_queue.push(v); },
+                                [&] { std::lock_guard lock(mtx); std_queue.pop(); });
+    LOG_INFO("push+pop per op ({} threads): TreiberStack {:.1f} ns vs mutex+std::stack {:.1f} ns, "
+             "MSQueue {:.1f} ns vs mutex+std::queue {:.1f} ns",
+             THREADS, treiber_ns, std_stack_ns, ms_ns, std_queue_ns);
+
+    // HazardRetirable 不在偏移 0 的节点：读者登记派生类型的地址，仍能阻止回收
+    struct Header {
+        uint64_t tag = 0;
+    };
+    struct OffsetNode : Header, HazardRetirable {};
+    OffsetNode node;
+    ASSERT_NE(static_cast<void*>(&node), static_cast<void*>(static_cast<HazardRetirable*>(&node)));
+    int reclaimed = 0;
+    HazardCohort cohort([](HazardRetirable*, void* count) { ++*static_cast<int*>(count); }, &reclaimed);
+    std::atomic<OffsetNode*> shared(&node);
+    HazardPointer hp;
+    hp.protect(shared);
+    cohort.retire(&node);
+    EXPECT_EQ(cohort.reclaim(), 0u);
+    hp.reset();
+    EXPECT_EQ(cohort.reclaim(), 1u);
+    EXPECT_EQ(reclaimed, 1);
+}
+
+namespace {
+    struct SharedConfig {
+        static constexpr uint64_t LIVE = 0x4c495645;
+        static constexpr uint64_t DEAD = 0xdead;
+
+        uint64_t magic = LIVE;
+        uint64_t version;
+        uint64_t checksum;      // 始终等于 version * 3
+    };
+}
+
+TEST(MemoryPoolTest, EpochReclamation) {
+    LockFreeMultiSizePool pool;
+    auto make_config = [&](uint64_t version) {
+        return new (pool.allocate(sizeof(SharedConfig))) SharedConfig{SharedConfig::LIVE, version, version * 3};
+    };
+    struct ReclaimContext {
+        LockFreeMultiSizePool* pool;
+        std::atomic<uint64_t> reclaimed{0};
+    } context{&pool};
+
+    // RCU 式读多写少：读者在临界区内读取当前配置，写者替换后退休旧配置
+    // 回收回调把对象标记为 DEAD，读者在临界区内永远不应该看到 DEAD
+    std::atomic<SharedConfig*> current(make_config(0));
+    std::atomic<bool> running{true};
+    std::atomic<bool> consistent{true};
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 3; ++r) {
+        readers.emplace_back([&] {
+            while (running.load(std::memory_order_relaxed)) {
+                epoch::Guard guard;
+                SharedConfig* config = current.load(std::memory_order_acquire);
+                for (int i = 0; i < 16; ++i) {
+                    if (config->magic != SharedConfig::LIVE || config->checksum != config->version * 3) consistent = false;
+                }
+            }
+        });
+    }
+    constexpr uint64_t UPDATES = 20000;
+    for (uint64_t version = 1; version <= UPDATES; ++version) {
+        SharedConfig* old = current.exchange(make_config(version), std::memory_order_acq_rel);
+        epoch::retire(old, [](void* ptr, void* ctx) {
+            auto* config = static_cast<SharedConfig*>(ptr);
+            config->magic = SharedConfig::DEAD;
+            auto* reclaim = static_cast<ReclaimContext*>(ctx);
+            reclaim->pool->deallocate(config, sizeof(SharedConfig));
+            reclaim->reclaimed.fetch_add(1, std::memory_order_relaxed);
+        }, &context);
+        if (version % 1000 == 0) std::this_thread::yield();
+    }
+    running = false;
+    for (auto& reader : readers) reader.join();
+    epoch::synchronize();
+    EXPECT_TRUE(consistent.load());
+    EXPECT_EQ(context.reclaimed.load(), UPDATES);
+    EXPECT_EQ(epoch::pending(), 0u);
+    pool.deallocate(current.load(), sizeof(SharedConfig));
+
+    // 开销：临界区进出与 hazard pointer 登记、读写锁的对比
+    constexpr int ITERATIONS = 2000000;
+    auto per_op = [](auto&& body) {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < ITERATIONS; ++i) body();
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+        return static_cast<double>(elapsed) / ITERATIONS;
+    };
+    std::atomic<SharedConfig*> shared(make_config(1));
+    std::shared_mutex rw;
+    uint64_t sink = 0;
+    double guard_ns = per_op([&] {
+        epoch::Guard guard;
+        sink += shared.load(std::memory_order_acquire)->version;
+    });
+    double hazard_ns = per_op([&] {
+        HazardPointer hp;
+        sink += hp.protect(shared)->version;
+    });
+    double rwlock_ns = per_op([&] {
+        std::shared_lock lock(rw);
+        sink += shared.load(std::memory_order_relaxed)->version;
+    });
+    EXPECT_EQ(sink, 3u * ITERATIONS);
+
+    // 退休后批量归还内存池与直接释放的对比
+    constexpr int RETIRES = 200000;
+    auto retire_ns = [&](bool deferred) {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < RETIRES; ++i) {
+            void* block = pool.allocate(64);
+            if (deferred) {
+                epoch::retire(pool, block, 64);
+            } else {
+                pool.deallocate(block, 64);
+            }
+        }
+        if (deferred) epoch::synchronize();
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+        return static_cast<double>(elapsed) / RETIRES;
+    };
+    double direct_ns = retire_ns(false);
+    double deferred_ns = retire_ns(true);
+    EXPECT_EQ(epoch::pending(), 0u);
+    pool.deallocate(shared.load(), sizeof(SharedConfig));
+
+    LOG_INFO("Read-side per op: epoch guard {:.1f} ns, hazard pointer {:.1f} ns, shared_mutex {:.1f} ns", guard_ns, hazard_ns, rwlock_ns);
+    LOG_INFO("allocate + free per op: direct {:.1f} ns, epoch retire with batched return {:.1f} ns", direct_ns, deferred_ns);
+}
+
+namespace {
+    std::vector<PoolError> reported_errors;
+
+    void record_pool_error(PoolError error, const void*, size_t) {
+        reported_errors.push_back(error);
+    }
+
+    size_t count_errors(PoolError error) {
+        return std::count(reported_errors.begin(), reported_errors.end(), error);
+    }
+}
+
+TEST(MemoryPoolTest, ForkWhileAllocating) {
+    // 其他线程正在取块、归还和 trim 时 fork，子进程中各个锁都必须处于未锁定状态
+    struct Tick {
+        uint64_t sequence;
+        double price;
+    };
+    LockFreeMultiSizePool multi;
+    LockFreeMultiSizePool per_cpu({}, PageBacking::Standard, CacheMode::PerCpu);
+    LockFreeFixedSizePool<Tick> fixed;
+    ObjectPool<std::string> strings;
+
+    std::atomic<bool> running{true};
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 3; ++t) {
+        workers.emplace_back([&, t] {
+            std::mt19937 rng(t);
+            std::vector<std::pair<void*, size_t>> blocks;
+            std::vector<Tick*> ticks;
+            std::vector<std::string*> names;
+            while (running.load(std::memory_order_relaxed)) {
+                for (int i = 0; i < 256; ++i) {
+                    size_t size = 8 + rng() % 2048;
+                    LockFreeMultiSizePool& pool = i % 2 ? multi : per_cpu;
+                    blocks.emplace_back(pool.allocate(size), size);
+                    ticks.push_back(fixed.allocate(Tick{static_cast<uint64_t>(i), 1.0}));
+                    names.push_back(strings.acquire());
+                }
+                for (size_t i = 0; i < blocks.size(); ++i) {
+                    (i % 2 ? multi : per_cpu).deallocate(blocks[i].first, blocks[i].second);
+                }
+                for (Tick* tick : ticks) fixed.deallocate(tick);
+                for (std::string* name : names) strings.release(name);
+                blocks.clear();
+                ticks.clear();
+                names.clear();
+                if (t == 0) {
+                    multi.trim();
+                    fixed.trim();
+                    strings.trim();
+                }
+            }
+        });
+    }
+
+    constexpr int FORKS = 40;
+    int failures = 0;
+    for (int i = 0; i < FORKS; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        pid_t child = fork();
+        if (child < 0) {
+            ++failures;
+            continue;
+        }
+        if (child == 0) {
+            // 锁残留时子进程会卡住，由 SIGALRM 结束
+            alarm(10);
+            bool ok = true;
+            for (size_t size = 8; size <= 4096; size *= 2) {
+                void* a = multi.allocate(size);
+                void* b = per_cpu.allocate(size);
+                ok = ok && a && b;
+                multi.deallocate(a, size);
+                per_cpu.deallocate(b, size);
+            }
+            void* large = multi.allocate(512 * 1024);
+            Tick* tick = fixed.allocate(Tick{1, 2.0});
+            std::string* name = strings.acquire();
+            ok = ok && large && tick && name;
+            multi.deallocate(large, 512 * 1024);
+            fixed.deallocate(tick);
+            strings.release(name);
+            multi.trim();
+            per_cpu.trim();
+            fixed.trim();
+            strings.trim();
+            _exit(ok ? 0 : 1);
+        }
+        int status = 0;
+        if (waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0) ++failures;
+    }
+    running.store(false);
+    for (auto& worker : workers) worker.join();
+    EXPECT_EQ(failures, 0);
+}
+
+TEST(MemoryPoolTest, HardenedChecks) {
+    reported_errors.clear();
+    PoolErrorHandler previous = set_pool_error_handler(record_pool_error);
+
+    LockFreeMultiSizePool pool;
+    void* ptr = pool.allocate(40);
+    pool.deallocate(ptr, 40);
+    pool.deallocate(ptr, 40);
+    EXPECT_EQ(count_errors(PoolError::DoubleFree), 1u);
+
+#if MEMORYPOOL_HARDENED
+    // 写越界：覆盖块尾的金丝雀
+    auto* bytes = static_cast<unsigned char*>(pool.allocate(40));
+    bytes[40] = 0;
+    pool.deallocate(bytes, 40);
+    EXPECT_EQ(count_errors(PoolError::BufferOverflow), 1u);
+
+    // 向前越界：覆盖块头的金丝雀
+    bytes = static_cast<unsigned char*>(pool.allocate(100));
+    bytes[-1] = 0;
+    pool.deallocate(bytes, 100);
+    EXPECT_EQ(count_errors(PoolError::BufferOverflow), 2u);
+
+    // 释放后写入：隔离区排空后复用时发现投毒内容被改写
+    bytes = static_cast<unsigned char*>(pool.allocate(500));
+    pool.deallocate(bytes, 500);
+    bytes[10] = 0x42;
+    pool.trim();
+    std::vector<void*> reused;
+    for (int i = 0; i < 64 && count_errors(PoolError::UseAfterFree) == 0; ++i) {
+        reused.push_back(pool.allocate(500));
+    }
+    EXPECT_EQ(count_errors(PoolError::UseAfterFree), 1u);
+    for (void* p : reused) pool.deallocate(p, 500);
+
+    // 隔离区延迟复用：刚释放的块不会立即被再次分配
+    void* first = pool.allocate(64);
+    pool.deallocate(first, 64);
+    void* second = pool.allocate(64);
+    EXPECT_NE(first, second);
+    pool.deallocate(second, 64);
+
+    // 定长内存池的重复释放和越界
+    LockFreeFixedSizePool<uint64_t> fixed;
+    uint64_t* value = fixed.allocate(7);
+    fixed.deallocate(value);
+    fixed.deallocate(value);
+    EXPECT_EQ(count_errors(PoolError::DoubleFree), 2u);
+    value = fixed.allocate(7);
+    value[1] = 0;
+    fixed.deallocate(value);
+    EXPECT_EQ(count_errors(PoolError::BufferOverflow), 3u);
+#endif
+
+    set_pool_error_handler(previous);
+}
+
 TEST(MemoryPoolTest, Performance) {
     constexpr int NUM_ALLOCATIONS = 100000;
     
@@ -190,7 +2070,7 @@ TEST(MemoryPoolTest, Performance) {
     LOG_INFO("Multi size pool time: {} microseconds", test__multi_pool().count());
 }
 
-int main() {
-    ::testing::InitGoogleTest();
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
 }
\ No newline at end of file
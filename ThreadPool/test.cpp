@@ -122,6 +122,48 @@ TEST(ThreadPoolTest, EdgeTest) {
     
     pool.Stop();
 }
+TEST(ThreadPoolTest, MemoryResource) {
+    // 统计经过 resource 的分配，任务全部完成、线程池销毁后应全部归还
+    class CountingResource : public std::pmr::memory_resource {
+    public:
+        std::atomic<long> live{0};
+        std::atomic<long> total{0};
+    private:
+        void* do_allocate(size_t bytes, size_t alignment) override {
+            ++live;
+            ++total;
+            return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        }
+        void do_deallocate(void* ptr, size_t bytes, size_t alignment) override {
+            --live;
+            std::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+        }
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+    };
+
+    CountingResource resource;
+    {
+        ThreadPool pool(4, &resource);
+        EXPECT_THROW(pool.enqueue([]() { return 1; }), std::runtime_error);
+        pool.Start();
+        std::vector<std::future<int>> res;
+        for (int i = 0; i < 1000; i++) {
+            res.emplace_back(pool.enqueue([](int x) { return x; }, i));
+        }
+        auto failing = pool.enqueue([]() { throw std::runtime_error("task failed"); });
+        for (int i = 0; i < 1000; i++) {
+            EXPECT_EQ(res[i].get(), i);
+        }
+        EXPECT_THROW(failing.get(), std::runtime_error);
+        pool.Stop();
+    }
+    // 每个任务至少分配任务本身和 promise 共享状态
+    EXPECT_GE(resource.total.load(), 2002);
+    EXPECT_EQ(resource.live.load(), 0);
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
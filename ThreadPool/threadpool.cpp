@@ -1,6 +1,9 @@
 #include "threadpool.hpp"
 
-ThreadPool::ThreadPool(size_t numThreads): mStart(false), mNumThreads(numThreads)
+#include <cassert>
+
+ThreadPool::ThreadPool(size_t numThreads, std::pmr::memory_resource* resource)
+    : mResource(resource), mQueueTasks(std::pmr::deque<TaskBase*>(resource)), mStart(false), mNumThreads(numThreads)
 {
     if (numThreads <= 0) {
         throw std::invalid_argument("numThreads must be positive");
@@ -32,11 +35,14 @@ void ThreadPool::Stop()
     for (auto &work:mWorks) {
         if (work.joinable()) work.join();
     }
+    // 工作线程退出前会执行完队列中的任务，未 Start 时 enqueue 直接抛异常，队列此时必然为空
+    assert(mQueueTasks.empty());
 }
 void ThreadPool::workerThread()
 {
-    while(mStart) {
-        std::function<void()> task;
+    // Stop() 之后继续执行已入队的任务，队列清空后才退出
+    for (;;) {
+        TaskBase* task = nullptr;
         {
             std::unique_lock<std::mutex> lk(mtx);
             if (mQueueTasks.empty() && mStart) {
@@ -50,9 +56,9 @@ void ThreadPool::workerThread()
             if (mQueueTasks.empty()) {
                 continue;
             }
-            task = std::move(mQueueTasks.front());
+            task = mQueueTasks.front();
             mQueueTasks.pop();
-            task();
+            task->run();
         }
         
     }
@@ -3,16 +3,20 @@
 #include <vector>
 #include <functional>
 #include <queue>
+#include <deque>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
 #include <future>
 #include <iostream>
+#include <memory_resource>
 
 class ThreadPool {
 public:
-    explicit ThreadPool(size_t numThreads);
+    // 任务、promise 共享状态和任务队列都从 resource 分配，resource 必须线程安全且比线程池活得更久
+    // 例如用 MultiSizePoolResource 包装 LockFreeMultiSizePool，默认使用 new/delete
+    explicit ThreadPool(size_t numThreads, std::pmr::memory_resource* resource = std::pmr::new_delete_resource());
 
     ~ThreadPool();
     ThreadPool(const ThreadPool& other) = delete;
@@ -22,9 +26,47 @@ public:
     void Stop();
     void Start();
 private:
+    // 类型擦除的任务，执行或丢弃后自行销毁并归还内存
+    struct TaskBase {
+        virtual void run() = 0;
+        virtual void discard() = 0;    // 不执行，future 得到 broken_promise
+    protected:
+        ~TaskBase() = default;
+    };
+
+    template<class R, class Fn>
+    struct Task final : TaskBase {
+        std::pmr::polymorphic_allocator<> alloc;
+        std::promise<R> promise;
+        Fn fn;
+
+        Task(std::pmr::polymorphic_allocator<> a, Fn&& f)
+            : alloc(a), promise(std::allocator_arg, a), fn(std::move(f)) {}
+
+        void run() override {
+            try {
+                if constexpr (std::is_void_v<R>) {
+                    fn();
+                    promise.set_value();
+                } else {
+                    promise.set_value(fn());
+                }
+            } catch (...) {
+                promise.set_exception(std::current_exception());
+            }
+            discard();
+        }
+
+        void discard() override {
+            auto a = alloc;
+            a.delete_object(this);
+        }
+    };
+
     void workerThread();
     std::vector<std::thread> mWorks;
-    std::queue<std::function<void()>> mQueueTasks;
+    std::pmr::memory_resource* mResource;
+    std::queue<TaskBase*, std::pmr::deque<TaskBase*>> mQueueTasks;
     std::mutex mtx;
     std::condition_variable mCv;
     std::atomic<bool> mStart;
@@ -35,20 +77,24 @@ template<class F, class...Args>
 auto ThreadPool::enqueue(F &&f, Args &&...args)->std::future<typename std::invoke_result_t<F, Args...>>
 {
     using return_type = typename std::invoke_result_t<F, Args...>;
-    auto task = std::make_shared<std::packaged_task<return_type()>>(
-        [f = std::forward<F>(f), ... args = std::forward<Args>(args)]() mutable -> return_type {
-            return f(args...);
-        }
-    );
+    auto fn = [f = std::forward<F>(f), ... args = std::forward<Args>(args)]() mutable -> return_type {
+        return f(args...);
+    };
+    std::pmr::polymorphic_allocator<> alloc(mResource);
+    auto* task = alloc.new_object<Task<return_type, decltype(fn)>>(alloc, std::move(fn));
 
-    std::future<return_type> res = task->get_future();
+    std::future<return_type> res = task->promise.get_future();
     {
         std::unique_lock<std::mutex> lk(mtx);
-        if (!mStart) {
-            throw std::runtime_error("enqueue on stopped ThreadPool");
+        if (mStart) {
+            mQueueTasks.push(task);
+            task = nullptr;
         }
-        mQueueTasks.emplace([task]() { (*task)(); });
+    }
+    if (task) {
+        task->discard();
+        throw std::runtime_error("enqueue on stopped ThreadPool");
     }
     mCv.notify_one();
     return res;
-}
\ No newline at end of file
+}